@@ -0,0 +1,145 @@
+// Measures how many arrangements per second a BatchRenderer gets through with
+// different numbers of worker threads, all rendering the same few songs. The
+// songs are synthesized and written as WAV files first, so the benchmark needs
+// no input files.
+
+#include <bqBatchRenderer.h>
+#include <bqLibrary.h>
+
+#include <miniaudio.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const ma_uint32 NUM_CHANNELS = 2;
+static const ma_uint32 SAMPLE_RATE = 44100;
+static const unsigned int NUM_SONGS = 4;
+static const unsigned int SONG_NUM_SECONDS = 30;
+static const unsigned int NUM_JOBS = 64;
+static const double JOB_NUM_BEATS = 32.0;
+
+bool write_song(const std::string &filename, double frequency)
+{
+	ma_encoder_config encoder_cfg = ma_encoder_config_init(
+		ma_resource_format_wav, ma_format_f32, NUM_CHANNELS,
+		SAMPLE_RATE);
+
+	ma_encoder encoder;
+	if (ma_encoder_init_file(filename.c_str(), &encoder_cfg, &encoder) !=
+		MA_SUCCESS) {
+		return false;
+	}
+
+	ma_uint64 num_frames = static_cast<ma_uint64>(SONG_NUM_SECONDS) *
+		SAMPLE_RATE;
+	std::vector<float> frames(num_frames * NUM_CHANNELS);
+	for (ma_uint64 i = 0; i < num_frames; ++i) {
+		float sample = 0.25f * static_cast<float>(std::sin(6.283185307 *
+			frequency * static_cast<double>(i) / SAMPLE_RATE));
+		for (ma_uint32 j = 0; j < NUM_CHANNELS; ++j) {
+			frames[i * NUM_CHANNELS + j] = sample;
+		}
+	}
+
+	bool result = ma_encoder_write_pcm_frames(&encoder, frames.data(),
+		num_frames) == num_frames;
+
+	ma_encoder_uninit(&encoder);
+
+	return result;
+}
+
+// Every job plays all the songs at once, one per track, at a tempo of its own
+bq::BatchRenderJob make_job(unsigned int job_idx)
+{
+	bq::BatchRenderJob job;
+	job.setup = [job_idx](bq::World &world) {
+		world.set_bpm(100.0 + static_cast<double>(job_idx % 40));
+		for (unsigned int i = 0; i < NUM_SONGS &&
+			i < world.get_num_tracks(); ++i) {
+			world.insert_clip(i, 0.0, JOB_NUM_BEATS, 0.125, 0.125,
+				0.0, 0, i);
+		}
+	};
+	job.from_beat = 0.0;
+	job.to_beat = JOB_NUM_BEATS;
+	job.on_block = [](const float *, const float *const *, ma_uint64) {
+		return true;
+	};
+
+	return job;
+}
+
+double renders_per_second(bq::Library &library, unsigned int num_threads)
+{
+	bq::BatchRendererConfig config;
+	config.num_threads = num_threads;
+
+	bq::BatchRenderer renderer(&library, NUM_CHANNELS, SAMPLE_RATE,
+		config);
+
+	std::atomic<unsigned int> num_failed(0);
+
+	auto begin = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < NUM_JOBS; ++i) {
+		renderer.submit(make_job(i), [&num_failed](unsigned int,
+			bool succeeded) {
+			if (!succeeded) {
+				num_failed.fetch_add(1);
+			}
+		});
+	}
+	renderer.wait();
+	auto end = std::chrono::steady_clock::now();
+
+	if (num_failed.load() > 0) {
+		std::cerr << num_failed.load() << " renders failed" <<
+			std::endl;
+	}
+
+	double num_seconds = std::chrono::duration<double>(end - begin)
+		.count();
+	return static_cast<double>(NUM_JOBS) / num_seconds;
+}
+
+int main(int argc, char *argv[])
+{
+	bq::Library library;
+	library.set_out_sample_rate(SAMPLE_RATE);
+
+	for (unsigned int i = 0; i < NUM_SONGS; ++i) {
+		std::string filename = "batch-render-song-" +
+			std::to_string(i) + ".wav";
+		if (!write_song(filename, 220.0 * (i + 1))) {
+			std::cerr << "Unable to write " << filename <<
+				std::endl;
+			return 1;
+		}
+		library.add_song(filename, SAMPLE_RATE, 120.0);
+	}
+
+	unsigned int max_num_threads = std::thread::hardware_concurrency();
+	if (max_num_threads < 1) {
+		max_num_threads = 1;
+	}
+
+	double single_thread_rate = 0.0;
+	for (unsigned int num_threads = 1; num_threads <= max_num_threads;
+		num_threads *= 2) {
+		double rate = renders_per_second(library, num_threads);
+		if (num_threads == 1) {
+			single_thread_rate = rate;
+		}
+
+		std::cout << num_threads << " threads: " << rate <<
+			" renders/s (" << rate / single_thread_rate <<
+			"x)" << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,118 @@
+// Measures how long the audio thread takes to find the current clip in a
+// track with a very large number of clips, comparing a scan over whole
+// AudioClip records (the layout clips used to be published in) with the
+// structure-of-arrays scan AudioClipsArray performs now.
+
+#include <bqAudioClipsArray.h>
+
+#include <chrono>
+#include <iostream>
+
+static const unsigned int NUM_CLIPS = 100000;
+static const unsigned int NUM_REPEATS = 200;
+
+unsigned int scan_clip_records(const bq::AudioClip *clips,
+	unsigned int num_clips, unsigned int from_idx, double beat)
+{
+	unsigned int cur_clip_idx = 0;
+	for (unsigned int i = from_idx; i < num_clips; ++i) {
+		if (clips[i].start <= beat) {
+			cur_clip_idx = i;
+		} else {
+			break;
+		}
+	}
+
+	return cur_clip_idx;
+}
+
+unsigned int scan_clip_starts(bq::AudioClipsArray &track,
+	unsigned int from_idx, double beat)
+{
+	unsigned int num_started = track.count_starts_at_or_before(beat,
+		from_idx);
+	return num_started > 0 ? from_idx + num_started - 1 : 0;
+}
+
+template<class F>
+double time_ns(F f)
+{
+	auto begin = std::chrono::steady_clock::now();
+	f();
+	auto end = std::chrono::steady_clock::now();
+	return static_cast<double>(std::chrono::duration_cast<
+		std::chrono::nanoseconds>(end - begin).count());
+}
+
+int main(int argc, char *argv[])
+{
+	bq::AudioClipsArray track;
+	track.allocate(NUM_CLIPS);
+	for (unsigned int i = 0; i < NUM_CLIPS; ++i) {
+		bq::AudioClip &clip = track.clips[i];
+		clip.start = static_cast<double>(i);
+		clip.end = clip.start + 0.5;
+		track.starts[i] = clip.start;
+		track.ends[i] = clip.end;
+	}
+
+	// A jump to the end of the arrangement makes the audio thread scan
+	// every clip from the beginning of the track
+	double jump_beat = static_cast<double>(NUM_CLIPS) - 0.25;
+	volatile unsigned int sink = 0;
+
+	double records_ns = time_ns([&]() {
+		for (unsigned int i = 0; i < NUM_REPEATS; ++i) {
+			sink = scan_clip_records(track.clips, NUM_CLIPS, 0,
+				jump_beat);
+		}
+	}) / NUM_REPEATS;
+	double starts_ns = time_ns([&]() {
+		for (unsigned int i = 0; i < NUM_REPEATS; ++i) {
+			sink = scan_clip_starts(track, 0, jump_beat);
+		}
+	}) / NUM_REPEATS;
+
+	std::cout << "Full scan of " << NUM_CLIPS << " clips after a jump:"
+		<< std::endl;
+	std::cout << "  AudioClip records: " << records_ns / 1000.0 << " us"
+		<< std::endl;
+	std::cout << "  Start beat array:  " << starts_ns / 1000.0 << " us ("
+		<< records_ns / starts_ns << "x)" << std::endl;
+
+	// Normal playback only advances a fraction of a beat per callback, so
+	// most scans only look at one or two clips
+	const double BEATS_PER_CALLBACK = 0.02;
+	unsigned int records_idx = 0, starts_idx = 0;
+	double playback_records_ns = time_ns([&]() {
+		for (double beat = 0.0; beat < NUM_CLIPS;
+			beat += BEATS_PER_CALLBACK) {
+			records_idx = scan_clip_records(track.clips, NUM_CLIPS,
+				records_idx, beat);
+		}
+	});
+	double playback_starts_ns = time_ns([&]() {
+		for (double beat = 0.0; beat < NUM_CLIPS;
+			beat += BEATS_PER_CALLBACK) {
+			starts_idx = scan_clip_starts(track, starts_idx, beat);
+		}
+	});
+	double num_callbacks = NUM_CLIPS / BEATS_PER_CALLBACK;
+
+	std::cout << "Incremental scan during playback (per callback):"
+		<< std::endl;
+	std::cout << "  AudioClip records: " << playback_records_ns /
+		num_callbacks << " ns" << std::endl;
+	std::cout << "  Start beat array:  " << playback_starts_ns /
+		num_callbacks << " ns" << std::endl;
+
+	if (records_idx != starts_idx) {
+		std::cerr << "Scans disagree" << std::endl;
+		track.deallocate();
+		return 1;
+	}
+
+	track.deallocate();
+
+	return 0;
+}
@@ -0,0 +1,809 @@
+// Measures the costs that matter most for glitch-free playback and editing,
+// and prints them as JSON so that runs can be compared against each other to
+// catch regressions:
+//
+//  - pull: time the audio thread spends pulling every track per callback,
+//    against the number of tracks, how densely they're filled with clips,
+//    and how far the clips are stretched
+//  - decode: IOAudioFileDecoder::decode() throughput for several formats
+//  - preload: latency of the preload made for every inserted clip
+//  - edit: cost of inserting or erasing a clip and publishing the track,
+//    against the number of clips already in the track
+//  - jump: time from a playhead jump until the pulled audio is audible,
+//    both into a clip's preload and into the middle of a clip
+//  - storage: cost of converting buffered frames from each SampleStorage
+//    back to floats as the audio thread does, and the error each one adds
+//  - kernels: time a callback spends in the per-frame render loops (silence,
+//    fades and copies out of mono and stereo buffers), with the kernels
+//    specialized for the channel count against the generic ones
+//  - parallel: World::pull_mix() of many stretched tracks per callback,
+//    against the number of render workers helping the audio thread
+//
+// The test audio is synthesized and written as WAV files in the working
+// directory first (and deleted afterwards), so no input files are needed. The
+// pull benchmark reads it from a synthetic AudioSource instead, so that file
+// IO and decoding don't disturb the measurements.
+// Usage: hot-paths [output.json]; the JSON goes to stdout by default.
+
+#include <bqWorld.h>
+#include <bqIOAudioFileDecoder.h>
+#include <bqIOTrack.h>
+#include <bqLibrary.h>
+#include <bqTiming.h>
+#include <bqAudioSource.h>
+#include <bqSampleStorage.h>
+#include <bqRenderKernels.h>
+
+#include <miniaudio.h>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const ma_uint32 NUM_CHANNELS = 2;
+static const ma_uint32 SAMPLE_RATE = 44100;
+static const ma_uint64 CALLBACK_NUM_FRAMES = 512;
+static const unsigned int SONG_NUM_SECONDS = 30;
+static const double SONG_BPM = 120.0;
+// The default World's buffer sizes
+static const bq::BufferSizes BUFFER_SIZES =
+	bq::WorldConfig().resolve(SAMPLE_RATE);
+
+struct TestSong {
+	std::string name;
+	std::string filename;
+	ma_format format;
+	ma_uint32 sample_rate;
+};
+
+static const TestSong TEST_SONGS[] = {
+	{ "wav-f32", "hot-paths-f32.wav", ma_format_f32, 44100 },
+	{ "wav-s16", "hot-paths-s16.wav", ma_format_s16, 44100 },
+	{ "wav-s24", "hot-paths-s24.wav", ma_format_s24, 44100 },
+	{ "wav-s32", "hot-paths-s32.wav", ma_format_s32, 44100 },
+	// Needs resampling to the output rate
+	{ "wav-f32-48k", "hot-paths-f32-48k.wav", ma_format_f32, 48000 }
+};
+
+// A chord, so that time stretching has something to work on
+float chord_sample(ma_uint64 frame, ma_uint32 sample_rate)
+{
+	double t = static_cast<double>(frame) / sample_rate;
+	return static_cast<float>(0.2 * std::sin(6.283185307 * 220.0 * t) +
+		0.1 * std::sin(6.283185307 * 277.2 * t) +
+		0.1 * std::sin(6.283185307 * 329.6 * t));
+}
+
+// Generates the chord as it's read, without any file IO
+class ChordReader : public bq::AudioSourceReader {
+public:
+	ChordReader(ma_uint32 num_channels, ma_uint32 sample_rate)
+	{
+		_num_channels = num_channels;
+		_sample_rate = sample_rate;
+		_num_frames = static_cast<ma_uint64>(SONG_NUM_SECONDS) *
+			sample_rate;
+	}
+
+	bool seek(ma_uint64 frame) override
+	{
+		if (frame > _num_frames) {
+			return false;
+		}
+		_cur_frame = frame;
+		return true;
+	}
+
+	ma_uint64 read(float *frames, ma_uint64 num_frames) override
+	{
+		if (num_frames > _num_frames - _cur_frame) {
+			num_frames = _num_frames - _cur_frame;
+		}
+		for (ma_uint64 i = 0; i < num_frames; ++i) {
+			float sample = chord_sample(_cur_frame + i,
+				_sample_rate);
+			for (ma_uint32 j = 0; j < _num_channels; ++j) {
+				frames[i * _num_channels + j] = sample;
+			}
+		}
+		_cur_frame += num_frames;
+		return num_frames;
+	}
+
+	ma_uint64 get_length() override
+	{
+		return _num_frames;
+	}
+
+private:
+	ma_uint32 _num_channels = 0, _sample_rate = 0;
+	ma_uint64 _num_frames = 0, _cur_frame = 0;
+};
+
+class ChordSource : public bq::AudioSource {
+public:
+	std::unique_ptr<bq::AudioSourceReader> open(ma_uint32 num_channels,
+		ma_uint32 sample_rate) const override
+	{
+		return std::unique_ptr<bq::AudioSourceReader>(new ChordReader(
+			num_channels, sample_rate));
+	}
+
+	bool get_native_format(ma_uint32 &num_channels,
+		ma_uint32 &sample_rate) const override
+	{
+		num_channels = NUM_CHANNELS;
+		sample_rate = SAMPLE_RATE;
+		return true;
+	}
+
+	bq::AudioSourceCost get_cost_hint() const override
+	{
+		return bq::AudioSourceCost::MEMORY;
+	}
+};
+
+bool write_song(const TestSong &song)
+{
+	ma_encoder_config encoder_cfg = ma_encoder_config_init(
+		ma_resource_format_wav, song.format, NUM_CHANNELS,
+		song.sample_rate);
+
+	ma_encoder encoder;
+	if (ma_encoder_init_file(song.filename.c_str(), &encoder_cfg,
+		&encoder) != MA_SUCCESS) {
+		return false;
+	}
+
+	ma_uint64 num_frames = static_cast<ma_uint64>(SONG_NUM_SECONDS) *
+		song.sample_rate;
+	std::vector<float> frames(num_frames * NUM_CHANNELS);
+	for (ma_uint64 i = 0; i < num_frames; ++i) {
+		float sample = chord_sample(i, song.sample_rate);
+		for (ma_uint32 j = 0; j < NUM_CHANNELS; ++j) {
+			frames[i * NUM_CHANNELS + j] = sample;
+		}
+	}
+
+	std::vector<unsigned char> converted(num_frames *
+		ma_get_bytes_per_frame(song.format, NUM_CHANNELS));
+	ma_pcm_convert(converted.data(), song.format, frames.data(),
+		ma_format_f32, num_frames * NUM_CHANNELS, ma_dither_mode_none);
+
+	bool result = ma_encoder_write_pcm_frames(&encoder, converted.data(),
+		num_frames) == num_frames;
+
+	ma_encoder_uninit(&encoder);
+
+	return result;
+}
+
+std::string summary_json(const bq::TimingSummary &summary)
+{
+	std::ostringstream out;
+	out << "{\"count\": " << summary.count << ", \"mean_ns\": " <<
+		summary.mean << ", \"p50_ns\": " << summary.p50 <<
+		", \"p99_ns\": " << summary.p99 << ", \"p999_ns\": " <<
+		summary.p999 << ", \"max_ns\": " << summary.max << "}";
+	return out.str();
+}
+
+std::string join(const std::vector<std::string> &entries)
+{
+	std::string result = "[";
+	for (size_t i = 0; i < entries.size(); ++i) {
+		result += (i > 0 ? ",\n\t\t" : "\n\t\t") + entries[i];
+	}
+	result += entries.empty() ? "]" : "\n\t]";
+	return result;
+}
+
+// Does one round of the IO thread's work and then one audio callback, pulling
+// the first num_tracks tracks of the first playhead. Returns the time spent
+// pulling.
+ma_uint64 run_callback(bq::World &world, unsigned int num_tracks,
+	float *frames, bool *audible = nullptr)
+{
+	world.pump_io_thread();
+	for (unsigned int i = 0; i < world.get_num_tracks(); ++i) {
+		world.decode_chunks(0, i);
+	}
+	world.pump_audio_thread();
+
+	ma_uint64 start = bq::TimingHistogram::now();
+	for (unsigned int i = 0; i < num_tracks; ++i) {
+		world.pull_audio(0, i, frames + i * CALLBACK_NUM_FRAMES *
+			NUM_CHANNELS, CALLBACK_NUM_FRAMES);
+	}
+	world.pull_done_advance_playhead(0, CALLBACK_NUM_FRAMES);
+	ma_uint64 elapsed = bq::TimingHistogram::now() - start;
+
+	if (audible) {
+		*audible = false;
+		for (ma_uint64 i = 0; i < num_tracks * CALLBACK_NUM_FRAMES *
+			NUM_CHANNELS; ++i) {
+			if (frames[i] != 0.0f) {
+				*audible = true;
+				break;
+			}
+		}
+	}
+
+	return elapsed;
+}
+
+std::string bench_pull_case(unsigned int num_tracks, double clip_num_beats,
+	double stretch_ratio)
+{
+	const double ARRANGEMENT_NUM_BEATS = 16.0;
+	const unsigned int NUM_CALLBACKS = 500;
+
+	std::vector<float> frames(num_tracks * CALLBACK_NUM_FRAMES *
+		NUM_CHANNELS);
+
+	bq::WorldConfig config;
+	config.num_tracks = num_tracks;
+	config.num_playheads = 1;
+	bq::World world(NUM_CHANNELS, SAMPLE_RATE, config);
+	unsigned int song_id = world.add_song(std::make_shared<ChordSource>(),
+		SONG_BPM);
+	world.set_bpm(SONG_BPM * stretch_ratio);
+
+	unsigned int num_clips = 0;
+	for (unsigned int i = 0; i < num_tracks; ++i) {
+		for (double beat = 0.0; beat < ARRANGEMENT_NUM_BEATS;
+			beat += clip_num_beats) {
+			world.insert_clip(i, beat, beat + clip_num_beats, 0.0,
+				0.0, 0.0, 0, song_id);
+			++num_clips;
+		}
+	}
+	world.set_playhead_beat(0, 0.0);
+	for (unsigned int i = 0; i < 3; ++i) {
+		run_callback(world, num_tracks, frames.data());
+	}
+
+	bq::TimingHistogram histogram;
+	histogram.set_enabled(true);
+	for (unsigned int i = 0; i < NUM_CALLBACKS; ++i) {
+		histogram.record(run_callback(world, num_tracks,
+			frames.data()));
+	}
+
+	bq::Stats stats = world.get_stats();
+	ma_uint64 num_underruns = 0;
+	for (unsigned int i = 0; i < num_tracks; ++i) {
+		num_underruns += stats.stream(0, i).num_underruns;
+	}
+
+	std::ostringstream out;
+	out << "{\"num_tracks\": " << num_tracks << ", \"num_clips\": " <<
+		num_clips << ", \"clip_num_beats\": " << clip_num_beats <<
+		", \"stretch_ratio\": " << stretch_ratio <<
+		", \"num_underruns\": " << num_underruns <<
+		", \"callback\": " << summary_json(histogram.summarize()) <<
+		"}";
+	return out.str();
+}
+
+std::vector<std::string> bench_pull()
+{
+	const unsigned int NUM_TRACKS[] = { 1, 2, 4, 8, 16 };
+	const double CLIP_NUM_BEATS[] = { 8.0, 2.0, 0.5 };
+	// World tempo relative to the songs' tempo
+	const double STRETCH_RATIOS[] = { 1.0, 0.8, 1.25 };
+
+	std::vector<std::string> results;
+
+	for (unsigned int num_tracks : NUM_TRACKS) {
+		for (double clip_num_beats : CLIP_NUM_BEATS) {
+			for (double ratio : STRETCH_RATIOS) {
+				results.push_back(bench_pull_case(num_tracks,
+					clip_num_beats, ratio));
+			}
+		}
+	}
+
+	return results;
+}
+
+std::vector<std::string> bench_decode()
+{
+	std::vector<std::string> results;
+
+	bq::Library library;
+	library.set_out_sample_rate(SAMPLE_RATE);
+
+	for (const TestSong &song : TEST_SONGS) {
+		unsigned int song_id = library.add_song(song.filename,
+			song.sample_rate, SONG_BPM);
+
+		bq::IOAudioFileDecoder decoder;
+		decoder.set_decode_config(NUM_CHANNELS, SAMPLE_RATE,
+			BUFFER_SIZES);
+		decoder.bind_library(&library);
+		decoder.set_clip_idx(0);
+		decoder.set_song_id(song_id);
+
+		ma_uint64 num_frames = 0;
+		ma_uint64 start = bq::TimingHistogram::now();
+		while (true) {
+			bq::PlayheadChunk *chunk = decoder.decode(num_frames);
+			if (!chunk) {
+				break;
+			}
+			num_frames += chunk->num_frames;
+			bq::free_samples(chunk->frames);
+			delete chunk;
+		}
+		double num_seconds = static_cast<double>(
+			bq::TimingHistogram::now() - start) / 1e9;
+
+		std::ostringstream out;
+		out << "{\"format\": \"" << song.name <<
+			"\", \"num_frames\": " << num_frames <<
+			", \"frames_per_second\": " <<
+			static_cast<double>(num_frames) / num_seconds <<
+			", \"realtime_factor\": " <<
+			static_cast<double>(num_frames) / SAMPLE_RATE /
+			num_seconds << "}";
+		results.push_back(out.str());
+	}
+
+	return results;
+}
+
+std::vector<std::string> bench_preload()
+{
+	const unsigned int NUM_PRELOADS = 32;
+
+	std::vector<std::string> results;
+
+	bq::Library library;
+	library.set_out_sample_rate(SAMPLE_RATE);
+
+	for (const TestSong &song : TEST_SONGS) {
+		unsigned int song_id = library.add_song(song.filename,
+			song.sample_rate, SONG_BPM);
+
+		bq::TimingHistogram histogram;
+		histogram.set_enabled(true);
+
+		bq::IOTrack track;
+		track.set_preload_config(NUM_CHANNELS, SAMPLE_RATE,
+			BUFFER_SIZES.preload_num_frames,
+			BUFFER_SIZES.sample_storage);
+		track.bind_library(&library);
+		track.bind_preload_timing(&histogram);
+
+		// Start each clip somewhere else in the song, so that every
+		// preload has to seek
+		for (unsigned int i = 0; i < NUM_PRELOADS; ++i) {
+			double beat = static_cast<double>(i);
+			track.insert_clip(beat, beat + 1.0, 0.0, 0.0, song_id,
+				(i * 7919ull * 64) % (SONG_NUM_SECONDS *
+				static_cast<ma_uint64>(song.sample_rate) / 2),
+				0.0, 0.0);
+		}
+
+		results.push_back("{\"format\": \"" + song.name +
+			"\", \"preload\": " + summary_json(
+			histogram.summarize()) + "}");
+	}
+
+	return results;
+}
+
+// Publishing is what the IOEngine does after every batch of edits: copy the
+// clips for the AudioEngine and hand over the preloads it no longer needs
+void publish(bq::IOTrack &track)
+{
+	bq::AudioClipsArray clips = track.copy_clips();
+	clips.deallocate();
+
+	for (bq::AudioClipPreload &preload : track.take_old_preloads()) {
+		bq::free_samples(preload.frames);
+	}
+}
+
+std::vector<std::string> bench_edit()
+{
+	const unsigned int NUM_CLIPS[] = { 16, 64, 256 };
+	const unsigned int NUM_EDITS = 64;
+	// Preloads are the biggest part of every clip, so they're kept mono
+	// to keep the largest arrangement's memory use reasonable
+	const ma_uint32 EDIT_NUM_CHANNELS = 1;
+
+	std::vector<std::string> results;
+
+	bq::Library library;
+	library.set_out_sample_rate(SAMPLE_RATE);
+	unsigned int song_id = library.add_song(TEST_SONGS[0].filename,
+		SAMPLE_RATE, SONG_BPM);
+
+	// Preloads are copied from here rather than decoded, so that the edits
+	// themselves aren't drowned out by decoding
+	bq::DecodedSongCache cache(SONG_NUM_SECONDS * SAMPLE_RATE *
+		EDIT_NUM_CHANNELS * sizeof(float) * 2ull);
+	library.bind_decoded_song_cache(&cache);
+
+	for (unsigned int num_clips : NUM_CLIPS) {
+		bq::IOTrack track;
+		track.set_preload_config(EDIT_NUM_CHANNELS, SAMPLE_RATE,
+			BUFFER_SIZES.preload_num_frames,
+			BUFFER_SIZES.sample_storage);
+		track.bind_library(&library);
+
+		for (unsigned int i = 0; i < num_clips; ++i) {
+			double beat = 2.0 * i;
+			track.insert_clip(beat, beat + 1.0, 0.0, 0.0, song_id,
+				0, 0.0, 0.0);
+		}
+		publish(track);
+
+		bq::TimingHistogram insert_histogram, erase_histogram;
+		insert_histogram.set_enabled(true);
+		erase_histogram.set_enabled(true);
+
+		// Edit in the gap in the middle of the track
+		double beat = 2.0 * (num_clips / 2) + 1.25;
+		for (unsigned int i = 0; i < NUM_EDITS; ++i) {
+			ma_uint64 start = bq::TimingHistogram::now();
+			track.insert_clip(beat, beat + 0.5, 0.0, 0.0, song_id,
+				0, 0.0, 0.0);
+			publish(track);
+			insert_histogram.record(bq::TimingHistogram::now() -
+				start);
+
+			start = bq::TimingHistogram::now();
+			track.erase_clips_range(beat, beat + 0.5);
+			publish(track);
+			erase_histogram.record(bq::TimingHistogram::now() -
+				start);
+		}
+
+		std::ostringstream out;
+		out << "{\"num_clips\": " << num_clips <<
+			", \"insert_and_publish\": " << summary_json(
+			insert_histogram.summarize()) <<
+			", \"erase_and_publish\": " << summary_json(
+			erase_histogram.summarize()) << "}";
+		results.push_back(out.str());
+	}
+
+	library.bind_decoded_song_cache(nullptr);
+
+	return results;
+}
+
+std::vector<std::string> bench_jump()
+{
+	const unsigned int NUM_JUMPS = 32;
+	const unsigned int MAX_NUM_CALLBACKS = 1000;
+	// Jumps alternate between two beats, so that every jump really moves
+	// the playhead
+	struct JumpCase {
+		const char *name;
+		double beats[2];
+	};
+	// The clip's preload covers its first 4 seconds (8 beats)
+	const JumpCase CASES[] = {
+		{ "into_preload", { 0.0, 4.0 } },
+		{ "into_stream", { 32.0, 44.0 } }
+	};
+
+	std::vector<std::string> results;
+	std::vector<float> frames(CALLBACK_NUM_FRAMES * NUM_CHANNELS);
+
+	for (const JumpCase &jump_case : CASES) {
+		bq::World world(NUM_CHANNELS, SAMPLE_RATE);
+		unsigned int song_id = world.add_song(TEST_SONGS[0].filename,
+			SAMPLE_RATE, SONG_BPM);
+		world.set_bpm(SONG_BPM);
+		world.insert_clip(0, 0.0, 56.0, 0.0, 0.0, 0.0, 0, song_id);
+
+		bq::TimingHistogram time_histogram, callbacks_histogram;
+		time_histogram.set_enabled(true);
+		callbacks_histogram.set_enabled(true);
+		unsigned int num_never_audible = 0;
+
+		for (unsigned int i = 0; i < NUM_JUMPS; ++i) {
+			ma_uint64 start = bq::TimingHistogram::now();
+			world.set_playhead_beat(0, jump_case.beats[i % 2]);
+
+			bool audible = false;
+			unsigned int num_callbacks = 0;
+			while (!audible && num_callbacks < MAX_NUM_CALLBACKS) {
+				run_callback(world, 1, frames.data(), &audible);
+				++num_callbacks;
+			}
+
+			if (audible) {
+				time_histogram.record(
+					bq::TimingHistogram::now() - start);
+				callbacks_histogram.record(num_callbacks);
+			} else {
+				++num_never_audible;
+			}
+		}
+
+		bq::TimingSummary callbacks = callbacks_histogram.summarize();
+
+		std::ostringstream out;
+		out << "{\"case\": \"" << jump_case.name <<
+			"\", \"num_never_audible\": " << num_never_audible <<
+			", \"callbacks_p50\": " << callbacks.p50 <<
+			", \"callbacks_max\": " << callbacks.max <<
+			", \"time\": " << summary_json(
+			time_histogram.summarize()) << "}";
+		results.push_back(out.str());
+	}
+
+	return results;
+}
+
+std::vector<std::string> bench_storage()
+{
+	const unsigned int NUM_PASSES = 64;
+
+	struct Storage {
+		std::string name;
+		bq::SampleStorage storage;
+	};
+	static const Storage STORAGES[] = {
+		{ "f32", bq::SampleStorage::F32 },
+		{ "s16", bq::SampleStorage::S16 },
+		{ "f16", bq::SampleStorage::F16 }
+	};
+
+	std::vector<std::string> results;
+
+	ma_uint64 num_samples = BUFFER_SIZES.preload_num_frames *
+		NUM_CHANNELS;
+	std::vector<float> src(num_samples), dest(num_samples);
+	for (ma_uint64 i = 0; i < num_samples; ++i) {
+		src[i] = chord_sample(i / NUM_CHANNELS, SAMPLE_RATE);
+	}
+
+	ma_uint64 callback_num_samples = CALLBACK_NUM_FRAMES * NUM_CHANNELS;
+	for (const Storage &storage : STORAGES) {
+		void *stored = bq::allocate_samples(storage.storage,
+			num_samples);
+		bq::store_samples(stored, storage.storage, src.data(),
+			num_samples);
+
+		// A callback's worth at a time, like pulls from a preload
+		ma_uint64 start = bq::TimingHistogram::now();
+		for (unsigned int i = 0; i < NUM_PASSES; ++i) {
+			for (ma_uint64 j = 0; j < num_samples;
+				j += callback_num_samples) {
+				ma_uint64 n = num_samples - j;
+				if (n > callback_num_samples) {
+					n = callback_num_samples;
+				}
+				bq::load_samples(dest.data() + j,
+					bq::sample_at(stored, storage.storage,
+					j), storage.storage, n);
+			}
+		}
+		double num_seconds = static_cast<double>(
+			bq::TimingHistogram::now() - start) / 1e9;
+
+		double max_error = 0.0;
+		for (ma_uint64 i = 0; i < num_samples; ++i) {
+			double error = std::abs(static_cast<double>(dest[i]) -
+				src[i]);
+			if (error > max_error) {
+				max_error = error;
+			}
+		}
+		bq::free_samples(stored);
+
+		std::ostringstream out;
+		out << "{\"storage\": \"" << storage.name <<
+			"\", \"bytes_per_sample\": " <<
+			bq::sample_storage_num_bytes(storage.storage) <<
+			", \"samples_per_second\": " <<
+			static_cast<double>(num_samples) * NUM_PASSES /
+			num_seconds << ", \"max_error\": " << max_error << "}";
+		results.push_back(out.str());
+	}
+
+	return results;
+}
+
+// One callback's worth of the render loops a stream runs: a fade over the
+// whole callback, copies out of a stereo and a mono buffer, and silence
+static void run_kernels(const bq::RenderKernels &kernels, float *dest,
+	const float *gains, const void *stereo, const void *mono,
+	bq::SampleStorage storage)
+{
+	kernels.load_frames(dest, stereo, storage, NUM_CHANNELS,
+		CALLBACK_NUM_FRAMES);
+	kernels.apply_gains(dest, gains, CALLBACK_NUM_FRAMES);
+	kernels.load_frames(dest, mono, storage, 1, CALLBACK_NUM_FRAMES);
+	kernels.apply_gains(dest, gains, CALLBACK_NUM_FRAMES);
+	kernels.fill_silence(dest, CALLBACK_NUM_FRAMES);
+}
+
+std::vector<std::string> bench_kernels()
+{
+	const unsigned int NUM_CALLBACKS = 20000;
+	const bq::SampleStorage STORAGE = bq::SampleStorage::S16;
+
+	ma_uint64 num_samples = CALLBACK_NUM_FRAMES * NUM_CHANNELS;
+	std::vector<float> src(num_samples), dest(num_samples);
+	std::vector<float> gains(CALLBACK_NUM_FRAMES);
+	for (ma_uint64 i = 0; i < num_samples; ++i) {
+		src[i] = chord_sample(i / NUM_CHANNELS, SAMPLE_RATE);
+	}
+	for (ma_uint64 i = 0; i < CALLBACK_NUM_FRAMES; ++i) {
+		gains[i] = static_cast<float>(i) / CALLBACK_NUM_FRAMES;
+	}
+
+	void *stereo = bq::allocate_samples(STORAGE, num_samples);
+	bq::store_samples(stereo, STORAGE, src.data(), num_samples);
+	void *mono = bq::allocate_samples(STORAGE, CALLBACK_NUM_FRAMES);
+	bq::store_samples(mono, STORAGE, src.data(), CALLBACK_NUM_FRAMES);
+
+	std::vector<std::string> results;
+	for (bool generic : { true, false }) {
+		bq::RenderKernels kernels;
+		kernels.select(NUM_CHANNELS, generic);
+
+		// Warm up the caches first
+		run_kernels(kernels, dest.data(), gains.data(), stereo, mono,
+			STORAGE);
+
+		ma_uint64 start = bq::TimingHistogram::now();
+		for (unsigned int i = 0; i < NUM_CALLBACKS; ++i) {
+			run_kernels(kernels, dest.data(), gains.data(),
+				stereo, mono, STORAGE);
+		}
+		double ns_per_callback = static_cast<double>(
+			bq::TimingHistogram::now() - start) / NUM_CALLBACKS;
+
+		std::ostringstream out;
+		out << "{\"kernels\": \"" << (kernels.is_specialized() ?
+			"specialized" : "generic") <<
+			"\", \"num_channels\": " << NUM_CHANNELS <<
+			", \"ns_per_callback\": " << ns_per_callback << "}";
+		results.push_back(out.str());
+	}
+
+	bq::free_samples(stereo);
+	bq::free_samples(mono);
+
+	return results;
+}
+
+std::string bench_parallel_case(unsigned int num_tracks,
+	unsigned int num_workers)
+{
+	const double ARRANGEMENT_NUM_BEATS = 16.0;
+	const double STRETCH_RATIO = 1.25;
+	const unsigned int NUM_CALLBACKS = 500;
+
+	std::vector<float> mix(CALLBACK_NUM_FRAMES * NUM_CHANNELS);
+
+	bq::WorldConfig config;
+	config.num_tracks = num_tracks;
+	config.num_playheads = 1;
+	config.num_render_workers = num_workers;
+	bq::World world(NUM_CHANNELS, SAMPLE_RATE, config);
+	unsigned int song_id = world.add_song(std::make_shared<ChordSource>(),
+		SONG_BPM);
+	world.set_bpm(SONG_BPM * STRETCH_RATIO);
+
+	for (unsigned int i = 0; i < num_tracks; ++i) {
+		world.insert_clip(i, 0.0, ARRANGEMENT_NUM_BEATS, 0.0, 0.0, 0.0,
+			0, song_id);
+	}
+	world.set_playhead_beat(0, 0.0);
+
+	bq::TimingHistogram histogram;
+	histogram.set_enabled(true);
+	for (unsigned int i = 0; i < NUM_CALLBACKS + 3; ++i) {
+		world.pump_io_thread();
+		for (unsigned int j = 0; j < num_tracks; ++j) {
+			world.decode_chunks(0, j);
+		}
+		world.pump_audio_thread();
+
+		ma_uint64 start = bq::TimingHistogram::now();
+		world.pull_mix(0, mix.data(), bq::MixFormat::F32,
+			CALLBACK_NUM_FRAMES);
+		// The first few callbacks only warm up
+		if (i >= 3) {
+			histogram.record(bq::TimingHistogram::now() - start);
+		}
+	}
+
+	std::ostringstream out;
+	out << "{\"num_tracks\": " << num_tracks <<
+		", \"num_render_workers\": " << num_workers <<
+		", \"stretch_ratio\": " << STRETCH_RATIO <<
+		", \"callback\": " << summary_json(histogram.summarize()) <<
+		"}";
+	return out.str();
+}
+
+std::vector<std::string> bench_parallel()
+{
+	const unsigned int NUM_TRACKS[] = { 8, 32 };
+	const unsigned int NUM_WORKERS[] = { 0, 1, 3, 7 };
+
+	std::vector<std::string> results;
+
+	for (unsigned int num_tracks : NUM_TRACKS) {
+		for (unsigned int num_workers : NUM_WORKERS) {
+			results.push_back(bench_parallel_case(num_tracks,
+				num_workers));
+		}
+	}
+
+	return results;
+}
+
+int main(int argc, char *argv[])
+{
+	for (const TestSong &song : TEST_SONGS) {
+		if (!write_song(song)) {
+			std::cerr << "Unable to write " << song.filename <<
+				std::endl;
+			return 1;
+		}
+	}
+
+	std::cerr << "pull..." << std::endl;
+	std::vector<std::string> pull = bench_pull();
+	std::cerr << "decode..." << std::endl;
+	std::vector<std::string> decode = bench_decode();
+	std::cerr << "preload..." << std::endl;
+	std::vector<std::string> preload = bench_preload();
+	std::cerr << "edit..." << std::endl;
+	std::vector<std::string> edit = bench_edit();
+	std::cerr << "jump..." << std::endl;
+	std::vector<std::string> jump = bench_jump();
+	std::cerr << "storage..." << std::endl;
+	std::vector<std::string> storage = bench_storage();
+	std::cerr << "kernels..." << std::endl;
+	std::vector<std::string> kernels = bench_kernels();
+	std::cerr << "parallel..." << std::endl;
+	std::vector<std::string> parallel = bench_parallel();
+
+	for (const TestSong &song : TEST_SONGS) {
+		std::remove(song.filename.c_str());
+	}
+
+	std::ostringstream json;
+	json << "{\n\t\"sample_rate\": " << SAMPLE_RATE <<
+		",\n\t\"num_channels\": " << NUM_CHANNELS <<
+		",\n\t\"callback_num_frames\": " << CALLBACK_NUM_FRAMES <<
+		",\n\t\"pull\": " << join(pull) <<
+		",\n\t\"decode\": " << join(decode) <<
+		",\n\t\"preload\": " << join(preload) <<
+		",\n\t\"edit\": " << join(edit) <<
+		",\n\t\"jump\": " << join(jump) <<
+		",\n\t\"storage\": " << join(storage) <<
+		",\n\t\"kernels\": " << join(kernels) <<
+		",\n\t\"parallel\": " << join(parallel) << "\n}\n";
+
+	if (argc > 1) {
+		std::ofstream file(argv[1]);
+		file << json.str();
+		if (!file) {
+			std::cerr << "Unable to write " << argv[1] << std::endl;
+			return 1;
+		}
+	} else {
+		std::cout << json.str();
+	}
+
+	return 0;
+}
@@ -0,0 +1,163 @@
+// Measures how much the IO thread polling per-stream state slows down the
+// audio thread, comparing tightly packed per-track atomic arrays that both
+// threads write (the layout AudioPlayhead and IOEngine used to have) with
+// cache-line-aligned per-stream blocks that each have a single writer.
+//
+// Contention only shows up when the two threads actually run at the same
+// time, so run this on a machine with at least two free cores.
+
+#include <bqConfig.h>
+
+#include <miniaudio.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+static const unsigned int NUM_TRACKS = 64;
+static const unsigned int NUM_CALLBACKS = 200000;
+static const ma_uint64 CALLBACK_NUM_FRAMES = 256;
+
+struct PackedState {
+	std::atomic<ma_uint64> cur_want_frame[NUM_TRACKS];
+	std::atomic<unsigned int> cur_clip_idx[NUM_TRACKS];
+	std::atomic<bool> wait_cur_want_frame[NUM_TRACKS];
+
+	PackedState()
+	{
+		for (unsigned int i = 0; i < NUM_TRACKS; ++i) {
+			cur_want_frame[i] = 0;
+			cur_clip_idx[i] = 0;
+			wait_cur_want_frame[i] = false;
+		}
+	}
+
+	void audio_callback()
+	{
+		for (unsigned int i = 0; i < NUM_TRACKS; ++i) {
+			cur_want_frame[i] = cur_want_frame[i] +
+				CALLBACK_NUM_FRAMES;
+			cur_clip_idx[i] = 0;
+			if (wait_cur_want_frame[i]) {
+				wait_cur_want_frame[i] = false;
+			}
+		}
+	}
+
+	ma_uint64 io_poll(unsigned int iteration)
+	{
+		ma_uint64 sum = 0;
+		for (unsigned int i = 0; i < NUM_TRACKS; ++i) {
+			if (!wait_cur_want_frame[i]) {
+				sum += cur_want_frame[i] + cur_clip_idx[i];
+			}
+			if (iteration % 16 == 0) {
+				wait_cur_want_frame[i] = true;
+			}
+		}
+		return sum;
+	}
+};
+
+struct AlignedState {
+	struct alignas(bq::CACHE_LINE_NUM_BYTES) AudioBlock {
+		std::atomic<ma_uint64> cur_want_frame;
+		std::atomic<ma_uint64> want_frame_ack;
+		std::atomic<unsigned int> cur_clip_idx;
+	} audio[NUM_TRACKS];
+	struct alignas(bq::CACHE_LINE_NUM_BYTES) IOBlock {
+		std::atomic<ma_uint64> want_frame_request;
+	} io[NUM_TRACKS];
+
+	AlignedState()
+	{
+		for (unsigned int i = 0; i < NUM_TRACKS; ++i) {
+			audio[i].cur_want_frame = 0;
+			audio[i].want_frame_ack = 0;
+			audio[i].cur_clip_idx = 0;
+			io[i].want_frame_request = 0;
+		}
+	}
+
+	void audio_callback()
+	{
+		for (unsigned int i = 0; i < NUM_TRACKS; ++i) {
+			ma_uint64 request = io[i].want_frame_request;
+			audio[i].cur_want_frame = audio[i].cur_want_frame +
+				CALLBACK_NUM_FRAMES;
+			audio[i].cur_clip_idx = 0;
+			audio[i].want_frame_ack = request;
+		}
+	}
+
+	ma_uint64 io_poll(unsigned int iteration)
+	{
+		ma_uint64 sum = 0;
+		for (unsigned int i = 0; i < NUM_TRACKS; ++i) {
+			ma_uint64 request = io[i].want_frame_request;
+			if (audio[i].want_frame_ack == request) {
+				sum += audio[i].cur_want_frame +
+					audio[i].cur_clip_idx;
+			}
+			if (iteration % 16 == 0) {
+				io[i].want_frame_request = request + 1;
+			}
+		}
+		return sum;
+	}
+};
+
+template<class State>
+double run(const char *name)
+{
+	State *state = new State;
+	std::atomic<bool> running(true);
+	std::atomic<ma_uint64> io_sum(0);
+
+	std::thread io_thread([&]() {
+		ma_uint64 sum = 0;
+		unsigned int iteration = 0;
+		while (running) {
+			sum += state->io_poll(iteration++);
+		}
+		io_sum = sum;
+	});
+
+	auto begin = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < NUM_CALLBACKS; ++i) {
+		state->audio_callback();
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	running = false;
+	io_thread.join();
+	delete state;
+
+	double ns = static_cast<double>(std::chrono::duration_cast<
+		std::chrono::nanoseconds>(end - begin).count()) /
+		NUM_CALLBACKS;
+	std::cout << "  " << name << ": " << ns << " ns per callback"
+		<< std::endl;
+
+	return ns;
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "Audio thread cost of updating " << NUM_TRACKS
+		<< " tracks while the IO thread polls them:" << std::endl;
+
+	double packed_ns = run<PackedState>("Packed arrays  ");
+	double aligned_ns = run<AlignedState>("Aligned blocks ");
+
+	std::cout << "  Speedup: " << packed_ns / aligned_ns << "x"
+		<< std::endl;
+
+	if (std::thread::hardware_concurrency() < 2) {
+		std::cout << "(Only one hardware thread is available, so the "
+			"threads never ran concurrently)" << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,54 @@
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include <miniaudio.h>
+#include <bqWorld.h>
+#include <bqOfflineRenderer.h>
+
+int main(int argc, char *argv[])
+{
+	const ma_uint32 NUM_CHANNELS = 2;
+	const ma_uint32 SAMPLE_RATE = 44100;
+
+	bq::World *world = new bq::World(NUM_CHANNELS, SAMPLE_RATE);
+
+	// A procedurally generated two-second loop, already in the World's
+	// output format, so it's played straight from this buffer without
+	// being copied. The buffer must outlive the World.
+	std::vector<float> loop(2 * SAMPLE_RATE * NUM_CHANNELS);
+	for (size_t i = 0; i < loop.size() / NUM_CHANNELS; ++i) {
+		float sample = 0.25f * static_cast<float>(std::sin(
+			6.283185307 * 110.0 * i / SAMPLE_RATE));
+		loop[i * NUM_CHANNELS] = sample;
+		loop[i * NUM_CHANNELS + 1] = sample;
+	}
+	unsigned int loop_id = world->add_song(loop.data(),
+		loop.size() / NUM_CHANNELS, NUM_CHANNELS, SAMPLE_RATE, 120.0,
+		false);
+
+	// An encoded file that arrived in memory (read from disk here for the
+	// sake of the example). The Library keeps its own copy, so the bytes
+	// may be discarded right away.
+	std::ifstream file("fastsong.mp3", std::ios::binary);
+	std::vector<char> encoded((std::istreambuf_iterator<char>(file)),
+		std::istreambuf_iterator<char>());
+	unsigned int song_id = world->add_song(encoded.data(), encoded.size(),
+		44100.0, 130.0, true);
+	encoded.clear();
+
+	world->insert_clip(0, 0.0, 4.0, 0.0, 0.0, 0, 0, loop_id);
+	world->insert_clip(0, 4.0, 8.0, 0.0, 0.0, 0, 0, loop_id);
+	world->insert_clip(1, 0.0, 8.0, 0.125, 0.125, 0, 0, song_id);
+
+	bq::OfflineRenderer renderer(world);
+	if (!renderer.render_mix(0, 0.0, 8.0, "in-memory.wav")) {
+		std::cerr << "Unable to render in-memory.wav" << std::endl;
+	}
+
+	delete world;
+
+	return 0;
+}
@@ -0,0 +1,39 @@
+#include <iostream>
+
+#include <miniaudio.h>
+#include <bqWorld.h>
+#include <bqOfflineRenderer.h>
+
+int main(int argc, char *argv[])
+{
+	const ma_uint32 NUM_CHANNELS = 2;
+	const ma_uint32 SAMPLE_RATE = 44100;
+
+	// No playback device or IO thread is needed to render offline
+	bq::World *world = new bq::World(NUM_CHANNELS, SAMPLE_RATE);
+
+	// Load two songs with different tempos
+	unsigned int song_1_id = world->add_song("fastsong.mp3", 44100.0,
+		130.0);
+	unsigned int song_2_id = world->add_song("slowsong.mp3", 44100.0,
+		100.0);
+
+	// Arrange them across two tracks
+	world->insert_clip(0, 0.0, 16.0, 0.125, 0.125, 1, 0, song_1_id);
+	world->insert_clip(1, 12.0, 32.0, 0.125, 0.125, -1, 0, song_2_id);
+
+	bq::OfflineRenderer renderer(world);
+
+	// Bounce the first 32 beats of the first playhead, both as a mix and
+	// as one file per track
+	if (!renderer.render_mix(0, 0.0, 32.0, "bounce.wav")) {
+		std::cerr << "Unable to render bounce.wav" << std::endl;
+	}
+	if (!renderer.render_stems(0, 0.0, 32.0, "bounce-track-")) {
+		std::cerr << "Unable to render stems" << std::endl;
+	}
+
+	delete world;
+
+	return 0;
+}
@@ -0,0 +1,179 @@
+//
+// Drives a World through arrangement edits, playhead jumps and tempo changes
+// while rendering, without an output device, and reports every realtime-safety
+// violation made on the audio thread.
+//
+// Build bquence and this program with BQ_REALTIME_AUDIT defined (and
+// optionally BQ_REALTIME_AUDIT_WRAP_LIBC plus the --wrap link options listed
+// in bqRealtimeAudit.cpp). Exits with a non-zero status if any violation was
+// recorded.
+//
+// Usage: realtime-audit [--stack-traces] <song> <sample rate> <bpm> [...]
+//
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <miniaudio.h>
+#include <bqWorld.h>
+#include <bqRealtimeAudit.h>
+
+struct ThreadUserData {
+	bq::World *world = nullptr;
+	std::atomic<bool> running{ false };
+};
+
+static const ma_uint32 NUM_CHANNELS = 2;
+static const ma_uint32 SAMPLE_RATE = 44100;
+static const ma_uint32 CALLBACK_NUM_FRAMES = 512;
+
+void audio_thread(ThreadUserData *user_data)
+{
+	std::vector<float> out_frames(CALLBACK_NUM_FRAMES * NUM_CHANNELS);
+	std::chrono::microseconds period(static_cast<long long>(
+		1000000.0 * CALLBACK_NUM_FRAMES / SAMPLE_RATE));
+
+	while (user_data->running) {
+		bq::World *world = user_data->world;
+
+		world->pump_audio_thread();
+		for (unsigned int p = 0; p < world->get_num_playheads(); ++p) {
+			for (unsigned int t = 0; t < world->get_num_tracks();
+				++t) {
+				world->pull_audio(p, t, out_frames.data(),
+					CALLBACK_NUM_FRAMES);
+			}
+			world->pull_done_advance_playhead(p,
+				CALLBACK_NUM_FRAMES);
+		}
+
+		std::this_thread::sleep_for(period);
+	}
+}
+
+void io_thread(ThreadUserData *user_data)
+{
+	while (user_data->running) {
+		bq::World *world = user_data->world;
+
+		world->pump_io_thread();
+		for (unsigned int p = 0; p < world->get_num_playheads(); ++p) {
+			for (unsigned int t = 0; t < world->get_num_tracks();
+				++t) {
+				world->decode_chunks(p, t);
+			}
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+}
+
+int main(int argc, char *argv[])
+{
+#ifndef BQ_REALTIME_AUDIT
+	std::cerr << "Build with BQ_REALTIME_AUDIT defined to run the audit"
+		<< std::endl;
+	return 1;
+#else
+	int arg_idx = 1;
+	if (arg_idx < argc && std::strcmp(argv[arg_idx], "--stack-traces") ==
+		0) {
+		bq::realtime_audit_set_print_stack_traces(true);
+		++arg_idx;
+	}
+
+	if ((argc - arg_idx) < 3 || (argc - arg_idx) % 3 != 0) {
+		std::cerr << "Usage: " << argv[0] << " [--stack-traces] <song> "
+			"<sample rate> <bpm> [<song> <sample rate> <bpm> ...]"
+			<< std::endl;
+		return 1;
+	}
+
+	bq::World *world = new bq::World(NUM_CHANNELS, SAMPLE_RATE);
+
+	std::vector<unsigned int> song_ids;
+	std::vector<double> song_num_frames;
+	for (; arg_idx < argc; arg_idx += 3) {
+		double sample_rate = std::atof(argv[arg_idx + 1]);
+		double bpm = std::atof(argv[arg_idx + 2]);
+		song_ids.push_back(world->add_song(argv[arg_idx], sample_rate,
+			bpm));
+		song_num_frames.push_back(sample_rate * 30.0);
+	}
+
+	ThreadUserData user_data;
+	user_data.world = world;
+	user_data.running = true;
+
+	std::thread audio = std::thread(audio_thread, &user_data);
+	std::thread io = std::thread(io_thread, &user_data);
+
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<unsigned int> pick_song(0,
+		static_cast<unsigned int>(song_ids.size() - 1));
+	std::uniform_int_distribution<unsigned int> pick_track(0,
+		world->get_num_tracks() - 1);
+	std::uniform_int_distribution<unsigned int> pick_playhead(0,
+		world->get_num_playheads() - 1);
+	std::uniform_real_distribution<double> pick_beat(0.0, 64.0);
+	std::uniform_real_distribution<double> pick_unit(0.0, 1.0);
+
+	// Lay down an initial arrangement on every track
+	for (unsigned int t = 0; t < world->get_num_tracks(); ++t) {
+		for (double beat = 0.0; beat < 64.0; beat += 8.0) {
+			unsigned int s = pick_song(rng);
+			world->insert_clip(t, beat, beat + 8.0, 0.125, 0.125,
+				0.0, 0, song_ids[s]);
+		}
+	}
+
+	// Then hammer it with edits, jumps and tempo changes for a while
+	const int NUM_STEPS = 2000;
+	for (int step = 0; step < NUM_STEPS; ++step) {
+		double action = pick_unit(rng);
+
+		if (action < 0.4) {
+			unsigned int s = pick_song(rng);
+			double start = pick_beat(rng);
+			double end = start + 1.0 + pick_unit(rng) * 8.0;
+			ma_uint64 first_frame = static_cast<ma_uint64>(
+				pick_unit(rng) * song_num_frames[s]);
+			world->insert_clip(pick_track(rng), start, end, 0.125,
+				0.125, (pick_unit(rng) - 0.5) * 4.0,
+				first_frame, song_ids[s]);
+		} else if (action < 0.6) {
+			double from = pick_beat(rng);
+			world->erase_clips_range(pick_track(rng), from,
+				from + pick_unit(rng) * 4.0);
+		} else if (action < 0.9) {
+			world->set_playhead_beat(pick_playhead(rng),
+				pick_beat(rng));
+		} else {
+			world->set_bpm(80.0 + pick_unit(rng) * 100.0);
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+
+	user_data.running = false;
+	audio.join();
+	io.join();
+	delete world;
+
+	bq::RealtimeAuditReport report = bq::realtime_audit_get_report();
+	std::cout << "Allocations on the audio thread:    "
+		<< report.num_allocations << std::endl;
+	std::cout << "Deallocations on the audio thread:  "
+		<< report.num_deallocations << std::endl;
+	std::cout << "Blocking calls on the audio thread: "
+		<< report.num_blocking_calls << std::endl;
+
+	return report.num_violations() > 0 ? 1 : 0;
+#endif
+}
@@ -0,0 +1,95 @@
+#ifndef BQALIGNEDARRAY_H
+#define BQALIGNEDARRAY_H
+
+#include "bqConfig.h"
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace bq {
+//
+// A fixed-size array whose length is only known at runtime. The elements are
+// constructed in place in one contiguous block aligned to at least a cache
+// line, and are never moved or copied, so they may hold atomics and be
+// referenced from other threads for as long as the array exists.
+//
+// allocate() and deallocate() must not be called while another thread might be
+// using the elements; indexing never allocates and is realtime-safe.
+//
+template<class T>
+class AlignedArray {
+public:
+	AlignedArray() {}
+	~AlignedArray()
+	{
+		deallocate();
+	}
+
+	AlignedArray(const AlignedArray &) = delete;
+	AlignedArray &operator=(const AlignedArray &) = delete;
+
+	// Every element is constructed with args
+	template<class... Args>
+	void allocate(size_t size, const Args &...args)
+	{
+		deallocate();
+		if (size < 1) {
+			return;
+		}
+
+		_data = static_cast<T *>(::operator new(size * sizeof(T),
+			std::align_val_t(_ALIGNMENT)));
+		for (_size = 0; _size < size; ++_size) {
+			new (_data + _size) T(args...);
+		}
+	}
+
+	void deallocate()
+	{
+		if (!_data) {
+			return;
+		}
+
+		while (_size > 0) {
+			_data[--_size].~T();
+		}
+		::operator delete(_data, std::align_val_t(_ALIGNMENT));
+		_data = nullptr;
+	}
+
+	size_t size() const
+	{
+		return _size;
+	}
+
+	T &operator[](size_t idx)
+	{
+		return _data[idx];
+	}
+
+	const T &operator[](size_t idx) const
+	{
+		return _data[idx];
+	}
+
+	T *begin()
+	{
+		return _data;
+	}
+
+	T *end()
+	{
+		return _data + _size;
+	}
+
+private:
+	static constexpr size_t _ALIGNMENT = alignof(T) > CACHE_LINE_NUM_BYTES ?
+		alignof(T) : CACHE_LINE_NUM_BYTES;
+
+	T *_data = nullptr;
+	size_t _size = 0;
+};
+}
+
+#endif
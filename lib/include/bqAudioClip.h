@@ -2,6 +2,7 @@
 #define BQAUDIOCLIP_H
 
 #include "bqAudioClipPreload.h"
+#include "bqRenderKernels.h"
 
 #include <miniaudio.h>
 
@@ -11,21 +12,50 @@ public:
 	AudioClip() {}
 	~AudioClip() {}
 
-	ma_uint64 pull_preload(float *dest, ma_uint64 first_pull_frame,
-		ma_uint64 num_pull_frames);
+	// dest has the kernels' channel count, which the preload's own
+	// channels are mapped onto (see RenderKernels::load_frames())
+	ma_uint64 pull_preload(const RenderKernels &kernels, float *dest,
+		ma_uint64 first_pull_frame, ma_uint64 num_pull_frames);
+
+	// Same as Library::beats_to_out_samples for this clip's song, but
+	// without looking anything up in the Library
+	ma_uint64 beats_to_out_frames(double beats) const
+	{
+		if (beats < 0.0) {
+			beats = -beats;
+		}
+
+		return static_cast<ma_uint64>(beats * beats_to_out_frames_factor
+			+ 0.5);
+	}
 
 	double start = -1.0, end = -1.0; // Measured in beats
 	double fade_in = 0.0, fade_out = 0.0; // Measured in beats
 	double pitch_shift = 0.0; // Measured in semitones
 	ma_uint64 first_frame = 0;
 	unsigned int song_id = 0;
+	// 0.0 means the song's (or failing that, the World's) preload length
+	double preload_seconds = 0.0;
+
+	// Contiguous clips from the same song whose frames continue seamlessly
+	// from one clip to the next form a single stream. Every clip in a
+	// stream is rendered relative to the stream's first clip and shares
+	// its preload, so the stretcher and decoder never notice the boundary.
+	double stream_start = -1.0; // Measured in beats
+	ma_uint64 stream_first_frame = 0;
+	unsigned int stream_first_clip_idx = 0;
+
+	// Everything the AudioEngine needs to know about the clip's song is
+	// baked in by IOTrack when the clips are published, so the audio thread
+	// never has to consult the Library
+	double song_bpm = 0.0; // 0.0 if the song ID is invalid
+	double beats_to_out_frames_factor = 0.0;
+	double inv_fade_in = 0.0, inv_fade_out = 0.0; // Measured in 1 / beats
 
 	AudioClipPreload preload;
-
-private:
-	void _copy_frames(float *dest, float *src, ma_uint64 dest_first_frame,
-		ma_uint64 src_first_frame, ma_uint64 num_frames,
-		ma_uint64 num_channels);
+	// False if the preload frames belong to another clip in the stream (or
+	// if nothing has been preloaded yet)
+	bool owns_preload = false;
 };
 }
 
@@ -1,6 +1,8 @@
 #ifndef BQAUDIOCLIPPRELOAD_H
 #define BQAUDIOCLIPPRELOAD_H
 
+#include "bqSampleStorage.h"
+
 #include <miniaudio.h>
 
 namespace bq {
@@ -9,7 +11,18 @@ struct AudioClipPreload {
 	ma_uint64 sample_rate = 0;
 	ma_uint64 first_frame = 0;
 	ma_uint64 num_frames = 0;
-	float *frames = nullptr;
+	// Frames asked for when the preload was made; num_frames falls short of
+	// it if the song ended sooner
+	ma_uint64 want_num_frames = 0;
+	void *frames = nullptr;
+	SampleStorage storage = SampleStorage::F32;
+	// Memory allocated for frames (see allocate_samples()), which may be
+	// more than num_frames frames if the song ended sooner than expected;
+	// 0 if borrowed
+	ma_uint64 num_bytes = 0;
+	// True if frames points straight into a song's memory (see
+	// Library::pcm_frames()), in which case it must never be freed
+	bool borrowed = false;
 };
 }
 
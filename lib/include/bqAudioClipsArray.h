@@ -4,11 +4,35 @@
 #include "bqAudioClip.h"
 
 namespace bq {
+// Clips are stored as a structure of arrays: the start and end beats that
+// are scanned by the audio thread on every callback live in their own
+// contiguous arrays, apart from the rest of each clip's data. Every array is
+// sorted by start beat.
 struct AudioClipsArray {
+	void allocate(unsigned int num);
+	void deallocate();
+
 	bool is_clip_valid(unsigned int clip_idx);
 
+	// Number of consecutive clips, beginning at from_idx, that start
+	// before (or at, respectively) the given beat
+	unsigned int count_starts_before(double beat, unsigned int from_idx);
+	unsigned int count_starts_at_or_before(double beat,
+		unsigned int from_idx);
+
 	unsigned int num_clips;
+	double *starts; // Measured in beats
+	double *ends; // Measured in beats
 	AudioClip *clips;
+
+private:
+	template<class Compare>
+	unsigned int _count_starts(double beat, unsigned int from_idx,
+		Compare is_before);
+
+	// Clips are compared against the beat in blocks of this size, which the
+	// compiler can vectorize because there is no early exit inside a block
+	static constexpr unsigned int _SCAN_BLOCK_SIZE = 8;
 };
 }
 
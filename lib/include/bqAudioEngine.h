@@ -1,12 +1,18 @@
 #ifndef BQAUDIOENGINE_H
 #define BQAUDIOENGINE_H
 
+#include "bqAlignedArray.h"
 #include "bqAudioPlayhead.h"
 #include "bqPlayheadChunk.h"
-#include "bqOldPreloadsArray.h"
 #include "bqAudioClipsArray.h"
 #include "bqAudioMsg.h"
 #include "bqLibrary.h"
+#include "bqRenderKernels.h"
+#include "bqRenderPool.h"
+#include "bqStats.h"
+#include "bqTiming.h"
+#include "bqTrace.h"
+#include "bqWorldConfig.h"
 #include "bqConfig.h"
 
 #include <miniaudio.h>
@@ -21,22 +27,39 @@ class IOEngine;
 
 class AudioEngine {
 public:
-	AudioEngine();
+	AudioEngine(unsigned int num_tracks, unsigned int num_playheads);
 	~AudioEngine();
 
 	void pull(unsigned int playhead_idx, unsigned int track_idx,
 		float *dest, ma_uint64 num_frames);
+	// Renders into one buffer per channel instead of interleaved frames
+	void pull_planar(unsigned int playhead_idx, unsigned int track_idx,
+		float *const *dest_channels, ma_uint64 num_frames);
+	// Pulls tracks 0 to num_tracks - 1 of the playhead into dests[0] to
+	// dests[num_tracks - 1]. With a pool, the tracks are rendered on the
+	// pool's workers and the calling thread at once; every stream's state
+	// is its own, so they never contend. Timing records the whole call as
+	// one pull. Offline renders always pull one track after another,
+	// since their blocking decodes aren't meant to run concurrently.
+	void pull_tracks(unsigned int playhead_idx, float *const *dests,
+		unsigned int num_tracks, ma_uint64 num_frames,
+		RenderPool *pool);
 	void pull_done_advance_playhead(unsigned int playhead_idx,
 		ma_uint64 num_frames);
 
-	void set_playback_config(ma_uint32 num_channels, ma_uint32 sample_rate);
+	void set_playback_config(ma_uint32 num_channels, ma_uint32 sample_rate,
+		const BufferSizes &sizes);
 	void bind_io_engine(IOEngine *io);
 	void bind_library(Library *library);
+	void bind_tracer(Tracer *tracer);
+	// See World::set_offline_rendering()
+	void set_offline(bool offline);
 
 	void handle_all_msgs();
 
+	// The clips remain owned by the IOEngine, which frees them once the
+	// epoch shows that the audio thread can no longer be using them
 	void receive_clips(unsigned int track, AudioClipsArray clips);
-	void receive_old_preloads(OldPreloadsArray old_preloads);
 	void receive_cur_clip_idx(unsigned int playhead, unsigned int track,
 		unsigned int cur_clip_idx);
 	void receive_playhead_chunk(unsigned int playhead, unsigned int track,
@@ -51,19 +74,49 @@ public:
 		unsigned int track_idx);
 	unsigned int get_playhead_cur_song_id(unsigned int playhead_idx,
 		unsigned int track_idx);
+	ma_uint64 get_want_frame_ack(unsigned int playhead_idx,
+		unsigned int track_idx);
+	ma_uint64 get_num_chunks_released(unsigned int playhead_idx,
+		unsigned int track_idx);
+	// The ring itself is safe to share between the audio and IO threads
+	PlayheadRing *get_playhead_ring(unsigned int playhead_idx,
+		unsigned int track_idx);
 	// However, we want to pass messages in this case, because we need to be
 	// sure this is processed after any track updates (so indices are valid)
 	void jump_playhead(unsigned int playhead_idx, unsigned int track_idx,
 		unsigned int cur_clip_idx, double beat);
 
+	// Incremented every time handle_all_msgs() is called, i.e. at the
+	// beginning of every audio callback. Once the epoch has advanced twice
+	// past the point at which the IOEngine replaced something, the audio
+	// thread can no longer be using the old version.
+	ma_uint64 get_epoch();
+
+	// Safe to call from any thread; fills in the stats this engine (and
+	// its playheads) keep
+	void get_stats(Stats &stats);
+
+	// Timing is off by default; both may be called from any thread
+	void set_timing_enabled(bool enabled);
+	void get_timing_stats(TimingStats &stats);
+
 	double get_bpm();
 	void set_bpm(double bpm);
 	ma_uint64 beats_to_samples(double beats);
 	double samples_to_beats(double samples);
 
 private:
-	void _fade(float *dest, ma_uint64 dest_num_frames,
-		float total_num_frames, float initial_x, bool reverse);
+	void _pull_timed(unsigned int playhead_idx, unsigned int track_idx,
+		const RenderDest &dest, ma_uint64 num_frames);
+	void _pull(unsigned int playhead_idx, unsigned int track_idx,
+		const RenderDest &dest, ma_uint64 num_frames, bool timing);
+	static void _pull_track_job(void *context, unsigned int track_idx);
+	void _finish_callback_timing();
+
+	void _fade(const RenderDest &dest, ma_uint64 dest_first_frame,
+		ma_uint64 dest_num_frames, float total_num_frames,
+		float initial_x, bool reverse);
+	float _fade_curve_at(float x);
 	float _sigmoid_0_to_1(float x);
 
 	void _apply_next_bpm();
@@ -71,9 +124,10 @@ private:
 
 	bool _is_track_valid(unsigned int track_idx);
 	bool _is_playhead_valid(unsigned int playhead_idx);
+	unsigned int _stream_idx(unsigned int playhead_idx,
+		unsigned int track_idx);
 
 	void _handle_receive_clips(AudioMsgReceiveClips &msg);
-	void _handle_receive_old_preloads(AudioMsgReceiveOldPreloads &msg);
 	void _handle_receive_cur_clip_idx(AudioMsgReceiveCurClipIdx &msg);
 	void _handle_receive_playhead_chunk(AudioMsgReceivePlayheadChunk &msg);
 	void _handle_jump_playhead(AudioMsgJumpPlayhead &msg);
@@ -81,9 +135,6 @@ private:
 	void _update_cur_clip_idx(unsigned int playhead_idx,
 		unsigned int track_idx);
 
-	void _fill_silence(float *dest, ma_uint64 first_frame,
-		ma_uint64 num_frames, ma_uint64 num_channels);
-
 	template<class T>
 	constexpr const T &_min(const T &a, const T &b)
 	{
@@ -98,19 +149,55 @@ private:
 
 	std::atomic<unsigned int> _num_channels;
 	std::atomic<unsigned int> _sample_rate;
+	bool _offline = false;
+	// Picked for _num_channels by set_playback_config()
+	RenderKernels _kernels;
 	std::atomic<double> _bpm, _next_bpm;
 	std::atomic<double> _beats_to_samples;
 	std::atomic<double> _samples_to_beats;
 
-	AudioClipsArray _tracks[WORLD_NUM_TRACKS];
-
-	AudioPlayhead _playheads[WORLD_NUM_PLAYHEADS];
+	alignas(CACHE_LINE_NUM_BYTES) std::atomic<ma_uint64> _epoch;
+
+	struct alignas(CACHE_LINE_NUM_BYTES) _StreamStats {
+		StatsCounter num_pulls;
+		StatsCounter num_frames_rendered;
+		StatsCounter num_emergency_chunk_requests;
+	};
+	// One per playhead/track combination, indexed by _stream_idx()
+	AlignedArray<_StreamStats> _stream_stats;
+	// Messages are only ever pushed by the IO thread and handled by the
+	// audio thread
+	alignas(CACHE_LINE_NUM_BYTES) StatsCounter _num_msgs_pushed;
+	alignas(CACHE_LINE_NUM_BYTES) StatsCounter _num_msgs_handled;
+
+	// Recorded only by the audio thread
+	struct _Timings {
+		TimingHistogram pump, pull, clip_scan, stretch, fade;
+		TimingHistogram dsp_load;
+		std::atomic<ma_uint64> last_dsp_load_ppm{0};
+
+		// Accumulated over the current audio callback
+		ma_uint64 callback_ns = 0;
+		ma_uint64 callback_num_frames = 0;
+	} _timings;
+
+	static constexpr unsigned int _FADE_CURVE_NUM_POINTS = 1025;
+	float _fade_curve[_FADE_CURVE_NUM_POINTS];
+	// Gains worked out from the curve at a time before they're applied
+	static constexpr ma_uint64 _FADE_BLOCK_NUM_FRAMES = 256;
+
+	AlignedArray<AudioClipsArray> _tracks;
+	unsigned int _num_tracks = 0;
+
+	AlignedArray<AudioPlayhead> _playheads;
+	unsigned int _num_playheads = 0;
 
 	QwMpscFifoQueue<AudioMsg *, AUDIO_MSG_NEXT_LINK> _msg_queue;
 	QwNodePool<AudioMsg> *_msg_pool = nullptr;
 
 	IOEngine *_io = nullptr;
 	Library *_library = nullptr;
+	Tracer *_tracer = nullptr;
 
 	static constexpr unsigned int _NUM_MAX_POOL_MSGS =
 		ENGINE_MAX_NUM_POOL_MSGS;
@@ -1,7 +1,6 @@
 #ifndef BQAUDIOMSG_H
 #define BQAUDIOMSG_H
 
-#include "bqOldPreloadsArray.h"
 #include "bqAudioClipsArray.h"
 #include "bqPlayheadChunk.h"
 
@@ -14,7 +13,6 @@ enum AudioMsgLink {
 enum class AudioMsgType {
 	NONE = 0,
 	RECEIVE_CLIPS,
-	RECEIVE_OLD_PRELOADS,
 	RECEIVE_CUR_CLIP_IDX,
 	JUMP_PLAYHEAD,
 	RECEIVE_PLAYHEAD_CHUNK
@@ -25,10 +23,6 @@ struct AudioMsgReceiveClips {
 	AudioClipsArray clips;
 };
 
-struct AudioMsgReceiveOldPreloads {
-	OldPreloadsArray old_preloads;
-};
-
 struct AudioMsgReceiveCurClipIdx {
 	unsigned int playhead;
 	unsigned int track;
@@ -50,7 +44,6 @@ struct AudioMsgReceivePlayheadChunk {
 
 union AudioMsgContents {
 	AudioMsgReceiveClips receive_clips;
-	AudioMsgReceiveOldPreloads receive_old_preloads;
 	AudioMsgReceiveCurClipIdx receive_cur_clip_idx;
 	AudioMsgJumpPlayhead jump_playhead;
 	AudioMsgReceivePlayheadChunk receive_playhead_chunk;
@@ -1,9 +1,15 @@
 #ifndef BQAUDIOPLAYHEAD_H
 #define BQAUDIOPLAYHEAD_H
 
+#include "bqAlignedArray.h"
 #include "bqAudioClip.h"
 #include "bqPlayheadChunk.h"
+#include "bqPlayheadRing.h"
+#include "bqRenderKernels.h"
 #include "bqLibrary.h"
+#include "bqStats.h"
+#include "bqTrace.h"
+#include "bqWorldConfig.h"
 #include "bqConfig.h"
 
 #include <miniaudio.h>
@@ -17,19 +23,32 @@ class IOEngine;
 
 class AudioPlayhead {
 public:
-	AudioPlayhead();
+	explicit AudioPlayhead(unsigned int num_tracks);
 	~AudioPlayhead();
 
-	void set_playback_config(ma_uint32 num_channels, ma_uint32 sample_rate);
+	// Only the ring sizes are used
+	void set_playback_config(ma_uint32 num_channels, ma_uint32 sample_rate,
+		const BufferSizes &sizes);
 	void bind_io_engine(IOEngine *io);
 	void bind_library(Library *library);
+	void bind_tracer(Tracer *tracer);
+	// Only used to label trace events and to request blocking decodes
+	void set_playhead_idx(unsigned int playhead_idx);
+	// See World::set_offline_rendering()
+	void set_offline(bool offline);
 
+	// Renders num_frames frames into dest, starting at dest_first_frame
 	bool pull_stretch(double master_bpm, unsigned int track_idx,
-		AudioClip &clip, double song_bpm, float *dest,
-		ma_uint64 first_frame, ma_uint64 num_frames,
-		ma_uint64 next_expected_first_frame);
+		AudioClip &clip, double song_bpm, const RenderDest &dest,
+		ma_uint64 dest_first_frame, ma_uint64 first_frame,
+		ma_uint64 num_frames, ma_uint64 next_expected_first_frame);
 
 	void receive_chunk(unsigned int track, PlayheadChunk *chunk);
+	// Chunks are released in the same order they are received, so the IO
+	// thread may free that many of the chunks it sent, in sending order
+	ma_uint64 get_num_chunks_released(unsigned int track_idx);
+	// Only allocated if STREAMER_USE_RING_BUFFERS is true
+	PlayheadRing *get_ring(unsigned int track_idx);
 
 	double get_beat();
 	ma_uint64 get_cur_want_frame(unsigned int track_idx);
@@ -46,11 +65,23 @@ public:
 	void set_cannot_request_emergency_chunk(unsigned int track_idx);
 	bool get_can_request_emergency_chunk(unsigned int track_idx);
 
+	ma_uint64 get_want_frame_ack(unsigned int track_idx);
+	void set_want_frame_ack(unsigned int track_idx, ma_uint64 request);
+
+	// Safe to call from any thread; fills in the stats this playhead keeps
+	void get_stats(unsigned int track_idx, StreamStats &stats);
+
 private:
-	void _setup_soundtouch(HANDLE &st);
+	void _setup_soundtouch(HANDLE &st, float *st_src);
 
 	bool _pull(unsigned int track_idx, AudioClip &clip, float *dest,
 		ma_uint64 num_frames);
+	void _pull_blocking(unsigned int track_idx, AudioClip &clip,
+		float *dest, ma_uint64 want_frame, ma_uint64 &num_pulled,
+		ma_uint64 num_frames);
+	bool _pull_chunk(PlayheadChunk &chunk, unsigned int song_id,
+		float *dest, ma_uint64 want_frame, ma_uint64 &num_pulled,
+		ma_uint64 num_frames);
 
 	struct _TrackStInfo {
 		double last_pitch = 0.0;
@@ -59,44 +90,82 @@ private:
 	};
 	struct _ChunksList {
 		PlayheadChunk *head = nullptr, *tail = nullptr;
+	};
+
+	// Each track's state lives in its own cache-line-aligned block, so
+	// tracks never contend for a cache line. Within a block, the part that
+	// the IO thread polls is kept on a separate cache line from the part
+	// that only the audio thread ever touches. The audio thread is the only
+	// writer of either part.
+	struct alignas(CACHE_LINE_NUM_BYTES) _TrackSharedState {
 		std::atomic<ma_uint64> cur_want_frame;
+		std::atomic<ma_uint64> want_frame_ack;
+		std::atomic<ma_uint64> num_chunks_released;
+		std::atomic<unsigned int> cur_clip_idx;
+		std::atomic<unsigned int> cur_song_id;
+	};
+	struct alignas(CACHE_LINE_NUM_BYTES) _TrackAudioState {
+		HANDLE st = nullptr;
+		_TrackStInfo st_info;
+		// Each track has its own, so that tracks may be rendered on
+		// different threads at once (see RenderPool). SoundTouch only
+		// hands out interleaved frames, so they're received into
+		// st_dest first when rendering into planar buffers.
+		float *st_src = nullptr;
+		float *st_dest = nullptr;
+		_ChunksList chunks;
+		ma_uint64 expect_first_frame = 0;
+		unsigned int last_song_id = 0;
+		bool last_song_id_valid = false;
+		bool can_request_emergency_chunk = false;
+	};
+	// Also written only by the audio thread, but read by whichever thread
+	// asks for stats
+	struct alignas(CACHE_LINE_NUM_BYTES) _TrackStats {
+		StatsCounter num_frames_from_preload;
+		StatsCounter num_frames_from_chunks;
+		StatsCounter num_frames_silence;
+		StatsCounter num_underruns;
+		StatsCounter num_soundtouch_resets;
+	};
+	struct _TrackState {
+		_TrackSharedState shared;
+		_TrackAudioState audio;
+		_TrackStats stats;
+		PlayheadRing ring;
 	};
 
-	void _copy_frames(float *dest, float *src, ma_uint64 dest_first_frame,
-		ma_uint64 src_first_frame, ma_uint64 num_frames,
-		ma_uint64 num_channels);
+	void _copy_frames(float *dest, const PlayheadChunk &chunk,
+		ma_uint64 dest_first_frame, ma_uint64 src_first_frame,
+		ma_uint64 num_frames);
 	void _fill_silence(float *dest, ma_uint64 first_frame,
-		ma_uint64 num_frames, ma_uint64 num_channels);
+		ma_uint64 num_frames);
 
-	void _delete_chunk(PlayheadChunk *chunk);
-	void _pop_chunk(_ChunksList &chunks);
+	void _pop_chunk(_TrackState &track);
 	void _pop_all_chunks(unsigned int track_idx);
 
 	bool _is_track_valid(unsigned int track_idx);
 
-	std::atomic<double> _beat;
+	alignas(CACHE_LINE_NUM_BYTES) std::atomic<double> _beat;
 
 	// Why 519?
 	// https://github.com/mixxxdj/mixxx/blob/master/src/engine/bufferscalers/enginebufferscalest.cpp#L25
 	static constexpr unsigned int _NUM_ST_SRC_FRAMES = 519;
-	float *_st_src = nullptr;
-
-	HANDLE _st[WORLD_NUM_TRACKS];
 
-	_TrackStInfo _st_info[WORLD_NUM_TRACKS];
-	_ChunksList _cache[WORLD_NUM_TRACKS];
-	std::atomic<unsigned int> _cur_clip_idx[WORLD_NUM_TRACKS];
-	std::atomic<unsigned int> _cur_song_id[WORLD_NUM_TRACKS];
-	std::atomic<ma_uint64> _expect_first_frame[WORLD_NUM_TRACKS];
-	std::atomic<unsigned int> _last_song_id[WORLD_NUM_TRACKS];
-	std::atomic<bool> _last_song_id_valid[WORLD_NUM_TRACKS];
-	std::atomic<bool> _can_request_emergency_chunk[WORLD_NUM_TRACKS];
+	AlignedArray<_TrackState> _tracks;
+	unsigned int _num_tracks = 0;
 
 	ma_uint32 _num_channels = 0;
 	ma_uint32 _sample_rate = 0;
+	// Picked for _num_channels by set_playback_config()
+	RenderKernels _kernels;
 
 	IOEngine *_io = nullptr;
 	Library *_library = nullptr;
+	Tracer *_tracer = nullptr;
+	unsigned int _playhead_idx = 0;
+
+	bool _offline = false;
 };
 }
 
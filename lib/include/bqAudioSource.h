@@ -0,0 +1,174 @@
+#ifndef BQAUDIOSOURCE_H
+#define BQAUDIOSOURCE_H
+
+#include <miniaudio.h>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+namespace bq {
+// How expensive a source is to read from, cheapest first. Songs whose source
+// is more expensive than MEMORY are worth keeping in a DecodedSongCache.
+enum class AudioSourceCost {
+	// Already decoded in memory
+	MEMORY,
+	// Raw PCM on disk: file IO, but no decoding
+	RAW_FILE,
+	// Compressed or containerized audio that has to be decoded
+	DECODE
+};
+
+//
+// Reads one song as interleaved 32-bit float frames, in the format it was
+// opened with. Each reader has its own position, so any number of readers
+// may be open on the same source at once (from the IO thread only).
+//
+class AudioSourceReader {
+public:
+	virtual ~AudioSourceReader() {}
+
+	virtual bool seek(ma_uint64 frame) = 0;
+	// Returns fewer than num_frames frames only at the end of the song
+	virtual ma_uint64 read(float *frames, ma_uint64 num_frames) = 0;
+	// The length of the song, or 0 if it isn't known without reading it
+	virtual ma_uint64 get_length() { return 0; }
+};
+
+//
+// Where a song's audio comes from. Every song in the Library has one; the
+// preloader and the streamer open readers on it in the output format.
+// Sources must be safe to open from several IO threads at once, since Worlds
+// sharing a Library (see BatchRenderer) each have their own IO thread.
+//
+class AudioSource {
+public:
+	virtual ~AudioSource() {}
+
+	// Returns nullptr if the song can't be read
+	virtual std::unique_ptr<AudioSourceReader> open(ma_uint32 num_channels,
+		ma_uint32 sample_rate) const = 0;
+
+	// The format the song is stored in; returns false if it can't be
+	// determined
+	virtual bool get_native_format(ma_uint32 &num_channels,
+		ma_uint32 &sample_rate) const = 0;
+
+	virtual AudioSourceCost get_cost_hint() const = 0;
+
+	// The song's frames, if they're already in memory in the given format
+	// and stay there for as long as the source exists, so that they can be
+	// used in place instead of being read. nullptr otherwise.
+	virtual const float *get_frames(ma_uint32 /*num_channels*/,
+		ma_uint32 /*sample_rate*/, ma_uint64 &num_frames) const
+	{
+		num_frames = 0;
+		return nullptr;
+	}
+};
+
+// Any file miniaudio can decode
+class MiniaudioFileSource : public AudioSource {
+public:
+	explicit MiniaudioFileSource(const std::string &filename);
+
+	std::unique_ptr<AudioSourceReader> open(ma_uint32 num_channels,
+		ma_uint32 sample_rate) const override;
+	bool get_native_format(ma_uint32 &num_channels,
+		ma_uint32 &sample_rate) const override;
+	AudioSourceCost get_cost_hint() const override;
+
+	const std::string &get_filename() const;
+
+private:
+	std::string _filename;
+};
+
+// A whole file miniaudio can decode, held in memory. owner, if not null,
+// keeps the memory alive; otherwise it must outlive the source.
+class MiniaudioMemorySource : public AudioSource {
+public:
+	MiniaudioMemorySource(const void *data, size_t num_bytes,
+		std::shared_ptr<const void> owner);
+
+	std::unique_ptr<AudioSourceReader> open(ma_uint32 num_channels,
+		ma_uint32 sample_rate) const override;
+	bool get_native_format(ma_uint32 &num_channels,
+		ma_uint32 &sample_rate) const override;
+	AudioSourceCost get_cost_hint() const override;
+
+private:
+	const void *_data = nullptr;
+	size_t _num_bytes = 0;
+	std::shared_ptr<const void> _owner;
+};
+
+// Interleaved 32-bit float frames in memory. Frames already in the requested
+// format are read (or used in place) directly; anything else is converted.
+// owner, if not null, keeps the memory alive; otherwise it must outlive the
+// source.
+class PcmMemorySource : public AudioSource {
+public:
+	PcmMemorySource(const float *frames, ma_uint64 num_frames,
+		ma_uint32 num_channels, ma_uint32 sample_rate,
+		std::shared_ptr<const void> owner);
+
+	std::unique_ptr<AudioSourceReader> open(ma_uint32 num_channels,
+		ma_uint32 sample_rate) const override;
+	bool get_native_format(ma_uint32 &num_channels,
+		ma_uint32 &sample_rate) const override;
+	AudioSourceCost get_cost_hint() const override;
+	const float *get_frames(ma_uint32 num_channels, ma_uint32 sample_rate,
+		ma_uint64 &num_frames) const override;
+
+private:
+	const float *_frames = nullptr;
+	ma_uint64 _num_frames = 0;
+	ma_uint32 _num_channels = 0;
+	ma_uint32 _sample_rate = 0;
+	std::shared_ptr<const void> _owner;
+};
+
+// A headerless file of interleaved PCM samples in the given format, starting
+// first_byte bytes into the file
+class RawPcmFileSource : public AudioSource {
+public:
+	RawPcmFileSource(const std::string &filename, ma_format format,
+		ma_uint32 num_channels, ma_uint32 sample_rate,
+		ma_uint64 first_byte = 0);
+
+	std::unique_ptr<AudioSourceReader> open(ma_uint32 num_channels,
+		ma_uint32 sample_rate) const override;
+	bool get_native_format(ma_uint32 &num_channels,
+		ma_uint32 &sample_rate) const override;
+	AudioSourceCost get_cost_hint() const override;
+
+private:
+	std::string _filename;
+	ma_format _format = ma_format_unknown;
+	ma_uint32 _num_channels = 0;
+	ma_uint32 _sample_rate = 0;
+	ma_uint64 _first_byte = 0;
+};
+
+// Reads frames that are already in the requested format from memory. owner
+// keeps them alive for as long as the reader exists.
+class PcmMemoryReader : public AudioSourceReader {
+public:
+	PcmMemoryReader(const float *frames, ma_uint64 num_frames,
+		ma_uint32 num_channels, std::shared_ptr<const void> owner);
+
+	bool seek(ma_uint64 frame) override;
+	ma_uint64 read(float *frames, ma_uint64 num_frames) override;
+	ma_uint64 get_length() override;
+
+private:
+	const float *_frames = nullptr;
+	ma_uint64 _num_frames = 0;
+	ma_uint32 _num_channels = 0;
+	ma_uint64 _cur_frame = 0;
+	std::shared_ptr<const void> _owner;
+};
+}
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef BQBATCHRENDERER_H
+#define BQBATCHRENDERER_H
+
+#include "bqOfflineRenderer.h"
+#include "bqDecodedSongCache.h"
+#include "bqLibrary.h"
+#include "bqWorld.h"
+#include "bqConfig.h"
+
+#include <miniaudio.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bq {
+struct BatchRenderJob {
+	// Builds the arrangement (set_bpm(), insert_clip() etc.) on a fresh
+	// World that shares the BatchRenderer's Library. Must not add songs.
+	std::function<void(World &world)> setup;
+
+	unsigned int playhead_idx = 0;
+	double from_beat = 0.0;
+	double to_beat = 0.0;
+
+	// If filename isn't empty, the mix is written there as a WAV file in
+	// filename_format. Otherwise, every rendered block is passed to
+	// on_block (from one of the worker threads).
+	std::string filename;
+	MixFormat filename_format = MixFormat::F32;
+	OfflineRenderer::BlockCallback on_block;
+
+	// Memory the job is expected to need at its peak, counted against
+	// BatchRendererConfig::max_num_job_bytes. 0 means
+	// BatchRenderer::default_job_num_bytes() for the renderer's World
+	// config and output format.
+	ma_uint64 num_bytes = 0;
+};
+
+struct BatchRendererConfig {
+	// 0 means one per hardware thread
+	unsigned int num_threads = 0;
+	// Every job's World is created with this
+	WorldConfig world_config;
+	// Jobs are held back while starting them would take the total of all
+	// running jobs' num_bytes past this. A job that exceeds it on its own
+	// still runs, but only while no other job is running.
+	ma_uint64 max_num_job_bytes = 1024ull * 1024 * 1024;
+	// Size of the DecodedSongCache shared by all jobs; 0 disables it, so
+	// that every job decodes its songs itself
+	ma_uint64 max_num_cache_bytes = 1024ull * 1024 * 1024;
+};
+
+//
+// Renders many independent arrangements at once, each on its own World and
+// all sharing one Library, on a pool of worker threads. Each worker has its
+// own queue of jobs and steals from the others' when its queue runs dry, so
+// the workers stay busy even when jobs vary a lot in length.
+//
+// Songs are decoded once into a DecodedSongCache shared by every job (unless
+// disabled), so that rendering the same songs many times doesn't keep every
+// core busy decoding them over and over.
+//
+// The Library must be filled before the BatchRenderer is created, with its
+// output sample rate set to sample_rate, and left alone until the
+// BatchRenderer is destroyed.
+//
+class BatchRenderer {
+public:
+	// Called from a worker thread once the job has finished; succeeded is
+	// false if the render couldn't start, was stopped by on_block, or
+	// couldn't be written
+	using DoneCallback = std::function<void(unsigned int job_id,
+		bool succeeded)>;
+
+	BatchRenderer(Library *library, ma_uint32 num_channels,
+		ma_uint32 sample_rate, const BatchRendererConfig &config);
+	// Waits for every submitted job to finish
+	~BatchRenderer();
+
+	// May be called from any thread, including from callbacks. Returns
+	// the job's id, which is passed to on_done.
+	unsigned int submit(const BatchRenderJob &job,
+		const DoneCallback &on_done);
+	// Blocks until every job submitted so far has finished
+	void wait();
+
+	unsigned int get_num_threads();
+	// nullptr if the cache is disabled
+	DecodedSongCache *get_decoded_song_cache();
+
+	// Streaming buffers for every playhead/track combination, with room
+	// for a few clips' preloads on each track
+	static ma_uint64 default_job_num_bytes(const WorldConfig &config,
+		ma_uint32 num_channels, ma_uint32 sample_rate);
+
+private:
+	struct _Job {
+		unsigned int id = 0;
+		BatchRenderJob job;
+		DoneCallback on_done;
+	};
+
+	struct _Worker {
+		// May be locked while holding _mutex, never the other way round
+		std::mutex mutex;
+		// The owner takes jobs from the back, thieves from the front
+		std::deque<_Job> jobs;
+		std::thread thread;
+	};
+
+	void _work(unsigned int worker_idx);
+	bool _take_job(unsigned int worker_idx, _Job &job);
+	bool _run_job(const BatchRenderJob &job);
+
+	void _admit(ma_uint64 num_bytes);
+	void _release(ma_uint64 num_bytes);
+
+	Library *_library = nullptr;
+	ma_uint32 _num_channels = 0;
+	ma_uint32 _sample_rate = 0;
+	WorldConfig _world_config;
+	ma_uint64 _default_job_num_bytes = 0;
+
+	std::unique_ptr<DecodedSongCache> _cache;
+
+	std::vector<std::unique_ptr<_Worker>> _workers;
+	std::atomic<unsigned int> _next_worker_idx{0};
+
+	ma_uint64 _max_num_job_bytes = 0;
+
+	// Guards everything below
+	std::mutex _mutex;
+	std::condition_variable _jobs_available;
+	std::condition_variable _jobs_done;
+	std::condition_variable _memory_available;
+	// Jobs waiting in a queue, and jobs not finished yet (queued or not)
+	unsigned int _num_queued = 0;
+	unsigned int _num_pending = 0;
+	unsigned int _next_job_id = 0;
+	bool _quit = false;
+	ma_uint64 _num_running_bytes = 0;
+	unsigned int _num_running = 0;
+};
+}
+
+#endif
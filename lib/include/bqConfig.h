@@ -2,39 +2,67 @@
 #define BQCONFIG_H
 
 namespace bq {
-// Number of tracks available in every bq::World
+// Number of tracks in a bq::World unless its constructor is given another
 constexpr unsigned int WORLD_NUM_TRACKS = 4;
-// Number of playheads available in every bq::World
+// Number of playheads in a bq::World unless its constructor is given another
 constexpr unsigned int WORLD_NUM_PLAYHEADS = 2;
 
 //
-// These are (hopefully) sensible defaults for applications outputting at a
-// sample rate of 44,100. They must be increased proportionally if you plan to
-// output at larger rates.
+// Default buffer sizes, in seconds of audio. Each World resolves them against
+// its own output sample rate when it's constructed, so they hold at any rate;
+// see WorldConfig to override them.
 //
 //
-// Number of frames to pre-load at the beginning of a clip, available for
-// immediate usage by the AudioEngine without waiting for the IOEngine to decode
-// anything
-constexpr unsigned int PRELOADER_NUM_FRAMES = 176400;
-// Number of frames to decode and push to the AudioEngine each time a decode is
-// requested
+// Audio to pre-load at the beginning of a clip, available for immediate usage
+// by the AudioEngine without waiting for the IOEngine to decode anything
+constexpr double PRELOADER_NUM_SECONDS = 4.0;
+// Audio to decode and push to the AudioEngine each time a decode is requested
 //
 // Imagine this as how far the grey line underneath the red line is extended
 // each time the red line approaches the end of the grey line, on the YouTube
 // website video player.
-constexpr unsigned int STREAMER_CHUNK_NUM_FRAMES = 176400;
-// When a playhead is closer than this number of frames to the beginning of the
-// next chunk that needs to be this number of frames, it decodes it anyway even
-// though it won't be needed until this number of frames later than the time the
-// decode was performed.
+constexpr double STREAMER_CHUNK_NUM_SECONDS = 4.0;
+// When a playhead is closer than this to the beginning of the next chunk that
+// needs to be decoded, it decodes it anyway even though it won't be needed
+// until this much later than the time the decode was performed.
 //
 // Imagine this as the value that determines how close the red line may approach
 // to the end of the grey line, before the grey line is extended, on the YouTube
 // website video player.
-constexpr unsigned int STREAMER_NEXT_CHUNK_WINDOW_NUM_FRAMES = 176400;
+constexpr double STREAMER_NEXT_CHUNK_WINDOW_NUM_SECONDS = 4.0;
 //
 
+//
+// When true, each playhead/track combination streams through a fixed-size
+// ring of decoded frames that the IOEngine decodes into directly and the
+// AudioEngine reads in place, instead of through individually allocated chunks
+// passed as messages. The ring holds at least STREAMER_RING_NUM_SLOTS chunks
+// of STREAMER_RING_SLOT_NUM_SECONDS each, all allocated up front.
+//
+// The ring must be large enough to hold the next chunk window plus one slot,
+// or the IOEngine won't be able to decode far enough ahead, so more slots are
+// allocated if the window calls for them.
+//
+constexpr bool STREAMER_USE_RING_BUFFERS = false;
+constexpr unsigned int STREAMER_RING_NUM_SLOTS = 8;
+constexpr double STREAMER_RING_SLOT_NUM_SECONDS = 1.0;
+//
+
+//
+// Size of a CPU cache line, in bytes. State that is written by one thread and
+// polled by another is aligned to this, so that unrelated state never shares a
+// cache line (which would make the threads contend for it).
+//
+constexpr unsigned int CACHE_LINE_NUM_BYTES = 64;
+
+//
+// Event tracing (see bqTrace.h). Each traced thread gets a ring of
+// TRACE_RING_NUM_EVENTS events (24 bytes each), allocated for all
+// TRACE_MAX_NUM_THREADS threads the first time tracing is enabled.
+//
+constexpr unsigned int TRACE_MAX_NUM_THREADS = 8;
+constexpr unsigned int TRACE_RING_NUM_EVENTS = 16384;
+
 //
 // Maximum number of messages possible for AudioEngine or IOEngine to hold until
 // pump_audio_thread or pump_io_thread (for AudioEngine and IOEngine,
@@ -0,0 +1,87 @@
+#ifndef BQDECODEDSONGCACHE_H
+#define BQDECODEDSONGCACHE_H
+
+#include "bqAudioSource.h"
+
+#include <miniaudio.h>
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace bq {
+// A whole song, decoded to the output format. Never modified once cached, so
+// any number of threads may read it at once.
+struct DecodedSong {
+	ma_uint32 num_channels = 0;
+	ma_uint32 sample_rate = 0;
+	ma_uint64 num_frames = 0;
+	std::vector<float> frames;
+};
+
+//
+// Songs decoded in full, shared by every World whose Library is bound to the
+// cache, so that each song is only decoded once no matter how many Worlds
+// play it. Songs are decoded on first use by whichever IO thread asks for them
+// first; the other threads wait for that decode rather than repeating it.
+//
+// The cache never holds more than max_num_bytes of decoded audio. Songs that
+// aren't in use are evicted (least recently used first) to make room. A song
+// that doesn't fit even so isn't cached this time, and isn't decoded again
+// until enough songs have been released to make room for it; a song bigger
+// than the whole cache is never cached. Either way, its users decode it from
+// the file themselves.
+//
+// Thread-safe, but locks, so it must never be used from an audio thread.
+//
+class DecodedSongCache {
+public:
+	explicit DecodedSongCache(ma_uint64 max_num_bytes);
+	~DecodedSongCache() {}
+
+	// Returns nullptr if the song can't be decoded or doesn't fit
+	// Songs are identified by song_id alone, so a cache must only ever be
+	// used with the songs of one Library
+	std::shared_ptr<const DecodedSong> get(const AudioSource &source,
+		unsigned int song_id, ma_uint32 num_channels,
+		ma_uint32 sample_rate);
+
+	ma_uint64 get_num_bytes();
+	ma_uint64 get_max_num_bytes();
+
+private:
+	using _Key = std::tuple<unsigned int, ma_uint32, ma_uint32>;
+
+	struct _Entry {
+		std::shared_ptr<const DecodedSong> song;
+		ma_uint64 num_bytes = 0;
+		ma_uint64 last_use = 0;
+		bool decoding = false;
+		// Couldn't be decoded, or is bigger than the whole cache; not
+		// retried
+		bool failed = false;
+		// The song's size if it was last decoded while there was no
+		// room for it, so that it isn't decoded again until there is
+		ma_uint64 no_room_num_bytes = 0;
+	};
+
+	std::shared_ptr<DecodedSong> _decode(const AudioSource &source,
+		ma_uint32 num_channels, ma_uint32 sample_rate,
+		ma_uint64 max_num_bytes);
+	bool _can_make_room(ma_uint64 num_bytes);
+	bool _make_room(ma_uint64 num_bytes);
+
+	std::mutex _mutex;
+	std::condition_variable _decode_done;
+	std::map<_Key, _Entry> _entries;
+
+	ma_uint64 _max_num_bytes = 0;
+	ma_uint64 _num_bytes = 0;
+	ma_uint64 _use_clock = 0;
+};
+}
+
+#endif
@@ -2,34 +2,67 @@
 #define BQIOAUDIOFILEDECODER_H
 
 #include "bqAudioClip.h"
+#include "bqAudioSource.h"
 #include "bqPlayheadChunk.h"
+#include "bqPlayheadRing.h"
 #include "bqLibrary.h"
+#include "bqStats.h"
+#include "bqTrace.h"
+#include "bqWorldConfig.h"
 #include "bqConfig.h"
 
 #include <miniaudio.h>
 
+#include <memory>
+#include <vector>
+
 namespace bq {
 class IOAudioFileDecoder {
 public:
 	IOAudioFileDecoder() {}
 	~IOAudioFileDecoder();
 
-	void set_decode_config(ma_uint32 num_channels, ma_uint32 sample_rate);
+	// Only the chunk and next chunk window sizes and the sample storage are
+	// used
+	void set_decode_config(ma_uint32 num_channels, ma_uint32 sample_rate,
+		const BufferSizes &sizes);
 
 	void bind_library(Library *library);
+	void bind_tracer(Tracer *tracer, unsigned int playhead_idx,
+		unsigned int track_idx);
 
 	void set_clip_idx(unsigned int clip_idx);
 	void set_song_id(unsigned int song_id);
 	PlayheadChunk *decode(ma_uint64 from_frame);
+	// Decodes the next chunk directly into the ring's next free slot (if
+	// there is one and the chunk is needed yet), returning true if a slot
+	// was filled
+	bool decode_into(PlayheadRing &ring, ma_uint64 from_frame);
 
 	void invalidate_last_clip_idx();
 	void reset_next_send_frame();
 
+	// Safe to call from any thread
+	void get_stats(StreamStats &stats);
+
 private:
+	bool _prepare_decode(ma_uint64 from_frame, ma_uint64 chunk_num_frames,
+		ma_uint64 &actual_from_frame);
+	bool _decode_chunk(PlayheadChunk &chunk, ma_uint64 from_frame,
+		ma_uint64 actual_from_frame, ma_uint64 chunk_num_frames);
+
 	void _open_file(unsigned int song_id);
 	void _close_file();
 
+	bool _seek(ma_uint64 frame);
+	ma_uint64 _read(void *frames, SampleStorage storage,
+		ma_uint64 num_frames);
+	ma_uint64 _borrow(void *&frames, ma_uint64 num_frames);
+
 	ma_uint32 _num_channels = 0;
+	// The open song's frames are kept with this many channels (see
+	// stored_num_channels())
+	ma_uint32 _song_num_channels = 0;
 	ma_uint32 _sample_rate = 0;
 
 	ma_uint64 _decoder_cur_frame = 0;
@@ -50,17 +83,31 @@ private:
 	unsigned int _last_song_id = 0;
 	bool _last_song_id_valid = false;
 
-	ma_decoder _decoder;
+	std::unique_ptr<AudioSourceReader> _reader;
 	bool _decoder_ready = false;
+	// Songs already in memory in the output format (see
+	// Library::pcm_frames()) aren't read at all: chunks point straight
+	// into them instead
+	const float *_borrow_frames = nullptr;
+	ma_uint64 _borrow_num_frames = 0;
+	ma_uint64 _borrow_cur_frame = 0;
 
 	bool _end_of_song = false;
 
-	static constexpr ma_uint64 _SEND_FRAME_WINDOW =
-		STREAMER_NEXT_CHUNK_WINDOW_NUM_FRAMES;
-	static constexpr ma_uint64 _CHUNK_NUM_FRAMES =
-		STREAMER_CHUNK_NUM_FRAMES;
+	ma_uint64 _send_frame_window = 0;
+	ma_uint64 _chunk_num_frames = 0;
+	SampleStorage _storage = SampleStorage::F32;
+	// Frames read from songs pass through here on their way to a compact
+	// storage
+	std::vector<float> _scratch;
+
+	StatsCounter _num_decode_calls;
+	StatsCounter _num_decoded_bytes;
 
 	Library *_library = nullptr;
+	Tracer *_tracer = nullptr;
+	// Only used to label trace events
+	unsigned int _playhead_idx = 0, _track_idx = 0;
 };
 }
 
@@ -1,63 +1,103 @@
 #ifndef BQIOENGINE_H
 #define BQIOENGINE_H
 
-#include "bqOldPreloadsArray.h"
+#include "bqAlignedArray.h"
 #include "bqAudioClipsArray.h"
 #include "bqIOTrack.h"
 #include "bqIOMsg.h"
 #include "bqIOAudioFileDecoder.h"
 #include "bqLibrary.h"
+#include "bqStats.h"
+#include "bqTiming.h"
+#include "bqTrace.h"
+#include "bqWorldConfig.h"
 #include "bqConfig.h"
 
 #include <QwMpscFifoQueue.h>
 #include <QwNodePool.h>
 
+#include <deque>
+#include <vector>
+
 namespace bq {
 class AudioEngine;
 
 class IOEngine {
 public:
-	IOEngine();
+	IOEngine(unsigned int num_tracks, unsigned int num_playheads);
 	~IOEngine();
 
 	void decode_next_cache_chunks(unsigned int playhead_idx,
 		unsigned int track_idx);
 
-	void set_decode_config(ma_uint32 num_channels, ma_uint32 sample_rate);
+	void set_decode_config(ma_uint32 num_channels, ma_uint32 sample_rate,
+		const BufferSizes &sizes);
+	// See WorldConfig::memory_budget_num_bytes; 0 means no limit. Must be
+	// called before the IO thread starts pumping.
+	void set_memory_budget(ma_uint64 num_bytes);
 	void bind_audio_engine(AudioEngine *audio);
 	void bind_library(Library *library);
+	void bind_tracer(Tracer *tracer);
 
 	void handle_all_msgs();
 
 	void insert_clip(unsigned int track, double start, double end,
 		double fade_in, double fade_out, unsigned int song_id,
-		ma_uint64 first_frame, double pitch_shift);
+		ma_uint64 first_frame, double pitch_shift,
+		double preload_seconds);
 	void erase_clips_range(unsigned int track, double from, double to);
 
-	void delete_clips(AudioClipsArray clips);
-	void delete_old_preloads(OldPreloadsArray old_preloads);
-	void delete_playhead_chunk(PlayheadChunk *chunk);
-
 	void jump_playhead(unsigned int playhead, double beat);
 	void notify_audio_playhead_jumped(unsigned int playhead);
 
 	void request_emergency_chunk(unsigned int playhead, unsigned int track);
 
+	// Only for offline rendering, where the IO and audio work happen on the
+	// same thread: decodes the chunk of the clip's stream beginning at
+	// want_frame right away, and hands it to the caller instead of sending
+	// it to the AudioEngine. In ring mode, the chunk is decoded into the
+	// ring (which must be empty) and its slot is returned. Returns nullptr
+	// at the end of the song. Every chunk sent earlier must already have
+	// been received by the AudioEngine, so that chunks are still released
+	// in the order they were sent.
+	PlayheadChunk *decode_blocking(unsigned int playhead,
+		unsigned int track, const AudioClip &clip,
+		ma_uint64 want_frame);
+
+	// Whenever the IO thread can no longer trust the AudioEngine's current
+	// want frame (e.g. after an edit or a jump), it increments the request
+	// count and waits until the audio thread has acknowledged it by pulling
+	// with that request count. Each count has a single writer.
 	bool wait_cur_want_frame(unsigned int playhead, unsigned int track);
-	void set_wait_cur_want_frame(unsigned int playhead, unsigned int track,
-		bool value);
+	ma_uint64 get_want_frame_request(unsigned int playhead,
+		unsigned int track);
+
+	// Safe to call from any thread; fills in the stats this engine (and
+	// its tracks and decoders) keep
+	void get_stats(Stats &stats);
+
+	// Timing is off by default; both may be called from any thread
+	void set_timing_enabled(bool enabled);
+	void get_timing_stats(TimingStats &stats);
 
 private:
 	bool _is_track_valid(unsigned int track_idx);
 	bool _is_playhead_valid(unsigned int playhead_idx);
+	unsigned int _stream_idx(unsigned int playhead_idx,
+		unsigned int track_idx);
+
+	void _mark_track_dirty(unsigned int track_idx);
+	void _mark_track_preloads_dirty(unsigned int track_idx);
+	void _publish_clips(unsigned int track_idx);
+	void _mark_cur_clip_dirty(unsigned int playhead_idx,
+		unsigned int track_idx);
+	void _send_chunk(unsigned int playhead_idx, unsigned int track_idx,
+		PlayheadChunk *chunk);
+	void _free_chunk(PlayheadChunk *chunk);
 
 	void _handle_insert_clip(IOMsgInsertClip &msg);
 	void _handle_erase_clips_range(IOMsgEraseClipsRange &msg);
 
-	void _handle_delete_clips(IOMsgDeleteClips &msg);
-	void _handle_delete_old_preloads(IOMsgDeleteOldPreloads &msg);
-	void _handle_delete_playhead_chunk(IOMsgDeletePlayheadChunk &msg);
-
 	void _handle_jump_playhead(IOMsgJumpPlayhead &msg);
 	void _handle_audio_playhead_jumped(IOMsgAudioPlayheadJumped &msg);
 
@@ -66,8 +106,24 @@ private:
 	void _update_audio_cur_clip_idx(unsigned int playhead_idx,
 		unsigned int track_idx);
 
-	IOTrack _tracks[WORLD_NUM_TRACKS];
-	bool _track_dirty[WORLD_NUM_TRACKS];
+	void _request_cur_want_frame(unsigned int playhead_idx,
+		unsigned int track_idx);
+	double _cur_playhead_beat(unsigned int playhead_idx);
+
+	bool _should_balance_preloads();
+	void _balance_preloads();
+	double _distance_to_playheads(double stream_start, double stream_end);
+
+	void _retire(AudioClipsArray clips,
+		std::vector<AudioClipPreload> preloads);
+	void _reclaim();
+	void _reclaim_all();
+	void _free_retired(AudioClipsArray &clips,
+		std::vector<AudioClipPreload> &preloads);
+
+	AlignedArray<IOTrack> _tracks;
+	AlignedArray<AudioClipsArray> _published_clips;
+	unsigned int _num_tracks = 0;
 
 	// Used to determine for how many playheads we need to update current
 	// clip indices for the AudioEngine
@@ -75,12 +131,105 @@ private:
 		double jump_beat = 0.0;
 		bool jumping = false;
 		bool wait_playhead_jump = false;
-		bool cur_clip_dirty[WORLD_NUM_TRACKS];
-	} _playheads[WORLD_NUM_PLAYHEADS];
-	std::atomic_bool _wait_cur_want_frame[WORLD_NUM_PLAYHEADS]
-		[WORLD_NUM_TRACKS];
-
-	IOAudioFileDecoder _decoders[WORLD_NUM_PLAYHEADS][WORLD_NUM_TRACKS];
+	};
+	AlignedArray<DirtyPlayheadInfo> _playheads;
+	unsigned int _num_playheads = 0;
+
+	// Everything kept for one playhead/track combination
+	struct alignas(CACHE_LINE_NUM_BYTES) _Stream {
+		IOAudioFileDecoder decoder;
+		std::deque<PlayheadChunk *> sent_chunks;
+		ma_uint64 num_chunks_freed = 0;
+		StatsCounter num_chunks_sent;
+		bool cur_clip_dirty = false;
+		bool has_sent_chunks = false;
+
+		// Written only by the IO thread, and polled by the audio
+		// thread
+		alignas(CACHE_LINE_NUM_BYTES)
+			std::atomic<ma_uint64> want_frame_request{0};
+	};
+	// Indexed by _stream_idx()
+	AlignedArray<_Stream> _streams;
+
+	// Only the tracks and streams listed here are visited when messages
+	// are handled and memory is reclaimed, so pumping costs nothing for
+	// idle ones. Each list has room for every track or stream, reserved
+	// up front.
+	std::vector<unsigned int> _dirty_tracks;
+	std::vector<bool> _track_dirty;
+	// Tracks whose clips only need publishing again because preloads were
+	// made or evicted, which unlike an edit leaves the streams alone
+	std::vector<unsigned int> _preload_dirty_tracks;
+	std::vector<bool> _track_preloads_dirty;
+	std::vector<unsigned int> _dirty_streams;
+	std::vector<unsigned int> _streams_with_sent_chunks;
+
+	// Messages are pushed by the application's threads as well as the
+	// audio thread, so unlike every other counter this one needs a
+	// read-modify-write
+	alignas(CACHE_LINE_NUM_BYTES) std::atomic<ma_uint64> _num_msgs_pushed;
+	alignas(CACHE_LINE_NUM_BYTES) StatsCounter _num_msgs_handled;
+
+	// Subtracted from the bytes the tracks have preloaded to get the bytes
+	// still allocated
+	alignas(CACHE_LINE_NUM_BYTES) StatsCounter _num_freed_preload_bytes;
+
+	// Recorded only by the IO thread
+	struct _Timings {
+		TimingHistogram decode, preload;
+	} _timings;
+
+	//
+	// Memory the audio thread has seen is never freed by the audio thread
+	// and never sent back as a message. Instead, clip arrays (and the
+	// preloads only they referenced) are retired along with the
+	// AudioEngine's epoch at the time they were replaced, and freed in
+	// batches once the epoch has advanced far enough. Chunks are released
+	// by the audio thread in the order they were sent, so the IOEngine
+	// frees them as soon as the release count says so.
+	//
+	struct _RetiredMemory {
+		ma_uint64 epoch = 0;
+		AudioClipsArray clips;
+		std::vector<AudioClipPreload> preloads;
+	};
+	std::deque<_RetiredMemory> _retired;
+
+	// The epoch at which a message is pushed might be the epoch of an audio
+	// callback that is already past handling its messages, so the message
+	// is only guaranteed to have been handled (and the callback that
+	// handled it to have finished) two epochs later
+	static constexpr ma_uint64 _RECLAIM_NUM_EPOCHS = 2;
+
+	//
+	// With a memory budget, the IOEngine decides which streams hold a
+	// preload: every stream's first clip is a candidate, nearest to a
+	// playhead first, and preloads are kept for as many as fit in what the
+	// budget leaves after the stream buffers. Preloads replaced by edits
+	// are freed within a few audio callbacks, so they aren't counted.
+	//
+	// Balancing visits every clip, so it's only done after edits, once a
+	// playhead has moved far enough, and while preloads are still owed.
+	// It makes only a few preloads at a time, nearest first, so that the
+	// IO thread keeps up with decoding in between.
+	//
+	struct _PreloadCandidate {
+		unsigned int track_idx = 0;
+		unsigned int clip_idx = 0;
+		double distance = 0.0; // Measured in beats
+		ma_uint64 num_bytes = 0;
+		bool keep = false;
+	};
+	std::vector<_PreloadCandidate> _preload_candidates;
+	// Each playhead's beat as of the last balance
+	std::vector<double> _balance_beats;
+	ma_uint64 _memory_budget_num_bytes = 0;
+	ma_uint64 _stream_num_bytes = 0;
+	bool _balance_pending = false;
+
+	static constexpr double _BALANCE_INTERVAL_BEATS = 1.0;
+	static constexpr unsigned int _MAX_PRELOADS_PER_BALANCE = 4;
 
 	QwMpscFifoQueue<IOMsg *, IO_MSG_NEXT_LINK> _msg_queue;
 	QwNodePool<IOMsg> *_msg_pool = nullptr;
@@ -89,6 +238,7 @@ private:
 
 	AudioEngine *_audio = nullptr;
 	Library *_library = nullptr;
+	Tracer *_tracer = nullptr;
 
 	static constexpr unsigned int _NUM_MAX_POOL_MSGS =
 		ENGINE_MAX_NUM_POOL_MSGS;
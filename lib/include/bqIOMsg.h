@@ -1,9 +1,7 @@
 #ifndef BQIOMSG_H
 #define BQIOMSG_H
 
-#include "bqOldPreloadsArray.h"
-#include "bqAudioClipsArray.h"
-#include "bqPlayheadChunk.h"
+#include <miniaudio.h>
 
 namespace bq {
 enum IOMsgLink {
@@ -15,9 +13,6 @@ enum class IOMsgType {
 	NONE = 0,
 	INSERT_CLIP,
 	ERASE_CLIPS_RANGE,
-	DELETE_CLIPS,
-	DELETE_OLD_PRELOADS,
-	DELETE_PLAYHEAD_CHUNK,
 	JUMP_PLAYHEAD,
 	AUDIO_PLAYHEAD_JUMPED,
 	REQUEST_EMERGENCY_CHUNK
@@ -29,6 +24,7 @@ struct IOMsgInsertClip {
 	double start, end;
 	double fade_in, fade_out;
 	double pitch_shift;
+	double preload_seconds;
 	ma_uint64 first_frame;
 };
 
@@ -37,18 +33,6 @@ struct IOMsgEraseClipsRange {
 	double from, to;
 };
 
-struct IOMsgDeleteClips {
-	AudioClipsArray clips;
-};
-
-struct IOMsgDeleteOldPreloads {
-	OldPreloadsArray old_preloads;
-};
-
-struct IOMsgDeletePlayheadChunk {
-	PlayheadChunk *chunk;
-};
-
 struct IOMsgJumpPlayhead {
 	unsigned int playhead;
 	double beat;
@@ -66,9 +50,6 @@ struct IOMsgRequestEmergencyChunk {
 union IOMsgContents {
 	IOMsgInsertClip insert_clip;
 	IOMsgEraseClipsRange erase_clips_range;
-	IOMsgDeleteClips delete_clips;
-	IOMsgDeleteOldPreloads delete_old_preloads;
-	IOMsgDeletePlayheadChunk delete_playhead_chunk;
 	IOMsgJumpPlayhead jump_playhead;
 	IOMsgAudioPlayheadJumped audio_playhead_jumped;
 	IOMsgRequestEmergencyChunk request_emergency_chunk;
@@ -1,57 +1,121 @@
 #ifndef BQIOTRACK_H
 #define BQIOTRACK_H
 
-#include "bqOldPreloadsArray.h"
 #include "bqAudioClipsArray.h"
 #include "bqAudioClip.h"
 #include "bqAudioClipPreload.h"
 #include "bqLibrary.h"
+#include "bqStats.h"
+#include "bqTiming.h"
+#include "bqTrace.h"
+#include "bqWorldConfig.h"
 #include "bqConfig.h"
 
 #include <miniaudio.h>
 
 #include <vector>
 #include <string>
+#include <cmath>
+#include <memory>
 
 namespace bq {
 class IOTrack {
 public:
 	IOTrack() {}
-	~IOTrack() {}
+	~IOTrack();
 
-	void set_preload_config(ma_uint32 num_channels, ma_uint32 sample_rate);
+	// preload_num_frames is used for clips whose song and clip don't ask
+	// for a preload length of their own
+	void set_preload_config(ma_uint32 num_channels, ma_uint32 sample_rate,
+		ma_uint64 preload_num_frames, SampleStorage storage);
+
+	// While preloads are managed, publishing clips never preloads anything
+	// by itself. Instead, the IOEngine decides which streams hold a
+	// preload with materialize_preload() and evict_preload().
+	void set_preloads_managed(bool managed);
 
 	void bind_library(Library *library);
+	// Every preload is timed into this histogram while it's enabled
+	void bind_preload_timing(TimingHistogram *preload_timing);
+	void bind_tracer(Tracer *tracer, unsigned int track_idx);
 
 	void insert_clip(double start, double end, double fade_in,
 		double fade_out, unsigned int song_id, ma_uint64 first_frame,
-		double pitch_shift);
+		double pitch_shift, double preload_seconds);
 	void erase_clips_range(double from, double to);
 
 	//
 	// After all edit messages have been processed, the contents of
-	// copy_clips() and copy_old_preloads() should be sent (in that order)
-	// to the AudioEngine
+	// copy_clips() should be sent to the AudioEngine. Afterwards, the
+	// preloads returned by take_old_preloads() are no longer referenced by
+	// the new clips, and must be freed once the AudioEngine is done with
+	// the clips it had before.
 	//
 	AudioClipsArray copy_clips();
-	OldPreloadsArray copy_old_preloads();
+	std::vector<AudioClipPreload> take_old_preloads();
+
+	// Brings every clip's stream up to date without publishing anything,
+	// so that the stream_* members of the clips can be trusted
+	void update_streams();
+
+	// All of these take the index of a stream's first clip. The size is
+	// what the stream's preload takes, or would take if it were made now.
+	bool has_preload(unsigned int stream_first_clip_idx);
+	ma_uint64 preload_num_bytes(unsigned int stream_first_clip_idx);
+	void materialize_preload(unsigned int stream_first_clip_idx);
+	void evict_preload(unsigned int stream_first_clip_idx);
 
 	unsigned int num_clips();
 	const AudioClip &clip_at(unsigned int i);
 
 	bool is_clip_valid(unsigned int clip_idx);
 
-	static constexpr ma_uint64 PRELOAD_NUM_FRAMES = PRELOADER_NUM_FRAMES;
+	// Totals of all preloads ever made; safe to call from any thread
+	ma_uint64 get_num_preloads();
+	ma_uint64 get_num_preload_bytes();
+	ma_uint64 get_num_preload_evictions();
 
 private:
-	AudioClipPreload _preload(unsigned int song_id, ma_uint64 first_frame);
+	AudioClipPreload _preload(unsigned int song_id, ma_uint64 first_frame,
+		ma_uint64 preload_num_frames);
+	ma_uint64 _preload_num_frames_for(unsigned int stream_first_clip_idx);
+
+	void _bake_render_info();
+	bool _continues_stream(const AudioClip &prev, const AudioClip &clip);
+	void _retire_preload(AudioClip &clip);
 
 	std::vector<AudioClip> _clips;
-	std::vector<float *> _old_preloads;
+	std::vector<AudioClipPreload> _old_preloads;
 
 	Library *_library = nullptr;
 
+	TimingHistogram *_preload_timing = nullptr;
+	Tracer *_tracer = nullptr;
+	// Only used to label trace events
+	unsigned int _track_idx = 0;
+
+	StatsCounter _num_preloads;
+	StatsCounter _num_preload_bytes;
+	StatsCounter _num_preload_evictions;
+
 	ma_uint32 _preload_num_channels = 0, _preload_sample_rate = 0;
+	ma_uint64 _preload_num_frames = 0;
+	SampleStorage _preload_storage = SampleStorage::F32;
+	// Frames read from songs pass through here on their way to a compact
+	// storage
+	std::vector<float> _scratch;
+	bool _preloads_managed = false;
+
+	// How far apart (in beats and in frames, respectively) two clips may be
+	// while still being considered contiguous, to absorb rounding errors
+	// from splitting clips
+	static constexpr double _STREAM_MAX_BEAT_GAP = 1e-9;
+	static constexpr ma_uint64 _STREAM_MAX_FRAME_DRIFT = 1;
+
+	// Preloads are cut short to the frames their stream can actually
+	// play, plus this much for the time stretcher, which reads a little
+	// ahead of what it outputs
+	static constexpr double _PRELOAD_MARGIN_SECONDS = 0.25;
 };
 }
 
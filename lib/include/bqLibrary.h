@@ -2,9 +2,12 @@
 #define BQLIBRARY_H
 
 #include "bqLibrarySongInfo.h"
+#include "bqAudioSource.h"
+#include "bqDecodedSongCache.h"
 
 #include <miniaudio.h>
 
+#include <memory>
 #include <vector>
 
 namespace bq {
@@ -17,31 +20,88 @@ public:
 
 	unsigned int add_song(const std::string &filename, double sample_rate,
 		double bpm);
+	//
+	// Songs already in memory: either interleaved 32-bit float frames, or
+	// a whole encoded audio file. If copy is true, the Library keeps its
+	// own copy. Otherwise the caller's memory is used as is, and must stay
+	// valid and unchanged for as long as the Library exists.
+	//
+	// PCM songs that already match the output's sample rate, and either
+	// match its channel count or are mono, are played straight from their
+	// memory, without copying them into preloads or chunks.
+	//
+	unsigned int add_song(const float *frames, ma_uint64 num_frames,
+		ma_uint32 num_channels, double sample_rate, double bpm,
+		bool copy);
+	unsigned int add_song(const void *data, size_t num_bytes,
+		double sample_rate, double bpm, bool copy);
+	// Any other kind of song (see bqAudioSource.h), at the sample rate of
+	// its native format
+	unsigned int add_song(std::shared_ptr<const AudioSource> source,
+		double bpm);
+
+	// Overrides the World's preload length for every clip of the song
+	// that doesn't have its own; 0.0 restores the World's. Like
+	// add_song(), must not be called while a World using the Library is
+	// running.
+	void set_preload_seconds(unsigned int song_id, double preload_seconds);
 
 	// Quick access to any song info property in the library
 	// Not prefixed with "get_" for brevity's sake
 	double sample_rate(unsigned int song_id) const;
 	double bpm(unsigned int song_id) const;
+	double preload_seconds(unsigned int song_id) const;
+	// The channel count of the song's own format, or 0 if it's unknown
+	ma_uint32 num_channels(unsigned int song_id) const;
 	ma_uint64 beats_to_samples(unsigned int song_id, double beats) const;
 	double samples_to_beats(unsigned int song_id, double samples) const;
 	ma_uint64 beats_to_out_samples(unsigned int song_id, double beats)
 		const;
 	double out_samples_to_beats(unsigned int song_id, double out_samples)
 		const;
+	double beats_to_out_samples_factor(unsigned int song_id) const;
 	ma_uint64 samples_self2out(unsigned int song_id, ma_uint64 self_samples)
 		const;
 	ma_uint64 samples_out2self(unsigned int song_id, ma_uint64 out_samples)
 		const;
-	// DO NOT CALL THIS IN THE AUDIO THREAD
-	// It may involve a string copy, which involves memory allocation
-	const std::string filename(unsigned int song_id) const;
+	// Not meant for the audio thread, but safe there: no copy is made
+	const std::string &filename(unsigned int song_id) const;
 
 	bool is_song_id_valid(unsigned int song_id) const;
 
+	// nullptr if the song ID is invalid
+	const AudioSource *source(unsigned int song_id) const;
+	// Opens the cheapest way to read the song in the given format: its own
+	// source if that's in memory, and otherwise the bound
+	// DecodedSongCache if the song fits in it. Returns nullptr if the
+	// song can't be read. May block while another thread decodes the
+	// song, so it must only be called from IO threads.
+	std::unique_ptr<AudioSourceReader> open_song(unsigned int song_id,
+		ma_uint32 num_channels, ma_uint32 sample_rate) const;
+	// The song's frames, if they're already in memory in the given format
+	// (nullptr otherwise), which can be used in place for as long as the
+	// Library exists
+	const float *pcm_frames(unsigned int song_id, ma_uint32 num_channels,
+		ma_uint32 sample_rate, ma_uint64 &num_frames) const;
+
+	//
+	// Several Worlds may share one Library (see BatchRenderer), and bind
+	// it to a DecodedSongCache so that each song is decoded only once
+	// between them. Songs must not be added while any of those Worlds is
+	// running.
+	//
+	void bind_decoded_song_cache(DecodedSongCache *cache);
+
 private:
+	void _set_native_num_channels(LibrarySongInfo &song);
+
 	std::vector<LibrarySongInfo> _songs;
 
 	double _out_sample_rate = 0.0;
+
+	DecodedSongCache *_decoded_song_cache = nullptr;
+
+	const std::string _empty_filename;
 };
 }
 
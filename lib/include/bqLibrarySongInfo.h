@@ -1,6 +1,9 @@
 #ifndef BQLibrarySongInfo_H
 #define BQLibrarySongInfo_H
 
+#include "bqAudioSource.h"
+
+#include <memory>
 #include <string>
 
 #include <miniaudio.h>
@@ -17,16 +20,26 @@ public:
 	void set_sample_rate(double sample_rate);
 	void set_out_sample_rate(double out_sample_rate);
 	void set_bpm(double bpm);
+	void set_source(std::shared_ptr<const AudioSource> source);
+	void set_preload_seconds(double preload_seconds);
+	void set_num_channels(ma_uint32 num_channels);
 
 	const std::string &get_filename() const;
 	double get_sample_rate() const;
 	double get_bpm() const;
+	// nullptr if no source has been set
+	const AudioSource *get_source() const;
+	// 0.0 if the song uses the World's preload length
+	double get_preload_seconds() const;
+	// The source's own channel count, or 0 if it isn't known
+	ma_uint32 get_num_channels() const;
 
 	ma_uint64 beats_to_samples(double beats) const;
 	double samples_to_beats(double samples) const;
 
 	ma_uint64 beats_to_out_samples(double beats) const;
 	double out_samples_to_beats(double out_samples) const;
+	double get_beats_to_out_samples_factor() const;
 
 	ma_uint64 samples_self2out(ma_uint64 self_samples) const;
 	ma_uint64 samples_out2self(ma_uint64 out_samples) const;
@@ -38,6 +51,10 @@ private:
 	double _sample_rate = 0.0;
 	double _out_sample_rate = 0.0;
 	double _bpm = 0.0;
+	double _preload_seconds = 0.0;
+	ma_uint32 _num_channels = 0;
+
+	std::shared_ptr<const AudioSource> _source;
 
 	double _beats_to_samples = 0.0, _samples_to_beats = 0.0;
 	double _beats_to_out_samples = 0.0, _out_samples_to_beats = 0.0;
@@ -0,0 +1,50 @@
+#ifndef BQMIX_H
+#define BQMIX_H
+
+#include <miniaudio.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace bq {
+// Sample formats a mix may be written in. All of them are interleaved, and
+// S24 is packed into 3 little-endian bytes per sample, like ma_format_s24.
+enum class MixFormat {
+	F32,
+	S16,
+	S24,
+	S32
+};
+
+size_t mix_format_num_bytes(MixFormat format);
+ma_format mix_format_to_ma_format(MixFormat format);
+
+//
+// TPDF (triangular) dither of one LSB each way, added before a mix is rounded
+// to S16 or S24 so that the rounding error becomes a constant noise floor
+// instead of distortion that follows the signal. The noise comes from a
+// xorshift generator, so it's realtime-safe and the same seed always gives the
+// same output. Each output should have its own.
+//
+class MixDither {
+public:
+	MixDither(std::uint32_t seed = 0x9e3779b9u);
+
+	// Noise in (-1, 1), measured in LSBs
+	float next();
+
+private:
+	float _next_uniform();
+
+	std::uint32_t _state = 1;
+};
+
+// Sums num_srcs buffers of num_samples float samples each and writes the sum
+// to dest in format, in a single pass over dest. Integer formats are dithered
+// (except S32, whose LSB is far below a float's precision) and clipped.
+// Realtime-safe.
+void mix_samples(void *dest, MixFormat format, const float *const *srcs,
+	unsigned int num_srcs, ma_uint64 num_samples, MixDither &dither);
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef BQOFFLINERENDERER_H
+#define BQOFFLINERENDERER_H
+
+#include "bqMix.h"
+#include "bqWorld.h"
+#include "bqConfig.h"
+
+#include <miniaudio.h>
+
+#include <functional>
+#include <string>
+
+namespace bq {
+//
+// Renders a World's arrangement as fast as the CPU allows, without an audio
+// device or an IO thread. The renderer does the IO and audio threads' work
+// itself, one block at a time and always in the same order, so a render is
+// deterministic. Whenever a pull would run out of decoded audio, the missing
+// audio is decoded right away instead of being replaced with silence.
+//
+// Nothing else may pump the World while it's being rendered. Edits made
+// beforehand (insert_clip() etc.) are applied when the render begins.
+//
+class OfflineRenderer {
+public:
+	// Called with each rendered block: the mix of all tracks, and each
+	// track on its own, all num_frames interleaved frames long. Returning
+	// false stops the render.
+	using BlockCallback = std::function<bool(const float *mix,
+		const float *const *tracks, ma_uint64 num_frames)>;
+
+	OfflineRenderer(World *world);
+
+	// Renders the playhead from from_beat to to_beat at the World's tempo,
+	// returning false if the render was stopped or couldn't start
+	bool render(unsigned int playhead_idx, double from_beat, double to_beat,
+		const BlockCallback &callback);
+
+	// Write WAV files: either the mix of all tracks in format (dithered
+	// if it's S16 or S24, see mix_samples()), or one 32-bit float file per
+	// track named filename_prefix followed by the track index and ".wav"
+	bool render_mix(unsigned int playhead_idx, double from_beat,
+		double to_beat, const std::string &filename,
+		MixFormat format = MixFormat::F32);
+	bool render_stems(unsigned int playhead_idx, double from_beat,
+		double to_beat, const std::string &filename_prefix);
+
+private:
+	// Like BlockCallback, but with the mix in the format it was rendered
+	// in
+	using _MixBlockCallback = std::function<bool(const void *mix,
+		const float *const *tracks, ma_uint64 num_frames)>;
+
+	bool _render(unsigned int playhead_idx, double from_beat,
+		double to_beat, MixFormat format,
+		const _MixBlockCallback &callback);
+	void _pump(unsigned int playhead_idx);
+
+	World *_world = nullptr;
+
+	static constexpr ma_uint64 _BLOCK_NUM_FRAMES = 4096;
+	// Pumps needed for a playhead jump to travel from the IOEngine to the
+	// AudioEngine and for the IOEngine to learn that it's done
+	static constexpr unsigned int _NUM_SETTLE_PUMPS = 3;
+};
+}
+
+#endif
@@ -1,11 +0,0 @@
-#ifndef BQOLDPRELOADSARRAY_H
-#define BQOLDPRELOADSARRAY_H
-
-namespace bq {
-struct OldPreloadsArray {
-	unsigned int num_preloads;
-	float **frames;
-};
-}
-
-#endif
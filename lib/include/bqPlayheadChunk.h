@@ -1,6 +1,8 @@
 #ifndef BQPLAYHEADCHUNK_H
 #define BQPLAYHEADCHUNK_H
 
+#include "bqSampleStorage.h"
+
 #include <miniaudio.h>
 
 namespace bq {
@@ -9,7 +11,12 @@ struct PlayheadChunk {
 
 	ma_uint32 num_channels, sample_rate;
 	ma_uint64 first_frame, num_frames;
-	float *frames;
+	void *frames;
+	SampleStorage storage;
+	// False if frames points straight into a song's memory (see
+	// Library::pcm_frames()) rather than to a buffer of the chunk's own.
+	// Nothing ever writes to frames that aren't owned.
+	bool owns_frames;
 
 	unsigned int song_id;
 };
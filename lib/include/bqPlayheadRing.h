@@ -0,0 +1,59 @@
+#ifndef BQPLAYHEADRING_H
+#define BQPLAYHEADRING_H
+
+#include "bqPlayheadChunk.h"
+#include "bqConfig.h"
+
+#include <miniaudio.h>
+
+#include <atomic>
+
+namespace bq {
+// Fixed-size single-producer, single-consumer ring of decoded chunks for one
+// playhead/track combination. Every slot's frames are allocated up front, so
+// the IO thread decodes directly into the ring and the audio thread reads the
+// frames in place; nothing is allocated or passed as a message while
+// streaming.
+class PlayheadRing {
+public:
+	PlayheadRing() {}
+	~PlayheadRing();
+
+	// Must not be called while either thread is using the ring
+	void allocate(ma_uint32 num_channels, unsigned int num_slots,
+		ma_uint64 slot_num_frames, SampleStorage storage);
+	void deallocate();
+
+	bool is_allocated();
+	ma_uint64 slot_num_frames();
+
+	// Should only be called from the IO thread. begin_write() returns the
+	// next free slot (or nullptr if the ring is full), which becomes
+	// visible to the audio thread once end_write() is called.
+	PlayheadChunk *begin_write();
+	void end_write();
+
+	// Should only be called from the audio thread. front() returns the
+	// oldest written slot (or nullptr if the ring is empty), which may be
+	// overwritten once pop() is called.
+	PlayheadChunk *front();
+	void pop();
+	void pop_all();
+
+	// Number of written slots not yet popped; may be called from any thread
+	ma_uint64 num_filled();
+
+private:
+	PlayheadChunk *_slots = nullptr;
+	void *_frames = nullptr;
+	unsigned int _num_slots = 0;
+	ma_uint64 _slot_num_frames = 0;
+
+	// Both indices only ever increase; each has a single writer and lives
+	// on its own cache line
+	alignas(CACHE_LINE_NUM_BYTES) std::atomic<ma_uint64> _write_idx{0};
+	alignas(CACHE_LINE_NUM_BYTES) std::atomic<ma_uint64> _read_idx{0};
+};
+}
+
+#endif
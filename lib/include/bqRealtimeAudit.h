@@ -0,0 +1,67 @@
+#ifndef BQREALTIMEAUDIT_H
+#define BQREALTIMEAUDIT_H
+
+#include <miniaudio.h>
+
+//
+// Realtime-safety audit mode
+//
+// When bquence is built with BQ_REALTIME_AUDIT defined, World marks the
+// calling thread as the audio thread for as long as pump_audio_thread(),
+// pull_audio() and pull_done_advance_playhead() run. Every operator new or
+// delete made by a marked thread is then counted as a violation, and reported
+// on stderr with a stack trace if requested.
+//
+// malloc/free and common blocking calls (mutexes, sleeps, file IO) are also
+// audited if BQ_REALTIME_AUDIT_WRAP_LIBC is defined and the final executable
+// is linked with the GNU ld --wrap options listed in bqRealtimeAudit.cpp.
+//
+// Without BQ_REALTIME_AUDIT none of this is compiled in and
+// BQ_REALTIME_AUDIT_SCOPE() expands to nothing.
+//
+
+namespace bq {
+struct RealtimeAuditReport {
+	ma_uint64 num_allocations = 0;
+	ma_uint64 num_deallocations = 0;
+	ma_uint64 num_blocking_calls = 0;
+
+	ma_uint64 num_violations() const
+	{
+		return num_allocations + num_deallocations +
+			num_blocking_calls;
+	}
+};
+
+enum class RealtimeAuditViolation {
+	ALLOCATION = 0,
+	DEALLOCATION,
+	BLOCKING_CALL
+};
+
+#ifdef BQ_REALTIME_AUDIT
+// Marks the current thread as the audio thread until destroyed; scopes may be
+// nested
+class RealtimeAuditScope {
+public:
+	RealtimeAuditScope();
+	~RealtimeAuditScope();
+};
+
+bool realtime_audit_is_audio_thread();
+void realtime_audit_report_violation(RealtimeAuditViolation violation,
+	const char *what);
+
+RealtimeAuditReport realtime_audit_get_report();
+void realtime_audit_reset();
+// Print a stack trace to stderr for every violation (off by default)
+void realtime_audit_set_print_stack_traces(bool print_stack_traces);
+
+#define BQ_REALTIME_AUDIT_SCOPE() \
+	bq::RealtimeAuditScope bq_realtime_audit_scope_
+#else
+#define BQ_REALTIME_AUDIT_SCOPE()
+#endif
+}
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef BQRENDERKERNELS_H
+#define BQRENDERKERNELS_H
+
+#include "bqSampleStorage.h"
+
+#include <miniaudio.h>
+
+namespace bq {
+// Where a pull renders to: interleaved frames, or one buffer per channel
+// (planar) if channels isn't nullptr. Frame indices passed along with it count
+// from frames (or from the start of each channel's buffer).
+struct RenderDest {
+	float *frames = nullptr;
+	float *const *channels = nullptr;
+};
+
+//
+// The loops the audio thread runs over every frame it renders. Each one is
+// instantiated for the common channel counts (1, 2, 4, 6 and 8), where the
+// channel loop is unrolled and the frame loop can be vectorized, plus a generic
+// fallback for any other count. The right instantiations are picked once, when
+// the output format is set, so the inner loops never branch on it.
+//
+class RenderKernels {
+public:
+	RenderKernels() { select(0); }
+
+	// generic forces the fallback kernels even where specialized ones
+	// exist, which is only useful to compare the two
+	void select(ma_uint32 num_channels, bool generic = false);
+
+	ma_uint32 get_num_channels() const
+	{
+		return _num_channels;
+	}
+
+	bool is_specialized() const
+	{
+		return _specialized;
+	}
+
+	// Zeroes num_frames frames
+	void fill_silence(float *dest, ma_uint64 num_frames) const
+	{
+		_fill_silence(dest, num_frames, _num_channels);
+	}
+
+	// Scales every channel of frame i by gains[i]
+	void apply_gains(float *dest, const float *gains,
+		ma_uint64 num_frames) const
+	{
+		_apply_gains(dest, gains, num_frames, _num_channels);
+	}
+
+	// Converts frames kept in storage to float, mapping src_num_channels
+	// channels (which must be either 1 or the kernels' channel count)
+	// onto the kernels' channels. Mono frames are copied to every
+	// channel, just as the decoder would have upmixed them.
+	void load_frames(float *dest, const void *src, SampleStorage storage,
+		ma_uint32 src_num_channels, ma_uint64 num_frames) const
+	{
+		_load_frames(dest, src, storage, src_num_channels, num_frames,
+			_num_channels);
+	}
+
+	// The same, for num_frames frames of dest starting at first_frame.
+	// Planar destinations are worked through one channel at a time.
+	void fill_silence(const RenderDest &dest, ma_uint64 first_frame,
+		ma_uint64 num_frames) const;
+	void apply_gains(const RenderDest &dest, ma_uint64 first_frame,
+		const float *gains, ma_uint64 num_frames) const;
+	// Copies num_frames interleaved frames from src into dest, splitting
+	// them into channels if dest is planar
+	void store_frames(const RenderDest &dest, ma_uint64 first_frame,
+		const float *src, ma_uint64 num_frames) const;
+
+private:
+	typedef void (*_FillSilenceFn)(float *dest, ma_uint64 num_frames,
+		ma_uint32 num_channels);
+	typedef void (*_ApplyGainsFn)(float *dest, const float *gains,
+		ma_uint64 num_frames, ma_uint32 num_channels);
+	typedef void (*_LoadFramesFn)(float *dest, const void *src,
+		SampleStorage storage, ma_uint32 src_num_channels,
+		ma_uint64 num_frames, ma_uint32 num_channels);
+	typedef void (*_DeinterleaveFn)(float *const *dest_channels,
+		ma_uint64 first_frame, const float *src, ma_uint64 num_frames,
+		ma_uint32 num_channels);
+
+	_FillSilenceFn _fill_silence = nullptr;
+	_ApplyGainsFn _apply_gains = nullptr;
+	_LoadFramesFn _load_frames = nullptr;
+	_DeinterleaveFn _deinterleave = nullptr;
+
+	ma_uint32 _num_channels = 0;
+	bool _specialized = false;
+};
+}
+
+#endif
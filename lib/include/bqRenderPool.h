@@ -0,0 +1,84 @@
+#ifndef BQRENDERPOOL_H
+#define BQRENDERPOOL_H
+
+#include "bqConfig.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace bq {
+//
+// A small fork-join pool of worker threads that help the audio thread render
+// independent streams at once. run() hands out jobs to the workers and to the
+// calling thread itself, and returns as soon as every job is done.
+//
+// run() never allocates or locks, and never waits for a worker that hasn't
+// claimed a job: the calling thread claims jobs too, so if every worker is
+// asleep (or descheduled) it simply renders all of them itself. It only waits
+// for jobs a worker has already started, so a worker preempted in the middle
+// of one stalls run() until it gets the CPU back. The workers should therefore
+// run at the audio thread's realtime priority: either pass it as
+// realtime_priority (SCHED_FIFO, where supported and permitted), or set it
+// from the host.
+//
+// Between runs the workers spin for a short while, so that the next run within
+// the same callback finds them awake, and then sleep on a futex (where
+// supported) until a run wakes them.
+//
+// Only one thread may call run() at a time.
+//
+class RenderPool {
+public:
+	using Job = void (*)(void *context, unsigned int job_idx);
+
+	// pin_workers pins each worker to its own core, where supported. A
+	// realtime_priority of 0 leaves the workers' priority alone.
+	RenderPool(unsigned int num_workers, bool pin_workers,
+		int realtime_priority = 0);
+	~RenderPool();
+
+	RenderPool(const RenderPool &) = delete;
+	RenderPool &operator=(const RenderPool &) = delete;
+
+	unsigned int get_num_workers();
+
+	// Calls job(context, i) once for every i below num_jobs, spread across
+	// the workers and the calling thread
+	void run(Job job, void *context, unsigned int num_jobs);
+
+private:
+	void _work(unsigned int worker_idx, bool pin, int realtime_priority);
+	// Claims and runs jobs from the current round until none are left
+	void _run_jobs();
+	void _wait_for_generation(std::uint32_t seen_generation);
+
+	std::vector<std::thread> _workers;
+
+	// Bumped by run() to start each round; workers sleep on it
+	alignas(CACHE_LINE_NUM_BYTES) std::atomic<std::uint32_t> _generation{0};
+	std::atomic<unsigned int> _num_sleeping{0};
+	std::atomic<bool> _quit{false};
+
+	// The round's generation (top 32 bits), number of jobs (next 16) and
+	// next unclaimed job (low 16) in one word, so that a worker that wakes
+	// late can never claim a job of a later round
+	alignas(CACHE_LINE_NUM_BYTES) std::atomic<std::uint64_t> _claim{0};
+	// Jobs of the current round that have finished
+	alignas(CACHE_LINE_NUM_BYTES) std::atomic<unsigned int> _num_done{0};
+
+	// Written by run() before it publishes a round in _claim, and left
+	// alone until every job of the round (so every claim) is done
+	Job _job = nullptr;
+	void *_context = nullptr;
+	unsigned int _first_job_idx = 0;
+
+	// Most jobs a round can count in _claim; run() splits bigger batches
+	static constexpr unsigned int _MAX_ROUND_NUM_JOBS = 0xffff;
+	// About 50-100us on current CPUs
+	static constexpr unsigned int _NUM_SPINS = 2048;
+};
+}
+
+#endif
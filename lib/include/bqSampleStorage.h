@@ -0,0 +1,64 @@
+#ifndef BQSAMPLESTORAGE_H
+#define BQSAMPLESTORAGE_H
+
+#include "bqAudioSource.h"
+
+#include <miniaudio.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace bq {
+//
+// How decoded audio is kept in preloads and chunks. Most source material is
+// 16-bit, so keeping it as 32-bit floats spends half of the memory (and half of
+// the bandwidth the audio thread reads it with) on nothing. The compact formats
+// are converted back to floats as the frames are copied out for the time
+// stretcher.
+//
+// S16 is exact for 16-bit sources, but clips anything outside [-1, 1]. F16
+// (IEEE half precision) keeps 11 bits of precision, but never clips.
+//
+// Frames borrowed straight from a song in memory (see Library::pcm_frames())
+// are always F32, whatever the World's storage is.
+//
+enum class SampleStorage {
+	F32,
+	S16,
+	F16
+};
+
+size_t sample_storage_num_bytes(SampleStorage storage);
+
+// Buffers of samples in any storage are allocated and freed with these
+void *allocate_samples(SampleStorage storage, ma_uint64 num_samples);
+void free_samples(void *samples);
+
+// The address of the sample at sample_idx
+void *sample_at(void *samples, SampleStorage storage, ma_uint64 sample_idx);
+const void *sample_at(const void *samples, SampleStorage storage,
+	ma_uint64 sample_idx);
+
+// Conversions between float samples and samples in storage. Both are
+// realtime-safe, and are vectorized where the target supports it (F16C for
+// F16, AVX2 for S16).
+void store_samples(void *dest, SampleStorage storage, const float *src,
+	ma_uint64 num_samples);
+void load_samples(float *dest, const void *src, SampleStorage storage,
+	ma_uint64 num_samples);
+
+// How many channels a song's frames are kept with in preloads and chunks. Mono
+// songs stay mono, and are copied to every channel as they're played (see
+// RenderKernels::load_frames()). Anything else is still mixed to the output's
+// channel count by the decoder, which knows the speaker layouts.
+ma_uint32 stored_num_channels(ma_uint32 song_num_channels,
+	ma_uint32 out_num_channels);
+
+// Reads up to num_frames frames into frames kept in storage, going through
+// scratch (which is sized on first use) unless the storage is F32
+ma_uint64 read_samples(AudioSourceReader &reader, void *frames,
+	SampleStorage storage, ma_uint64 num_frames, ma_uint32 num_channels,
+	std::vector<float> &scratch);
+}
+
+#endif
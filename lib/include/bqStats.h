@@ -0,0 +1,87 @@
+#ifndef BQSTATS_H
+#define BQSTATS_H
+
+#include "bqConfig.h"
+
+#include <miniaudio.h>
+
+#include <atomic>
+#include <vector>
+
+namespace bq {
+//
+// A counter with exactly one writer thread, readable from any thread at any
+// time. Because there is only one writer, it's updated with a relaxed load and
+// store rather than a read-modify-write, so counting costs no more than an
+// ordinary increment and never stalls the writer.
+//
+class StatsCounter {
+public:
+	StatsCounter() : _value(0) {}
+
+	void add(ma_uint64 n)
+	{
+		_value.store(_value.load(std::memory_order_relaxed) + n,
+			std::memory_order_relaxed);
+	}
+
+	ma_uint64 get() const
+	{
+		return _value.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<ma_uint64> _value;
+};
+
+// Statistics for a single playhead/track combination. All counts are totals
+// since the World was created.
+struct StreamStats {
+	// Frames fed to the time stretcher, by where they came from
+	ma_uint64 num_frames_from_preload = 0;
+	ma_uint64 num_frames_from_chunks = 0;
+	ma_uint64 num_frames_silence = 0;
+	// Number of times the time stretcher wanted more frames than the
+	// preload and chunks could provide
+	ma_uint64 num_underruns = 0;
+	ma_uint64 num_emergency_chunk_requests = 0;
+	ma_uint64 num_soundtouch_resets = 0;
+
+	// Calls to World::pull_audio() and the frames they rendered
+	ma_uint64 num_pulls = 0;
+	ma_uint64 num_frames_rendered = 0;
+
+	ma_uint64 num_decode_calls = 0;
+	ma_uint64 num_decoded_bytes = 0;
+	// Decoded chunks the IO thread has handed over that the audio thread
+	// hasn't finished with yet
+	ma_uint64 num_queued_chunks = 0;
+};
+
+struct Stats {
+	unsigned int num_tracks = 0;
+	unsigned int num_playheads = 0;
+	// num_tracks for each playhead in turn; see stream()
+	std::vector<StreamStats> streams;
+
+	StreamStats &stream(unsigned int playhead_idx, unsigned int track_idx)
+	{
+		return streams[playhead_idx * num_tracks + track_idx];
+	}
+
+	// Totals of all preloads ever made, and the memory they allocated
+	ma_uint64 num_preloads = 0;
+	ma_uint64 num_preload_bytes = 0;
+	// Memory held by preloads right now, including those replaced by
+	// edits that the audio thread might still be reading
+	ma_uint64 num_live_preload_bytes = 0;
+	// Preloads evicted to stay within WorldConfig::memory_budget_num_bytes
+	ma_uint64 num_preload_evictions = 0;
+
+	// Messages pushed to each engine that it hasn't handled yet
+	ma_uint64 audio_msg_queue_depth = 0;
+	ma_uint64 io_msg_queue_depth = 0;
+};
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef BQTIMING_H
+#define BQTIMING_H
+
+#include "bqStats.h"
+#include "bqConfig.h"
+
+#include <miniaudio.h>
+
+#include <atomic>
+
+namespace bq {
+// Percentiles of one histogram. Timings are in nanoseconds; the DSP load is in
+// parts per million of the buffer duration.
+struct TimingSummary {
+	ma_uint64 count = 0;
+	ma_uint64 mean = 0;
+	ma_uint64 p50 = 0;
+	ma_uint64 p99 = 0;
+	ma_uint64 p999 = 0;
+	ma_uint64 max = 0;
+};
+
+struct TimingStats {
+	// Audio thread: World::pump_audio_thread() (message handling), every
+	// World::pull_audio() as a whole, and the clip scan, time stretching
+	// and fading stages within each pull
+	TimingSummary audio_pump;
+	TimingSummary audio_pull;
+	TimingSummary audio_clip_scan;
+	TimingSummary audio_stretch;
+	TimingSummary audio_fade;
+
+	// IO thread: every chunk decode and every clip preload
+	TimingSummary io_decode;
+	TimingSummary io_preload;
+
+	// Time the audio thread spent inside bquence during each audio
+	// callback, relative to the duration of the buffer it rendered
+	TimingSummary dsp_load_ppm;
+	double last_dsp_load = 0.0;
+};
+
+//
+// Fixed-size, HDR-style histogram: values below 16 each have their own
+// bucket, and every power of two above that is split into 16 linear
+// sub-buckets, so any recorded value is reproduced within ~6%. Values are
+// clamped to 2^40 (about 18 minutes in nanoseconds).
+//
+// Only one thread may record into a histogram, but any thread may read its
+// percentiles at any time. Nothing is recorded while the histogram is
+// disabled (the default), and recording never allocates or locks.
+//
+class TimingHistogram {
+public:
+	TimingHistogram();
+
+	void set_enabled(bool enabled);
+	bool is_enabled() const;
+
+	void record(ma_uint64 value);
+
+	ma_uint64 get_count() const;
+	ma_uint64 get_max() const;
+	// p is in the range [0, 100]
+	ma_uint64 get_percentile(double p) const;
+	TimingSummary summarize() const;
+
+	// Monotonic clock in nanoseconds
+	static ma_uint64 now();
+
+private:
+	static unsigned int _bucket_idx(ma_uint64 value);
+	static ma_uint64 _bucket_highest_value(unsigned int bucket_idx);
+
+	static constexpr unsigned int _SUB_BUCKET_BITS = 4;
+	static constexpr unsigned int _NUM_SUB_BUCKETS = 1 << _SUB_BUCKET_BITS;
+	static constexpr unsigned int _MAX_MAGNITUDE = 40;
+	static constexpr unsigned int _NUM_BUCKETS = _NUM_SUB_BUCKETS +
+		(_MAX_MAGNITUDE - _SUB_BUCKET_BITS + 1) * _NUM_SUB_BUCKETS;
+
+	std::atomic<bool> _enabled;
+
+	StatsCounter _count;
+	StatsCounter _sum;
+	std::atomic<ma_uint64> _max;
+	StatsCounter _buckets[_NUM_BUCKETS];
+};
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef BQTRACE_H
+#define BQTRACE_H
+
+#include "bqConfig.h"
+
+#include <miniaudio.h>
+
+#include <atomic>
+#include <ostream>
+#include <string>
+
+namespace bq {
+enum class TraceEventType : ma_uint8 {
+	AUDIO_MSG_PUSH = 0,
+	AUDIO_MSG_POP,
+	IO_MSG_PUSH,
+	IO_MSG_POP,
+	DECODE_BEGIN,
+	DECODE_END,
+	CHUNK_RECEIVE,
+	PRELOAD_BEGIN,
+	PRELOAD_END,
+	UNDERRUN,
+	JUMP,
+	CLIP_BOUNDARY,
+	SOUNDTOUCH_CLEAR,
+	NUM_TYPES
+};
+
+// What value means depends on the event type (see TYPE_INFO in bqTrace.cpp)
+struct TraceEvent {
+	ma_uint64 time_ns;
+	double value;
+	TraceEventType type;
+	ma_uint8 playhead;
+	ma_uint8 track;
+};
+
+// Used in place of a playhead or track index for events that don't concern
+// one
+constexpr ma_uint8 TRACE_NO_IDX = 0xff;
+
+//
+// Opt-in event tracer. Every thread that records an event writes into its own
+// fixed-size ring of TRACE_RING_NUM_EVENTS events, which overwrites its oldest
+// events once full, so recording never locks, allocates or waits on another
+// thread. A thread claims one of the Tracer's TRACE_MAX_NUM_THREADS rings the
+// first time it records an event or is named while tracing is enabled, and
+// keeps it for as long as the Tracer lives; events recorded by any threads
+// beyond that are dropped.
+//
+// The rings are allocated the first time tracing is enabled, which should not
+// be done on the audio thread.
+//
+class Tracer {
+public:
+	Tracer();
+	~Tracer();
+
+	void set_enabled(bool enabled);
+	bool is_enabled() const
+	{
+		return _enabled.load(std::memory_order_relaxed);
+	}
+
+	void record(TraceEventType type, unsigned int playhead,
+		unsigned int track, double value);
+	// Names the calling thread in the exported trace, unless it already has
+	// a name. Does nothing while tracing is disabled. The name must outlive
+	// the Tracer (e.g. be a string literal).
+	void name_thread(const char *name);
+
+	// Not realtime-safe: allocates, sorts and writes every event still held
+	// in the rings. Events recorded while this is running may be missing.
+	void write_chrome_json(std::ostream &out);
+	bool write_chrome_json(const std::string &filename);
+
+private:
+	struct _Ring {
+		TraceEvent *events = nullptr;
+		std::atomic<ma_uint64> write_idx{0};
+		std::atomic<const char *> name{nullptr};
+		// The thread that claimed the ring, if any
+		std::atomic<const void *> owner{nullptr};
+	};
+
+	_Ring *_current_thread_ring();
+
+	// Tells this Tracer apart from any other one, even one later allocated
+	// at the same address
+	const ma_uint64 _id;
+	std::atomic<bool> _enabled{false};
+	std::atomic<bool> _allocated{false};
+	_Ring _rings[TRACE_MAX_NUM_THREADS];
+};
+
+// Records the event if there is a tracer and it's enabled
+inline void trace(Tracer *tracer, TraceEventType type, unsigned int playhead,
+	unsigned int track, double value)
+{
+	if (tracer && tracer->is_enabled()) {
+		tracer->record(type, playhead, track, value);
+	}
+}
+}
+
+#endif
@@ -1,9 +1,16 @@
 #ifndef BQWORLD_H
 #define BQWORLD_H
 
+#include "bqAlignedArray.h"
 #include "bqAudioEngine.h"
 #include "bqIOEngine.h"
 #include "bqLibrary.h"
+#include "bqMix.h"
+#include "bqRenderPool.h"
+#include "bqStats.h"
+#include "bqTiming.h"
+#include "bqTrace.h"
+#include "bqWorldConfig.h"
 #include "bqConfig.h"
 
 #include <miniaudio.h>
@@ -11,9 +18,27 @@
 namespace bq {
 class World {
 public:
-	World(ma_uint32 num_channels, ma_uint32 sample_rate);
+	// Everything kept for each track and playhead is allocated here, so
+	// a World costs only as much as the tracks and playheads it's given.
+	// The config's buffer sizes are resolved against sample_rate.
+	World(ma_uint32 num_channels, ma_uint32 sample_rate,
+		const WorldConfig &config = WorldConfig());
+	// Uses a Library owned (and filled) by the caller, which may be shared
+	// with other Worlds. Its output sample rate must already be set to
+	// sample_rate, and add_song() must not be called on any World sharing
+	// it while one of them is running.
+	World(ma_uint32 num_channels, ma_uint32 sample_rate,
+		Library *shared_library,
+		const WorldConfig &config = WorldConfig());
 	~World();
 
+	ma_uint32 get_num_channels();
+	ma_uint32 get_sample_rate();
+	unsigned int get_num_tracks();
+	unsigned int get_num_playheads();
+	const WorldConfig &get_config();
+	const BufferSizes &get_buffer_sizes();
+
 	double get_bpm();
 	void set_bpm(double bpm);
 
@@ -22,11 +47,24 @@ public:
 
 	unsigned int add_song(const std::string &filename, double sample_rate,
 		double bpm);
+	// In-memory songs; see Library::add_song()
+	unsigned int add_song(const float *frames, ma_uint64 num_frames,
+		ma_uint32 num_channels, double sample_rate, double bpm,
+		bool copy);
+	unsigned int add_song(const void *data, size_t num_bytes,
+		double sample_rate, double bpm, bool copy);
+	unsigned int add_song(std::shared_ptr<const AudioSource> source,
+		double bpm);
+	// See Library::set_preload_seconds()
+	void set_song_preload_seconds(unsigned int song_id,
+		double preload_seconds);
 
+	// preload_seconds overrides the song's (or the World's) preload length
+	// for this clip, unless it's 0.0
 	void insert_clip(unsigned int track_idx, double start_beat,
 		double end_beat, double fade_in_beats, double fade_out_beats,
 		double pitch_shift_semitones, ma_uint64 first_frame,
-		unsigned int song_id);
+		unsigned int song_id, double preload_seconds = 0.0);
 	void erase_clips_range(unsigned int track_idx, double from_beat,
 		double to_beat);
 
@@ -46,13 +84,77 @@ public:
 	// Should only be called from the audio thread
 	void pull_audio(unsigned int playhead_idx, unsigned int track_idx,
 		float *out_frames, ma_uint64 num_frames);
+	// Same as pull_audio(), but renders into one buffer per channel
+	// (out_channels[0] to out_channels[num_channels - 1]) instead of
+	// interleaved frames, for hosts that work with planar buffers. Fades
+	// and silence are applied to each channel's buffer directly.
+	void pull_audio_planar(unsigned int playhead_idx,
+		unsigned int track_idx, float *const *out_channels,
+		ma_uint64 num_frames);
 	void pull_done_advance_playhead(unsigned int playhead_idx,
 		ma_uint64 num_frames);
+	// Renders every track of the playhead, writes their mix to out_frames
+	// as interleaved frames in format (see mix_samples()), and advances
+	// the playhead, so it takes the place of pull_audio() and
+	// pull_done_advance_playhead() for hosts that just want the sum.
+	// Summing and converting to format are done in the same pass. The
+	// tracks are rendered in parallel if the World has render workers (see
+	// WorldConfig::num_render_workers).
+	void pull_mix(unsigned int playhead_idx, void *out_frames,
+		MixFormat format, ma_uint64 num_frames);
+
+	// May be called from any thread at any time. The counters are read
+	// one by one without synchronizing with the audio or IO threads, so
+	// the snapshot isn't atomic as a whole, but taking it never stalls
+	// either thread.
+	Stats get_stats();
+
+	// Offline rendering drives the IO and audio work from a single thread
+	// (see OfflineRenderer). While it's enabled, a pull that runs out of
+	// decoded audio decodes what it needs right away instead of filling
+	// the gap with silence. Must not be enabled while separate audio and
+	// IO threads are pumping the World.
+	void set_offline_rendering(bool offline);
+
+	// Timing of the audio and IO threads' work is off by default, since
+	// it reads the clock several times per pull. Both may be called from
+	// any thread at any time.
+	void set_timing_enabled(bool enabled);
+	TimingStats get_timing_stats();
+
+	// Tracing is off by default. Enabling it for the first time allocates
+	// the trace rings, so it shouldn't be done from the audio thread.
+	void set_tracing_enabled(bool enabled);
+	// Writes every event still held in the trace rings as Chrome trace
+	// JSON (viewable in about:tracing or Perfetto). Not realtime-safe.
+	bool write_trace(const std::string &filename);
+	// Names the calling thread in the trace, unless it already has a name;
+	// pump_audio_thread() and pump_io_thread() name theirs "audio" and
+	// "io". The name must outlive the World (e.g. be a string literal).
+	void name_trace_thread(const char *name);
 
 private:
+	void _init(ma_uint32 num_channels, ma_uint32 sample_rate,
+		const WorldConfig &config);
+
 	AudioEngine *_audio = nullptr;
 	IOEngine *_io = nullptr;
 	Library *_library = nullptr;
+	Tracer *_tracer = nullptr;
+	bool _owns_library = true;
+
+	ma_uint32 _num_channels = 0;
+	ma_uint32 _sample_rate = 0;
+	WorldConfig _config;
+	BufferSizes _buffer_sizes;
+
+	// Every track is rendered into here by pull_mix(), up to
+	// _MIX_BLOCK_NUM_FRAMES frames at a time
+	static constexpr ma_uint64 _MIX_BLOCK_NUM_FRAMES = 512;
+	AlignedArray<float> _mix_frames;
+	AlignedArray<float *> _mix_track_frames;
+	MixDither _mix_dither;
+	RenderPool *_render_pool = nullptr;
 };
 }
 
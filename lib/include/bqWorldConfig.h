@@ -0,0 +1,74 @@
+#ifndef BQWORLDCONFIG_H
+#define BQWORLDCONFIG_H
+
+#include "bqSampleStorage.h"
+#include "bqConfig.h"
+
+#include <miniaudio.h>
+
+namespace bq {
+// Buffer sizes in frames, resolved for a particular output format
+struct BufferSizes {
+	ma_uint64 preload_num_frames = 0;
+	ma_uint64 chunk_num_frames = 0;
+	ma_uint64 next_chunk_window_num_frames = 0;
+	ma_uint64 ring_slot_num_frames = 0;
+	unsigned int ring_num_slots = 0;
+	SampleStorage sample_storage = SampleStorage::F32;
+
+	// Memory taken by a preload and by a chunk (or ring slot) of
+	// num_channels channels, kept in sample_storage
+	ma_uint64 preload_num_bytes(ma_uint32 num_channels) const;
+	ma_uint64 chunk_num_bytes(ma_uint32 num_channels) const;
+	ma_uint64 ring_num_bytes(ma_uint32 num_channels) const;
+	// Most memory one playhead/track stream's chunks (or its ring) hold
+	// at once
+	ma_uint64 stream_num_bytes(ma_uint32 num_channels) const;
+};
+
+//
+// Everything a World is sized by. Buffer sizes are in seconds of audio (see
+// bqConfig.h for what each one does) and are resolved into frames against the
+// World's output sample rate when it's constructed.
+//
+struct WorldConfig {
+	unsigned int num_tracks = WORLD_NUM_TRACKS;
+	unsigned int num_playheads = WORLD_NUM_PLAYHEADS;
+
+	// Songs and clips may ask for a different preload length of their own
+	// (see Library::set_preload_seconds() and World::insert_clip())
+	double preload_seconds = PRELOADER_NUM_SECONDS;
+	double chunk_seconds = STREAMER_CHUNK_NUM_SECONDS;
+	double next_chunk_window_seconds =
+		STREAMER_NEXT_CHUNK_WINDOW_NUM_SECONDS;
+	double ring_slot_seconds = STREAMER_RING_SLOT_NUM_SECONDS;
+
+	// Most memory the World's preloads and stream buffers may take, or 0
+	// for no limit. The streams' share is set aside up front, and the
+	// rest goes to the preloads of the clips nearest a playhead; the
+	// others are evicted, and preloaded again as a playhead approaches.
+	// Songs in a DecodedSongCache are kept to the cache's own limit.
+	ma_uint64 memory_budget_num_bytes = 0;
+
+	// How preloads and chunks keep their frames; see SampleStorage
+	SampleStorage sample_storage = SampleStorage::F32;
+
+	// Threads that help the audio thread render the tracks mixed by
+	// World::pull_mix(), each pinned to its own core if
+	// pin_render_workers is set (see RenderPool). 0 renders every track
+	// on the audio thread alone. The workers should run at the audio
+	// thread's realtime priority: render_worker_priority gives them that
+	// SCHED_FIFO priority where permitted; otherwise (or if it's 0) the
+	// host has to raise it.
+	unsigned int num_render_workers = 0;
+	bool pin_render_workers = true;
+	int render_worker_priority = 0;
+
+	BufferSizes resolve(ma_uint32 sample_rate) const;
+};
+
+// Rounds to the nearest frame, but never below one frame
+ma_uint64 seconds_to_frames(double seconds, ma_uint32 sample_rate);
+}
+
+#endif
@@ -1,8 +1,8 @@
 #include "bqAudioClip.h"
 
 namespace bq {
-ma_uint64 AudioClip::pull_preload(float *dest, ma_uint64 first_pull_frame,
-	ma_uint64 num_pull_frames)
+ma_uint64 AudioClip::pull_preload(const RenderKernels &kernels, float *dest,
+	ma_uint64 first_pull_frame, ma_uint64 num_pull_frames)
 {
 	ma_uint64 num_pulled = 0;
 
@@ -21,9 +21,13 @@ ma_uint64 AudioClip::pull_preload(float *dest, ma_uint64 first_pull_frame,
 				num_avail_frames < num_pull_frames ?
 				num_avail_frames : num_pull_frames;
 
-			_copy_frames(dest, preload.frames, 0,
-				first_actual_pull_frame, num_actual_pull_frames,
+			ma_uint32 src_num_channels = static_cast<ma_uint32>(
 				preload.num_channels);
+			kernels.load_frames(dest,
+				sample_at(preload.frames, preload.storage,
+				first_actual_pull_frame * src_num_channels),
+				preload.storage, src_num_channels,
+				num_actual_pull_frames);
 
 			num_pulled += num_actual_pull_frames;
 		}
@@ -31,20 +35,4 @@ ma_uint64 AudioClip::pull_preload(float *dest, ma_uint64 first_pull_frame,
 
 	return num_pulled;
 }
-
-void AudioClip::_copy_frames(float *dest, float *src,
-	ma_uint64 dest_first_frame, ma_uint64 src_first_frame,
-	ma_uint64 num_frames, ma_uint64 num_channels)
-{
-	for (ma_uint64 i = 0; i < num_frames; ++i) {
-		for (ma_uint64 j = 0; j < num_channels; ++j) {
-			ma_uint64 src_idx = (src_first_frame + i) * num_channels
-				+ j;
-			ma_uint64 dest_idx = (dest_first_frame + i) *
-				num_channels + j;
-
-			dest[dest_idx] = src[src_idx];
-		}
-	}
-}
 }
@@ -1,8 +1,94 @@
 #include "bqAudioClipsArray.h"
 
 namespace bq {
+void AudioClipsArray::allocate(unsigned int num)
+{
+	num_clips = num;
+
+	if (num_clips > 0) {
+		starts = new double[static_cast<ma_uint64>(num_clips) * 2];
+		ends = starts + num_clips;
+		clips = new AudioClip[num_clips];
+	} else {
+		starts = nullptr;
+		ends = nullptr;
+		clips = nullptr;
+	}
+}
+
+void AudioClipsArray::deallocate()
+{
+	// The ends array shares its allocation with the starts array
+	if (starts) {
+		delete[] starts;
+	}
+
+	if (clips) {
+		delete[] clips;
+	}
+
+	num_clips = 0;
+	starts = nullptr;
+	ends = nullptr;
+	clips = nullptr;
+}
+
 bool AudioClipsArray::is_clip_valid(unsigned int clip_idx)
 {
 	return clip_idx < num_clips;
 }
+
+unsigned int AudioClipsArray::count_starts_before(double beat,
+	unsigned int from_idx)
+{
+	return _count_starts(beat, from_idx, [](double start, double target) {
+		return start < target;
+	});
+}
+
+unsigned int AudioClipsArray::count_starts_at_or_before(double beat,
+	unsigned int from_idx)
+{
+	return _count_starts(beat, from_idx, [](double start, double target) {
+		return start <= target;
+	});
+}
+
+template<class Compare>
+unsigned int AudioClipsArray::_count_starts(double beat,
+	unsigned int from_idx, Compare is_before)
+{
+	unsigned int i = from_idx;
+
+	// During playback, most scans stop after a clip or two, so the first
+	// few clips are checked one at a time
+	unsigned int num_single = num_clips - from_idx < _SCAN_BLOCK_SIZE ?
+		num_clips - from_idx : _SCAN_BLOCK_SIZE;
+	if (from_idx >= num_clips) {
+		num_single = 0;
+	}
+	for (unsigned int j = 0; j < num_single; ++j, ++i) {
+		if (!is_before(starts[i], beat)) {
+			return i - from_idx;
+		}
+	}
+
+	while (i + _SCAN_BLOCK_SIZE <= num_clips) {
+		unsigned int num_before = 0;
+		for (unsigned int j = 0; j < _SCAN_BLOCK_SIZE; ++j) {
+			num_before += is_before(starts[i + j], beat) ? 1 : 0;
+		}
+
+		i += num_before;
+		if (num_before < _SCAN_BLOCK_SIZE) {
+			return i - from_idx;
+		}
+	}
+
+	while (i < num_clips && is_before(starts[i], beat)) {
+		++i;
+	}
+
+	return i - from_idx;
+}
 }
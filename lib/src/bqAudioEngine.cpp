@@ -2,7 +2,7 @@
 #include "bqIOEngine.h"
 
 namespace bq {
-AudioEngine::AudioEngine()
+AudioEngine::AudioEngine(unsigned int num_tracks, unsigned int num_playheads)
 {
 	_num_channels = 0;
 	_sample_rate = 0;
@@ -10,15 +10,34 @@ AudioEngine::AudioEngine()
 	_next_bpm = 0.0;
 	_beats_to_samples = 0.0;
 	_samples_to_beats = 0.0;
+	_epoch = 0;
 
 	set_bpm(120.0);
 
+	// The fade envelope has the same shape for every clip, so it's sampled
+	// once here rather than evaluated for every frame of every fade
+	for (unsigned int i = 0; i < _FADE_CURVE_NUM_POINTS; ++i) {
+		float x = static_cast<float>(i) /
+			static_cast<float>(_FADE_CURVE_NUM_POINTS - 1);
+		_fade_curve[i] = _clamp(_sigmoid_0_to_1(x), 0.0f, 1.0f);
+	}
+
 	_msg_pool = new QwNodePool<AudioMsg>(_NUM_MAX_POOL_MSGS);
 
-	for (unsigned int i = 0; i < WORLD_NUM_TRACKS; ++i) {
-		_tracks[i].num_clips = 0;
-		_tracks[i].clips = nullptr;
+	_num_tracks = num_tracks;
+	_num_playheads = num_playheads;
+
+	_tracks.allocate(_num_tracks);
+	for (unsigned int i = 0; i < _num_tracks; ++i) {
+		_tracks[i].allocate(0);
+	}
+
+	_playheads.allocate(_num_playheads, _num_tracks);
+	for (unsigned int i = 0; i < _num_playheads; ++i) {
+		_playheads[i].set_playhead_idx(i);
 	}
+
+	_stream_stats.allocate(_num_playheads * _num_tracks);
 }
 
 AudioEngine::~AudioEngine()
@@ -31,33 +50,126 @@ AudioEngine::~AudioEngine()
 	// would cause memory management errors.
 	bind_library(nullptr);
 	bind_io_engine(nullptr);
+	bind_tracer(nullptr);
 
+	// Clips are owned (and freed) by the IOEngine
 	handle_all_msgs();
 
-	for (unsigned int i = 0; i < WORLD_NUM_TRACKS; ++i) {
-		if (_tracks[i].clips) {
-			delete[] _tracks[i].clips;
-		}
-		_tracks[i].num_clips = 0;
-	}
-
 	delete _msg_pool;
 }
 
 void AudioEngine::pull(unsigned int playhead_idx, unsigned int track_idx,
 	float *dest, ma_uint64 num_frames)
 {
-	if (!_library || !_is_playhead_valid(playhead_idx) ||
-		!_is_track_valid(track_idx)) {
-		_fill_silence(dest, 0, num_frames, _num_channels);
+	RenderDest render_dest;
+	render_dest.frames = dest;
+	_pull_timed(playhead_idx, track_idx, render_dest, num_frames);
+}
+
+void AudioEngine::pull_planar(unsigned int playhead_idx,
+	unsigned int track_idx, float *const *dest_channels,
+	ma_uint64 num_frames)
+{
+	RenderDest render_dest;
+	render_dest.channels = dest_channels;
+	_pull_timed(playhead_idx, track_idx, render_dest, num_frames);
+}
+
+// What each of pull_tracks()'s jobs needs to pull its track
+struct PullTracksJob {
+	AudioEngine *engine = nullptr;
+	unsigned int playhead_idx = 0;
+	float *const *dests = nullptr;
+	ma_uint64 num_frames = 0;
+};
+
+void AudioEngine::pull_tracks(unsigned int playhead_idx, float *const *dests,
+	unsigned int num_tracks, ma_uint64 num_frames, RenderPool *pool)
+{
+	if (!pool || _offline) {
+		for (unsigned int i = 0; i < num_tracks; ++i) {
+			pull(playhead_idx, i, dests[i], num_frames);
+		}
+		return;
+	}
+
+	bool timing = _timings.pull.is_enabled();
+	ma_uint64 start = timing ? TimingHistogram::now() : 0;
+
+	PullTracksJob job;
+	job.engine = this;
+	job.playhead_idx = playhead_idx;
+	job.dests = dests;
+	job.num_frames = num_frames;
+	pool->run(_pull_track_job, &job, num_tracks);
+
+	if (timing) {
+		ma_uint64 elapsed = TimingHistogram::now() - start;
+		_timings.pull.record(elapsed);
+		_timings.callback_ns += elapsed;
+		if (num_frames > _timings.callback_num_frames) {
+			_timings.callback_num_frames = num_frames;
+		}
+	}
+}
+
+// Runs on any of the pool's threads, so it mustn't touch the timings (which
+// only the audio thread records)
+void AudioEngine::_pull_track_job(void *context, unsigned int track_idx)
+{
+	PullTracksJob &job = *static_cast<PullTracksJob *>(context);
+
+	RenderDest dest;
+	dest.frames = job.dests[track_idx];
+	job.engine->_pull(job.playhead_idx, track_idx, dest, job.num_frames,
+		false);
+}
+
+void AudioEngine::_pull_timed(unsigned int playhead_idx,
+	unsigned int track_idx, const RenderDest &dest, ma_uint64 num_frames)
+{
+	if (!_timings.pull.is_enabled()) {
+		_pull(playhead_idx, track_idx, dest, num_frames, false);
+		return;
+	}
+
+	ma_uint64 start = TimingHistogram::now();
+	_pull(playhead_idx, track_idx, dest, num_frames, true);
+	ma_uint64 elapsed = TimingHistogram::now() - start;
+
+	_timings.pull.record(elapsed);
+	_timings.callback_ns += elapsed;
+	if (num_frames > _timings.callback_num_frames) {
+		_timings.callback_num_frames = num_frames;
+	}
+}
+
+void AudioEngine::_pull(unsigned int playhead_idx, unsigned int track_idx,
+	const RenderDest &dest, ma_uint64 num_frames, bool timing)
+{
+	ma_uint64 start = timing ? TimingHistogram::now() : 0;
+
+	if (!_is_playhead_valid(playhead_idx) || !_is_track_valid(track_idx)) {
+		_kernels.fill_silence(dest, 0, num_frames);
 		return;
 	}
 
 	AudioPlayhead &playhead = _playheads[playhead_idx];
 	AudioClipsArray &track = _tracks[track_idx];
 
+	_StreamStats &stream_stats = _stream_stats[_stream_idx(playhead_idx,
+		track_idx)];
+	stream_stats.num_pulls.add(1);
+	stream_stats.num_frames_rendered.add(num_frames);
+
+	ma_uint64 want_frame_request = 0;
+	if (_io) {
+		want_frame_request = _io->get_want_frame_request(playhead_idx,
+			track_idx);
+	}
+
 	if (track.num_clips < 1) {
-		_fill_silence(dest, 0, num_frames, _num_channels);
+		_kernels.fill_silence(dest, 0, num_frames);
 		return;
 	}
 
@@ -69,27 +181,26 @@ void AudioEngine::pull(unsigned int playhead_idx, unsigned int track_idx,
 
 	unsigned int first_clip = playhead.get_cur_clip_idx(track_idx);
 	if (!track.is_clip_valid(first_clip)) {
-		_fill_silence(dest, 0, num_frames, _num_channels);
+		_kernels.fill_silence(dest, 0, num_frames);
 		return;
 	}
-	unsigned int last_clip = first_clip;
+	unsigned int last_clip = first_clip + track.count_starts_before(
+		last_beat, first_clip + 1);
 
-	while (track.is_clip_valid(last_clip + 1)) {
-		if (track.clips[last_clip + 1].start < last_beat) {
-			++last_clip;
-		} else {
-			break;
-		}
+	ma_uint64 stretch_ns = 0, fade_ns = 0;
+	if (timing) {
+		_timings.clip_scan.record(TimingHistogram::now() - start);
 	}
 
 	ma_uint64 prev_last_frame_ofs = 0;
 	for (unsigned int i = first_clip; i <= last_clip; ++i) {
-		AudioClip &clip = track.clips[i];
-
-		if (clip.end <= first_beat || clip.start >= last_beat) {
+		if (track.ends[i] <= first_beat ||
+			track.starts[i] >= last_beat) {
 			continue;
 		}
 
+		AudioClip &clip = track.clips[i];
+
 		double clip_first_beat = clip.start;
 		if (clip_first_beat < first_beat) {
 			clip_first_beat = first_beat;
@@ -116,36 +227,45 @@ void AudioEngine::pull(unsigned int playhead_idx, unsigned int track_idx,
 			continue;
 		}
 
-		double song_bpm = _library->bpm(clip.song_id);
+		double song_bpm = clip.song_bpm;
 		if (song_bpm <= 0.0) { // Song ID is invalid...
 			continue;
 		}
-		ma_uint64 song_first_frame = clip.first_frame +
-			_library->beats_to_out_samples(clip.song_id,
-				clip_first_beat - clip.start);
-		ma_uint64 song_next_first_frame = clip.first_frame +
-			_library->beats_to_out_samples(clip.song_id,
-				clip_last_beat - clip.start);
+		// Frames are measured from the beginning of the clip's stream
+		// so that contiguous clips line up exactly and the stretcher
+		// isn't reset at their boundaries
+		ma_uint64 song_first_frame = clip.stream_first_frame +
+			clip.beats_to_out_frames(clip_first_beat -
+				clip.stream_start);
+		ma_uint64 song_next_first_frame = clip.stream_first_frame +
+			clip.beats_to_out_frames(clip_last_beat -
+				clip.stream_start);
 
 		if (prev_last_frame_ofs < clip_first_frame_ofs) {
 			ma_uint64 silence_num_frames = clip_first_frame_ofs -
 				prev_last_frame_ofs;
-			_fill_silence(dest, prev_last_frame_ofs,
-				silence_num_frames, _num_channels);
+			_kernels.fill_silence(dest, prev_last_frame_ofs,
+				silence_num_frames);
 		}
 
-		float *pull_dest = dest + (clip_first_frame_ofs *
-			_num_channels);
 		AudioPlayhead &playhead = _playheads[playhead_idx];
+		ma_uint64 stretch_start = timing ? TimingHistogram::now() : 0;
 		bool playhead_pull_successful = playhead.pull_stretch(_bpm,
-			track_idx, clip, song_bpm, pull_dest, song_first_frame,
-			clip_num_frames, song_next_first_frame);
+			track_idx, clip, song_bpm, dest, clip_first_frame_ofs,
+			song_first_frame, clip_num_frames,
+			song_next_first_frame);
+		if (timing) {
+			stretch_ns += TimingHistogram::now() - stretch_start;
+		}
 		if (!playhead_pull_successful &&
 			playhead.get_can_request_emergency_chunk(track_idx)) {
 			playhead.set_cannot_request_emergency_chunk(track_idx);
 			_io->request_emergency_chunk(playhead_idx, track_idx);
+			stream_stats.num_emergency_chunk_requests.add(1);
 		}
 
+		ma_uint64 fade_start = timing ? TimingHistogram::now() : 0;
+
 		// Fade in
 		double fade_in_last_beat = clip.start + clip.fade_in;
 		if (first_beat < fade_in_last_beat) {
@@ -153,11 +273,9 @@ void AudioEngine::pull(unsigned int playhead_idx, unsigned int track_idx,
 				clip.fade_in);
 			ma_uint64 dest_num_frames = _min(clip_num_frames,
 				fade_num_frames);
-			float *fade_dest = dest + (clip_first_frame_ofs *
-				_num_channels);
 			float fade_base = static_cast<float>(
-				(first_beat - clip.start) / clip.fade_in);
-			_fade(fade_dest, dest_num_frames,
+				(first_beat - clip.start) * clip.inv_fade_in);
+			_fade(dest, clip_first_frame_ofs, dest_num_frames,
 				static_cast<float>(fade_num_frames), fade_base,
 				false);
 		}
@@ -169,27 +287,34 @@ void AudioEngine::pull(unsigned int playhead_idx, unsigned int track_idx,
 				clip.fade_out);
 			ma_uint64 dest_num_frames = _min(clip_num_frames,
 				fade_num_frames);
-			float *fade_dest = dest +
-				((clip_last_frame_ofs - dest_num_frames) *
-					_num_channels);
 			float fade_base = static_cast<float>(
-				(clip.end - first_beat) / clip.fade_out);
-			_fade(fade_dest, dest_num_frames,
+				(clip.end - first_beat) * clip.inv_fade_out);
+			_fade(dest, clip_last_frame_ofs - dest_num_frames,
+				dest_num_frames,
 				static_cast<float>(fade_num_frames), fade_base,
 				true);
 		}
 
+		if (timing) {
+			fade_ns += TimingHistogram::now() - fade_start;
+		}
+
 		prev_last_frame_ofs = clip_last_frame_ofs;
 	}
 	if (prev_last_frame_ofs < num_frames) {
 		ma_uint64 silence_num_frames = num_frames -
 			prev_last_frame_ofs;
-		_fill_silence(dest, prev_last_frame_ofs,
-			silence_num_frames, _num_channels);
+		_kernels.fill_silence(dest, prev_last_frame_ofs,
+			silence_num_frames);
 	}
 
-	if (_io->wait_cur_want_frame(playhead_idx, track_idx)) {
-		_io->set_wait_cur_want_frame(playhead_idx, track_idx, false);
+	// Only requests made before this pull started are acknowledged, so a
+	// request made by the IO thread in the meantime isn't lost
+	playhead.set_want_frame_ack(track_idx, want_frame_request);
+
+	if (timing) {
+		_timings.stretch.record(stretch_ns);
+		_timings.fade.record(fade_ns);
 	}
 }
 
@@ -201,14 +326,16 @@ void AudioEngine::pull_done_advance_playhead(unsigned int playhead_idx,
 }
 
 void AudioEngine::set_playback_config(ma_uint32 num_channels,
-	ma_uint32 sample_rate)
+	ma_uint32 sample_rate, const BufferSizes &sizes)
 {
 	_num_channels = num_channels;
 	_sample_rate = sample_rate;
+	_kernels.select(num_channels);
 	_recalc_beats_samples_conversion_factors();
 
-	for (unsigned int i = 0; i < WORLD_NUM_PLAYHEADS; ++i) {
-		_playheads[i].set_playback_config(num_channels, sample_rate);
+	for (unsigned int i = 0; i < _num_playheads; ++i) {
+		_playheads[i].set_playback_config(num_channels, sample_rate,
+			sizes);
 	}
 }
 
@@ -216,38 +343,66 @@ void AudioEngine::bind_io_engine(IOEngine *io)
 {
 	_io = io;
 
-	for (unsigned int i = 0; i < WORLD_NUM_PLAYHEADS; ++i) {
+	for (unsigned int i = 0; i < _num_playheads; ++i) {
 		_playheads[i].bind_io_engine(_io);
 	}
 }
 
+void AudioEngine::set_offline(bool offline)
+{
+	_offline = offline;
+
+	for (unsigned int i = 0; i < _num_playheads; ++i) {
+		_playheads[i].set_offline(offline);
+	}
+}
+
+void AudioEngine::bind_tracer(Tracer *tracer)
+{
+	_tracer = tracer;
+
+	for (unsigned int i = 0; i < _num_playheads; ++i) {
+		_playheads[i].bind_tracer(_tracer);
+	}
+}
+
 void AudioEngine::bind_library(Library *library)
 {
 	_library = library;
 
-	for (unsigned int i = 0; i < WORLD_NUM_PLAYHEADS; ++i) {
+	for (unsigned int i = 0; i < _num_playheads; ++i) {
 		_playheads[i].bind_library(_library);
 	}
 }
 
 void AudioEngine::handle_all_msgs()
 {
+	bool timing = _timings.pump.is_enabled();
+	ma_uint64 start = 0;
+	if (timing) {
+		start = TimingHistogram::now();
+		_finish_callback_timing();
+	}
+
+	// The fence guarantees that any message pushed before the IOEngine saw
+	// the previous epoch is popped below
+	_epoch.store(_epoch.load(std::memory_order_relaxed) + 1);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
 	if (_bpm != _next_bpm) {
 		_apply_next_bpm();
 	}
 
 	AudioMsg *msg = nullptr;
 	while ((msg = _msg_queue.pop())) {
+		trace(_tracer, TraceEventType::AUDIO_MSG_POP, TRACE_NO_IDX,
+			TRACE_NO_IDX, static_cast<double>(msg->type));
+
 		switch (msg->type) {
 		case AudioMsgType::RECEIVE_CLIPS:
 			_handle_receive_clips(msg->contents.receive_clips);
 			break;
 
-		case AudioMsgType::RECEIVE_OLD_PRELOADS:
-			_handle_receive_old_preloads(
-				msg->contents.receive_old_preloads);
-			break;
-
 		case AudioMsgType::RECEIVE_CUR_CLIP_IDX:
 			_handle_receive_cur_clip_idx(
 				msg->contents.receive_cur_clip_idx);
@@ -267,6 +422,13 @@ void AudioEngine::handle_all_msgs()
 		}
 
 		_msg_pool->deallocate(msg);
+		_num_msgs_handled.add(1);
+	}
+
+	if (timing) {
+		ma_uint64 elapsed = TimingHistogram::now() - start;
+		_timings.pump.record(elapsed);
+		_timings.callback_ns += elapsed;
 	}
 }
 
@@ -276,15 +438,10 @@ void AudioEngine::receive_clips(unsigned int track, AudioClipsArray clips)
 	msg->type = AudioMsgType::RECEIVE_CLIPS;
 	msg->contents.receive_clips.track = track;
 	msg->contents.receive_clips.clips = clips;
+	trace(_tracer, TraceEventType::AUDIO_MSG_PUSH, TRACE_NO_IDX, track,
+		static_cast<double>(msg->type));
 	_msg_queue.push(msg);
-}
-
-void AudioEngine::receive_old_preloads(OldPreloadsArray old_preloads)
-{
-	AudioMsg *msg = _msg_pool->allocate();
-	msg->type = AudioMsgType::RECEIVE_OLD_PRELOADS;
-	msg->contents.receive_old_preloads.old_preloads = old_preloads;
-	_msg_queue.push(msg);
+	_num_msgs_pushed.add(1);
 }
 
 void AudioEngine::receive_cur_clip_idx(unsigned int playhead,
@@ -295,7 +452,10 @@ void AudioEngine::receive_cur_clip_idx(unsigned int playhead,
 	msg->contents.receive_cur_clip_idx.playhead = playhead;
 	msg->contents.receive_cur_clip_idx.track = track;
 	msg->contents.receive_cur_clip_idx.cur_clip_idx = cur_clip_idx;
+	trace(_tracer, TraceEventType::AUDIO_MSG_PUSH, playhead, track,
+		static_cast<double>(msg->type));
 	_msg_queue.push(msg);
+	_num_msgs_pushed.add(1);
 }
 
 void AudioEngine::receive_playhead_chunk(unsigned int playhead,
@@ -306,7 +466,10 @@ void AudioEngine::receive_playhead_chunk(unsigned int playhead,
 	msg->contents.receive_playhead_chunk.playhead = playhead;
 	msg->contents.receive_playhead_chunk.track = track;
 	msg->contents.receive_playhead_chunk.chunk = chunk;
+	trace(_tracer, TraceEventType::AUDIO_MSG_PUSH, playhead, track,
+		static_cast<double>(msg->type));
 	_msg_queue.push(msg);
+	_num_msgs_pushed.add(1);
 }
 
 double AudioEngine::get_playhead_beat(unsigned int playhead_idx)
@@ -348,6 +511,37 @@ unsigned int AudioEngine::get_playhead_cur_song_id(unsigned int playhead_idx,
 	}
 }
 
+ma_uint64 AudioEngine::get_want_frame_ack(unsigned int playhead_idx,
+	unsigned int track_idx)
+{
+	if (_is_playhead_valid(playhead_idx)) {
+		return _playheads[playhead_idx].get_want_frame_ack(track_idx);
+	} else {
+		return 0;
+	}
+}
+
+ma_uint64 AudioEngine::get_num_chunks_released(unsigned int playhead_idx,
+	unsigned int track_idx)
+{
+	if (_is_playhead_valid(playhead_idx)) {
+		return _playheads[playhead_idx].get_num_chunks_released(
+			track_idx);
+	} else {
+		return 0;
+	}
+}
+
+PlayheadRing *AudioEngine::get_playhead_ring(unsigned int playhead_idx,
+	unsigned int track_idx)
+{
+	if (_is_playhead_valid(playhead_idx)) {
+		return _playheads[playhead_idx].get_ring(track_idx);
+	} else {
+		return nullptr;
+	}
+}
+
 void AudioEngine::jump_playhead(unsigned int playhead_idx,
 	unsigned int track_idx, unsigned int cur_clip_idx, double beat)
 {
@@ -357,7 +551,63 @@ void AudioEngine::jump_playhead(unsigned int playhead_idx,
 	msg->contents.jump_playhead.track = track_idx;
 	msg->contents.jump_playhead.cur_clip_idx = cur_clip_idx;
 	msg->contents.jump_playhead.beat = beat;
+	trace(_tracer, TraceEventType::AUDIO_MSG_PUSH, playhead_idx, track_idx,
+		static_cast<double>(msg->type));
 	_msg_queue.push(msg);
+	_num_msgs_pushed.add(1);
+}
+
+ma_uint64 AudioEngine::get_epoch()
+{
+	return _epoch;
+}
+
+void AudioEngine::get_stats(Stats &stats)
+{
+	for (unsigned int i = 0; i < _num_playheads; ++i) {
+		for (unsigned int j = 0; j < _num_tracks; ++j) {
+			StreamStats &stream = stats.stream(i, j);
+			_StreamStats &stream_stats =
+				_stream_stats[_stream_idx(i, j)];
+
+			_playheads[i].get_stats(j, stream);
+			stream.num_pulls = stream_stats.num_pulls.get();
+			stream.num_frames_rendered =
+				stream_stats.num_frames_rendered.get();
+			stream.num_emergency_chunk_requests =
+				stream_stats.num_emergency_chunk_requests.get();
+		}
+	}
+
+	// The counters aren't read atomically together, so the handled count
+	// may be slightly ahead of the pushed count
+	ma_uint64 num_msgs_pushed = _num_msgs_pushed.get();
+	ma_uint64 num_msgs_handled = _num_msgs_handled.get();
+	stats.audio_msg_queue_depth = num_msgs_pushed > num_msgs_handled ?
+		num_msgs_pushed - num_msgs_handled : 0;
+}
+
+void AudioEngine::set_timing_enabled(bool enabled)
+{
+	_timings.pump.set_enabled(enabled);
+	_timings.pull.set_enabled(enabled);
+	_timings.clip_scan.set_enabled(enabled);
+	_timings.stretch.set_enabled(enabled);
+	_timings.fade.set_enabled(enabled);
+	_timings.dsp_load.set_enabled(enabled);
+}
+
+void AudioEngine::get_timing_stats(TimingStats &stats)
+{
+	stats.audio_pump = _timings.pump.summarize();
+	stats.audio_pull = _timings.pull.summarize();
+	stats.audio_clip_scan = _timings.clip_scan.summarize();
+	stats.audio_stretch = _timings.stretch.summarize();
+	stats.audio_fade = _timings.fade.summarize();
+	stats.dsp_load_ppm = _timings.dsp_load.summarize();
+	stats.last_dsp_load = static_cast<double>(
+		_timings.last_dsp_load_ppm.load(std::memory_order_relaxed)) /
+		1000000.0;
 }
 
 double AudioEngine::get_bpm()
@@ -386,25 +636,76 @@ double AudioEngine::samples_to_beats(double samples)
 	return samples * _samples_to_beats;
 }
 
-void AudioEngine::_fade(float *dest, ma_uint64 dest_num_frames,
-	float total_num_frames, float initial_x, bool reverse)
+void AudioEngine::_fade(const RenderDest &dest, ma_uint64 dest_first_frame,
+	ma_uint64 dest_num_frames, float total_num_frames, float initial_x,
+	bool reverse)
 {
-	for (ma_uint64 i = 0; i < dest_num_frames; ++i) {
-		float x = static_cast<float>(i) / total_num_frames;
-		x = reverse ? initial_x - x : initial_x + x;
-		x = _clamp(_sigmoid_0_to_1(x), 0.0f, 1.0f);
-		for (ma_uint64 j = 0; j < _num_channels; ++j) {
-			dest[i * _num_channels + j] *= x;
+	float step = 1.0f / total_num_frames;
+	if (reverse) {
+		step = -step;
+	}
+
+	// The curve lookups are kept out of the kernel's loop, so that it only
+	// has the multiplications left to vectorize
+	float gains[_FADE_BLOCK_NUM_FRAMES];
+	for (ma_uint64 i = 0; i < dest_num_frames;
+		i += _FADE_BLOCK_NUM_FRAMES) {
+		ma_uint64 num_block_frames = dest_num_frames - i;
+		if (num_block_frames > _FADE_BLOCK_NUM_FRAMES) {
+			num_block_frames = _FADE_BLOCK_NUM_FRAMES;
+		}
+
+		for (ma_uint64 j = 0; j < num_block_frames; ++j) {
+			gains[j] = _fade_curve_at(initial_x +
+				static_cast<float>(i + j) * step);
 		}
+		_kernels.apply_gains(dest, dest_first_frame + i, gains,
+			num_block_frames);
 	}
 }
 
+float AudioEngine::_fade_curve_at(float x)
+{
+	float pos = _clamp(x, 0.0f, 1.0f) *
+		static_cast<float>(_FADE_CURVE_NUM_POINTS - 1);
+	unsigned int idx = static_cast<unsigned int>(pos);
+	if (idx >= _FADE_CURVE_NUM_POINTS - 1) {
+		return _fade_curve[_FADE_CURVE_NUM_POINTS - 1];
+	}
+
+	float frac = pos - static_cast<float>(idx);
+	return _fade_curve[idx] + (_fade_curve[idx + 1] - _fade_curve[idx]) *
+		frac;
+}
+
 float AudioEngine::_sigmoid_0_to_1(float x)
 {
 	x -= 0.5f;
 	return 0.5f + 1.5f * (x / (1.0f + abs(x)));
 }
 
+// Called at the beginning of every audio callback (i.e. when the messages are
+// handled) to turn the time spent during the previous callback into a DSP load
+void AudioEngine::_finish_callback_timing()
+{
+	unsigned int sample_rate = _sample_rate;
+	if (_timings.callback_num_frames > 0 && sample_rate > 0) {
+		double buffer_ns = static_cast<double>(
+			_timings.callback_num_frames) * 1e9 /
+			static_cast<double>(sample_rate);
+		ma_uint64 load_ppm = static_cast<ma_uint64>(
+			static_cast<double>(_timings.callback_ns) * 1e6 /
+			buffer_ns);
+
+		_timings.dsp_load.record(load_ppm);
+		_timings.last_dsp_load_ppm.store(load_ppm,
+			std::memory_order_relaxed);
+	}
+
+	_timings.callback_ns = 0;
+	_timings.callback_num_frames = 0;
+}
+
 void AudioEngine::_apply_next_bpm()
 {
 	_bpm = _next_bpm.load();
@@ -419,54 +720,24 @@ void AudioEngine::_recalc_beats_samples_conversion_factors()
 
 bool AudioEngine::_is_track_valid(unsigned int track_idx)
 {
-	return track_idx < WORLD_NUM_TRACKS;
+	return track_idx < _num_tracks;
 }
 
 bool AudioEngine::_is_playhead_valid(unsigned int playhead_idx)
 {
-	return playhead_idx < WORLD_NUM_PLAYHEADS;
+	return playhead_idx < _num_playheads;
 }
 
-void AudioEngine::_handle_receive_clips(AudioMsgReceiveClips &msg)
+unsigned int AudioEngine::_stream_idx(unsigned int playhead_idx,
+	unsigned int track_idx)
 {
-	if (_is_track_valid(msg.track)) {
-		if (_io) {
-			_io->delete_clips(_tracks[msg.track]);
-		} else {
-			if (_tracks[msg.track].clips) {
-				delete[] _tracks[msg.track].clips;
-				_tracks[msg.track].clips = nullptr;
-			}
-			_tracks[msg.track].num_clips = 0;
-		}
-
-		_tracks[msg.track] = msg.clips;
-	} else {
-		if (_io) {
-			_io->delete_clips(msg.clips);
-		} else {
-			if (msg.clips.clips) {
-				delete[] msg.clips.clips;
-			}
-		}
-	}
+	return playhead_idx * _num_tracks + track_idx;
 }
 
-void AudioEngine::_handle_receive_old_preloads(AudioMsgReceiveOldPreloads &msg)
+void AudioEngine::_handle_receive_clips(AudioMsgReceiveClips &msg)
 {
-	if (_io) {
-		_io->delete_old_preloads(msg.old_preloads);
-	} else {
-		if (msg.old_preloads.frames) {
-			for (unsigned int i = 0;
-				i < msg.old_preloads.num_preloads; ++i) {
-				if (msg.old_preloads.frames[i]) {
-					delete[] msg.old_preloads.frames[i];
-				}
-			}
-
-			delete[] msg.old_preloads.frames;
-		}
+	if (_is_track_valid(msg.track)) {
+		_tracks[msg.track] = msg.clips;
 	}
 }
 
@@ -488,17 +759,9 @@ void AudioEngine::_handle_receive_playhead_chunk(
 	AudioMsgReceivePlayheadChunk &msg)
 {
 	if (_is_playhead_valid(msg.playhead) && _is_track_valid(msg.track)) {
+		trace(_tracer, TraceEventType::CHUNK_RECEIVE, msg.playhead,
+			msg.track, static_cast<double>(msg.chunk->first_frame));
 		_playheads[msg.playhead].receive_chunk(msg.track, msg.chunk);
-	} else {
-		if (_io) {
-			_io->delete_playhead_chunk(msg.chunk);
-		} else {
-			if (msg.chunk->frames) {
-				delete[] msg.chunk->frames;
-			}
-
-			delete msg.chunk;
-		}
 	}
 }
 
@@ -508,6 +771,8 @@ void AudioEngine::_handle_jump_playhead(AudioMsgJumpPlayhead &msg)
 		AudioPlayhead &playhead = _playheads[msg.playhead];
 		AudioClipsArray &track = _tracks[msg.track];
 
+		trace(_tracer, TraceEventType::JUMP, msg.playhead, msg.track,
+			msg.beat);
 		playhead.jump(msg.beat);
 
 		if (track.is_clip_valid(msg.cur_clip_idx)) {
@@ -532,27 +797,23 @@ void AudioEngine::_update_cur_clip_idx(unsigned int playhead_idx,
 	unsigned int old_cur_clip_idx = playhead.get_cur_clip_idx(track_idx);
 
 	unsigned int cur_clip_idx = 0;
-	for (unsigned int i = old_cur_clip_idx; i < track.num_clips; ++i) {
-		if (track.clips[i].start <= playhead_beat) {
-			cur_clip_idx = i;
-		} else {
-			break;
-		}
+	unsigned int num_started = track.count_starts_at_or_before(
+		playhead_beat, old_cur_clip_idx);
+	if (num_started > 0) {
+		cur_clip_idx = old_cur_clip_idx + num_started - 1;
 	}
 
 	if (track.is_clip_valid(cur_clip_idx)) {
+		if (cur_clip_idx != old_cur_clip_idx) {
+			trace(_tracer, TraceEventType::CLIP_BOUNDARY,
+				playhead_idx, track_idx,
+				static_cast<double>(cur_clip_idx));
+		}
+
 		AudioClip &cur_clip = track.clips[cur_clip_idx];
 		playhead.set_cur_clip_idx(track_idx, cur_clip_idx);
 		playhead.set_cur_song_id(track_idx, cur_clip.song_id);
 	}
 }
 
-void AudioEngine::_fill_silence(float *dest, ma_uint64 first_frame,
-	ma_uint64 num_frames, ma_uint64 num_channels)
-{
-	ma_uint64 ofs = first_frame * num_channels;
-	for (ma_uint64 i = 0; i < num_frames * num_channels; ++i) {
-		dest[ofs + i] = 0.0f;
-	}
-}
 }
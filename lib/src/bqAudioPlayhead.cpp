@@ -2,51 +2,62 @@
 #include "bqIOEngine.h"
 
 namespace bq {
-AudioPlayhead::AudioPlayhead()
+AudioPlayhead::AudioPlayhead(unsigned int num_tracks)
 {
 	_beat = 0.0;
 
-	for (unsigned int i = 0; i < WORLD_NUM_TRACKS; ++i) {
-		_cache[i].cur_want_frame = 0;
+	_tracks.allocate(num_tracks);
+	_num_tracks = num_tracks;
 
-		_st[i] = nullptr;
-
-		_cur_clip_idx[i] = 0;
-		_cur_song_id[i] = 0;
-		_expect_first_frame[i] = 0;
-		_last_song_id[i] = 0;
-		_last_song_id_valid[i] = 0;
-		_can_request_emergency_chunk[i] = 0;
+	for (unsigned int i = 0; i < _num_tracks; ++i) {
+		_TrackSharedState &shared = _tracks[i].shared;
+		shared.cur_want_frame = 0;
+		shared.want_frame_ack = 0;
+		shared.num_chunks_released = 0;
+		shared.cur_clip_idx = 0;
+		shared.cur_song_id = 0;
 	}
 }
 
 AudioPlayhead::~AudioPlayhead()
 {
-	for (unsigned int i = 0; i < WORLD_NUM_TRACKS; ++i) {
+	for (unsigned int i = 0; i < _num_tracks; ++i) {
 		_pop_all_chunks(i);
 
-		soundtouch_destroyInstance(_st[i]);
-		_st[i] = nullptr;
-	}
+		soundtouch_destroyInstance(_tracks[i].audio.st);
+		_tracks[i].audio.st = nullptr;
 
-	delete[] _st_src;
+		delete[] _tracks[i].audio.st_src;
+		delete[] _tracks[i].audio.st_dest;
+	}
 }
 
 void AudioPlayhead::set_playback_config(ma_uint32 num_channels,
-	ma_uint32 sample_rate)
+	ma_uint32 sample_rate, const BufferSizes &sizes)
 {
 	_num_channels = num_channels;
 	_sample_rate = sample_rate;
-
-	if (_st_src) {
-		delete[] _st_src;
-	}
-
-	_st_src = new float[static_cast<ma_uint64>(_NUM_ST_SRC_FRAMES) *
-		num_channels];
-
-	for (unsigned int i = 0; i < WORLD_NUM_TRACKS; ++i) {
-		_setup_soundtouch(_st[i]);
+	_kernels.select(num_channels);
+
+	ma_uint64 st_num_samples = static_cast<ma_uint64>(
+		_NUM_ST_SRC_FRAMES) * num_channels;
+
+	for (unsigned int i = 0; i < _num_tracks; ++i) {
+		_TrackAudioState &audio = _tracks[i].audio;
+		delete[] audio.st_src;
+		delete[] audio.st_dest;
+		audio.st_src = new float[st_num_samples];
+		audio.st_dest = new float[st_num_samples];
+
+		_setup_soundtouch(audio.st, audio.st_src);
+		_tracks[i].audio.st_info.valid = false;
+
+		if (STREAMER_USE_RING_BUFFERS) {
+			_tracks[i].ring.allocate(num_channels,
+				sizes.ring_num_slots,
+				sizes.ring_slot_num_frames,
+				sizes.sample_storage);
+		}
 	}
 }
 
@@ -60,24 +71,44 @@ void AudioPlayhead::bind_library(Library *library)
 	_library = library;
 }
 
+void AudioPlayhead::set_offline(bool offline)
+{
+	_offline = offline;
+}
+
+void AudioPlayhead::bind_tracer(Tracer *tracer)
+{
+	_tracer = tracer;
+}
+
+void AudioPlayhead::set_playhead_idx(unsigned int playhead_idx)
+{
+	_playhead_idx = playhead_idx;
+}
+
 bool AudioPlayhead::pull_stretch(double master_bpm, unsigned int track_idx,
-	AudioClip &clip, double song_bpm, float *dest, ma_uint64 first_frame,
+	AudioClip &clip, double song_bpm, const RenderDest &dest,
+	ma_uint64 dest_first_frame, ma_uint64 first_frame,
 	ma_uint64 num_frames, ma_uint64 next_expected_first_frame)
 {
 	if (!_is_track_valid(track_idx)) {
 		return 0;
 	}
 
-	HANDLE st = _st[track_idx];
+	_TrackState &track = _tracks[track_idx];
+	HANDLE st = track.audio.st;
 
-	if (first_frame != _expect_first_frame[track_idx] ||
-		clip.song_id != _last_song_id[track_idx] ||
-		!_last_song_id_valid[track_idx]) {
+	if (first_frame != track.audio.expect_first_frame ||
+		clip.song_id != track.audio.last_song_id ||
+		!track.audio.last_song_id_valid) {
 		soundtouch_clear(st);
-		_cache[track_idx].cur_want_frame = first_frame;
+		track.shared.cur_want_frame = first_frame;
+		track.stats.num_soundtouch_resets.add(1);
+		trace(_tracer, TraceEventType::SOUNDTOUCH_CLEAR, _playhead_idx,
+			track_idx, static_cast<double>(first_frame));
 	}
 
-	_TrackStInfo &st_info = _st_info[track_idx];
+	_TrackStInfo &st_info = track.audio.st_info;
 	if (!st_info.valid || st_info.last_pitch != clip.pitch_shift) {
 		soundtouch_setPitchSemiTones(st, static_cast<float>(
 			clip.pitch_shift));
@@ -95,22 +126,40 @@ bool AudioPlayhead::pull_stretch(double master_bpm, unsigned int track_idx,
 	ma_uint64 total_num_received = 0;
 	while (total_num_received < num_frames) {
 		if (soundtouch_numSamples(st) == 0) {
-			all_pulls_successful = _pull(track_idx, clip, _st_src,
-				_NUM_ST_SRC_FRAMES) && all_pulls_successful;
-			soundtouch_putSamples(st, _st_src, _NUM_ST_SRC_FRAMES);
+			all_pulls_successful = _pull(track_idx, clip,
+				track.audio.st_src, _NUM_ST_SRC_FRAMES) &&
+				all_pulls_successful;
+			soundtouch_putSamples(st, track.audio.st_src,
+				_NUM_ST_SRC_FRAMES);
 		}
 
+		ma_uint64 cur_dest_first_frame = dest_first_frame +
+			total_num_received;
 		unsigned int max_num_receive = static_cast<unsigned int>(
 			num_frames - total_num_received);
-		float *cur_dest = dest + (total_num_received * _num_channels);
-		unsigned int cur_num_received = soundtouch_receiveSamples(st,
-			cur_dest, max_num_receive);
-		total_num_received += cur_num_received;
+		if (dest.channels) {
+			if (max_num_receive > _NUM_ST_SRC_FRAMES) {
+				max_num_receive = _NUM_ST_SRC_FRAMES;
+			}
+			unsigned int cur_num_received =
+				soundtouch_receiveSamples(st,
+				track.audio.st_dest, max_num_receive);
+			_kernels.store_frames(dest, cur_dest_first_frame,
+				track.audio.st_dest, cur_num_received);
+			total_num_received += cur_num_received;
+		} else {
+			float *cur_dest = dest.frames + (cur_dest_first_frame *
+				_num_channels);
+			unsigned int cur_num_received =
+				soundtouch_receiveSamples(st, cur_dest,
+				max_num_receive);
+			total_num_received += cur_num_received;
+		}
 	}
 
-	_expect_first_frame[track_idx] = next_expected_first_frame;
-	_last_song_id[track_idx] = clip.song_id;
-	_last_song_id_valid[track_idx] = true;
+	track.audio.expect_first_frame = next_expected_first_frame;
+	track.audio.last_song_id = clip.song_id;
+	track.audio.last_song_id_valid = true;
 
 	return all_pulls_successful;
 }
@@ -118,7 +167,8 @@ bool AudioPlayhead::pull_stretch(double master_bpm, unsigned int track_idx,
 void AudioPlayhead::receive_chunk(unsigned int track_idx, PlayheadChunk *chunk)
 {
 	if (_is_track_valid(track_idx)) {
-		_ChunksList &chunks = _cache[track_idx];
+		_TrackAudioState &track = _tracks[track_idx].audio;
+		_ChunksList &chunks = track.chunks;
 		if (chunks.tail) {
 			chunks.tail->next = chunk;
 			chunks.tail = chunk;
@@ -126,9 +176,26 @@ void AudioPlayhead::receive_chunk(unsigned int track_idx, PlayheadChunk *chunk)
 			chunks.head = chunk;
 			chunks.tail = chunk;
 		}
-		_can_request_emergency_chunk[track_idx] = true;
+		track.can_request_emergency_chunk = true;
+	}
+}
+
+ma_uint64 AudioPlayhead::get_num_chunks_released(unsigned int track_idx)
+{
+	if (_is_track_valid(track_idx)) {
+		return _tracks[track_idx].shared.num_chunks_released;
 	} else {
-		_delete_chunk(chunk);
+		return 0;
+	}
+}
+
+PlayheadRing *AudioPlayhead::get_ring(unsigned int track_idx)
+{
+	if (_is_track_valid(track_idx) &&
+		_tracks[track_idx].ring.is_allocated()) {
+		return &_tracks[track_idx].ring;
+	} else {
+		return nullptr;
 	}
 }
 
@@ -140,7 +207,7 @@ double AudioPlayhead::get_beat()
 ma_uint64 AudioPlayhead::get_cur_want_frame(unsigned int track_idx)
 {
 	if (_is_track_valid(track_idx)) {
-		return _cache[track_idx].cur_want_frame;
+		return _tracks[track_idx].shared.cur_want_frame;
 	} else {
 		return 0;
 	}
@@ -149,9 +216,10 @@ ma_uint64 AudioPlayhead::get_cur_want_frame(unsigned int track_idx)
 void AudioPlayhead::jump(double beat)
 {
 	if (beat != _beat) {
-		for (unsigned int i = 0; i < WORLD_NUM_TRACKS; ++i) {
+		for (unsigned int i = 0; i < _num_tracks; ++i) {
 			set_cannot_request_emergency_chunk(i);
 			_pop_all_chunks(i);
+			_tracks[i].ring.pop_all();
 		}
 		_beat = beat;
 	}
@@ -167,7 +235,7 @@ unsigned int AudioPlayhead::get_cur_clip_idx(unsigned int track_idx)
 	unsigned int cur_clip_idx = 0;
 
 	if (_is_track_valid(track_idx)) {
-		cur_clip_idx = _cur_clip_idx[track_idx];
+		cur_clip_idx = _tracks[track_idx].shared.cur_clip_idx;
 	}
 
 	return cur_clip_idx;
@@ -178,7 +246,7 @@ unsigned int AudioPlayhead::get_cur_song_id(unsigned int track_idx)
 	unsigned int cur_song_id = 0;
 
 	if (_is_track_valid(track_idx)) {
-		cur_song_id = _cur_song_id[track_idx];
+		cur_song_id = _tracks[track_idx].shared.cur_song_id;
 	}
 
 	return cur_song_id;
@@ -188,7 +256,7 @@ void AudioPlayhead::set_cur_clip_idx(unsigned int track_idx,
 	unsigned int cur_clip_idx)
 {
 	if (_is_track_valid(track_idx)) {
-		_cur_clip_idx[track_idx] = cur_clip_idx;
+		_tracks[track_idx].shared.cur_clip_idx = cur_clip_idx;
 	}
 }
 
@@ -196,27 +264,59 @@ void AudioPlayhead::set_cur_song_id(unsigned int track_idx,
 	unsigned int cur_song_id)
 {
 	if (_is_track_valid(track_idx)) {
-		_cur_song_id[track_idx] = cur_song_id;
+		_tracks[track_idx].shared.cur_song_id = cur_song_id;
 	}
 }
 
 void AudioPlayhead::set_cannot_request_emergency_chunk(unsigned int track_idx)
 {
 	if (_is_track_valid(track_idx)) {
-		_can_request_emergency_chunk[track_idx] = false;
+		_tracks[track_idx].audio.can_request_emergency_chunk = false;
 	}
 }
 
 bool AudioPlayhead::get_can_request_emergency_chunk(unsigned int track_idx)
 {
 	if (_is_track_valid(track_idx)) {
-		return _can_request_emergency_chunk[track_idx];
+		return _tracks[track_idx].audio.can_request_emergency_chunk;
 	} else {
 		return false;
 	}
 }
 
-void AudioPlayhead::_setup_soundtouch(HANDLE &st)
+ma_uint64 AudioPlayhead::get_want_frame_ack(unsigned int track_idx)
+{
+	if (_is_track_valid(track_idx)) {
+		return _tracks[track_idx].shared.want_frame_ack;
+	} else {
+		return 0;
+	}
+}
+
+void AudioPlayhead::set_want_frame_ack(unsigned int track_idx,
+	ma_uint64 request)
+{
+	if (_is_track_valid(track_idx)) {
+		_tracks[track_idx].shared.want_frame_ack = request;
+	}
+}
+
+void AudioPlayhead::get_stats(unsigned int track_idx, StreamStats &stats)
+{
+	if (_is_track_valid(track_idx)) {
+		const _TrackStats &track_stats = _tracks[track_idx].stats;
+		stats.num_frames_from_preload =
+			track_stats.num_frames_from_preload.get();
+		stats.num_frames_from_chunks =
+			track_stats.num_frames_from_chunks.get();
+		stats.num_frames_silence = track_stats.num_frames_silence.get();
+		stats.num_underruns = track_stats.num_underruns.get();
+		stats.num_soundtouch_resets =
+			track_stats.num_soundtouch_resets.get();
+	}
+}
+
+void AudioPlayhead::_setup_soundtouch(HANDLE &st, float *st_src)
 {
 	if (st) {
 		soundtouch_clear(st);
@@ -238,69 +338,67 @@ void AudioPlayhead::_setup_soundtouch(HANDLE &st)
 	soundtouch_setSampleRate(st, _sample_rate);
 
 	soundtouch_setTempo(st, 0.1f);
-	soundtouch_putSamples(st, _st_src, _NUM_ST_SRC_FRAMES);
+	soundtouch_putSamples(st, st_src, _NUM_ST_SRC_FRAMES);
 	soundtouch_clear(st);
 	soundtouch_setTempo(st, 1.0f);
-
-	_st_info->valid = false;
 }
 
 bool AudioPlayhead::_pull(unsigned int track_idx, AudioClip &clip, float *dest,
 	ma_uint64 num_frames)
 {
-	ma_uint64 initial_want_frame = _cache[track_idx].cur_want_frame;
-	ma_uint64 num_pulled = clip.pull_preload(dest, initial_want_frame,
-		num_frames);
+	_TrackState &track = _tracks[track_idx];
+	ma_uint64 initial_want_frame = track.shared.cur_want_frame;
+	ma_uint64 num_pulled = clip.pull_preload(_kernels, dest,
+		initial_want_frame, num_frames);
+	track.stats.num_frames_from_preload.add(num_pulled);
+	ma_uint64 num_pulled_from_preload = num_pulled;
+
+	if (track.ring.is_allocated()) {
+		PlayheadRing &ring = track.ring;
+		PlayheadChunk *slot = nullptr;
+		while (num_pulled < num_frames && (slot = ring.front())) {
+			if (_pull_chunk(*slot, clip.song_id, dest,
+				initial_want_frame, num_pulled, num_frames)) {
+				ring.pop();
+			}
 
-	_ChunksList &chunks = _cache[track_idx];
-	while (chunks.head && num_pulled < num_frames) {
-		PlayheadChunk *chunk = chunks.head;
-
-		ma_uint64 cur_first_frame = initial_want_frame + num_pulled;
-		ma_uint64 chunk_last_frame = chunk->first_frame +
-			chunk->num_frames;
-
-		if (chunk->song_id == clip.song_id &&
-			cur_first_frame >= chunk->first_frame &&
-			cur_first_frame < chunk_last_frame) {
-			ma_uint64 need_frames = num_frames - num_pulled;
-			ma_uint64 avail_frames = chunk_last_frame -
-				cur_first_frame;
-			ma_uint64 cur_src_first_frame = cur_first_frame -
-				chunk->first_frame;
-			ma_uint64 cur_dest_first_frame = num_pulled;
-
-			if (avail_frames <= need_frames) {
-				_copy_frames(dest, chunk->frames,
-					cur_dest_first_frame,
-					cur_src_first_frame, avail_frames,
-					chunk->num_channels);
-				num_pulled += avail_frames;
-
-				_pop_chunk(chunks);
-			} else {
-				_copy_frames(dest, chunk->frames,
-					cur_dest_first_frame,
-					cur_src_first_frame, need_frames,
-					chunk->num_channels);
-				num_pulled += need_frames;
+			// Reading from the ring plays the same role as
+			// receiving a chunk
+			track.audio.can_request_emergency_chunk = true;
+		}
+	} else {
+		_ChunksList &chunks = track.audio.chunks;
+		while (chunks.head && num_pulled < num_frames) {
+			if (_pull_chunk(*chunks.head, clip.song_id, dest,
+				initial_want_frame, num_pulled, num_frames)) {
+				_pop_chunk(track);
 			}
-		} else {
-			_pop_chunk(chunks);
 		}
 	}
 
-	_cache[track_idx].cur_want_frame = initial_want_frame + num_frames;
+	if (num_pulled < num_frames && _offline && _io) {
+		_pull_blocking(track_idx, clip, dest, initial_want_frame,
+			num_pulled, num_frames);
+	}
+
+	track.shared.cur_want_frame = initial_want_frame + num_frames;
+	track.stats.num_frames_from_chunks.add(num_pulled -
+		num_pulled_from_preload);
 
 	if (num_pulled < num_frames) {
+		track.stats.num_frames_silence.add(num_frames - num_pulled);
+		track.stats.num_underruns.add(1);
+		trace(_tracer, TraceEventType::UNDERRUN, _playhead_idx,
+			track_idx,
+			static_cast<double>(num_frames - num_pulled));
+
 		// Passing silence to SoundTouch when we don't have any data is
 		// necessary to keeping multiple tracks in sync (so that the
 		// latency between each SoundTouch instance is consistent even
 		// if some tracks' clips decoded more quickly than others).
 		// Thus, if we don't have enough samples to fill the whole
 		// buffer, we fill the remaining part with silence.
-		_fill_silence(dest, num_pulled, num_frames - num_pulled,
-			_num_channels);
+		_fill_silence(dest, num_pulled, num_frames - num_pulled);
 
 		return false;
 	}
@@ -308,73 +406,122 @@ bool AudioPlayhead::_pull(unsigned int track_idx, AudioClip &clip, float *dest,
 	return true;
 }
 
-void AudioPlayhead::_copy_frames(float *dest, float *src,
-	ma_uint64 dest_first_frame, ma_uint64 src_first_frame,
-	ma_uint64 num_frames, ma_uint64 num_channels)
+// Only used when rendering offline, i.e. when the IO thread's work is done on
+// the audio thread: rather than running out of data, decode exactly what's
+// missing right now
+void AudioPlayhead::_pull_blocking(unsigned int track_idx, AudioClip &clip,
+	float *dest, ma_uint64 want_frame, ma_uint64 &num_pulled,
+	ma_uint64 num_frames)
 {
-	for (ma_uint64 i = 0; i < num_frames; ++i) {
-		for (ma_uint64 j = 0; j < num_channels; ++j) {
-			ma_uint64 src_idx = (src_first_frame + i) * num_channels
-				+ j;
-			ma_uint64 dest_idx = (dest_first_frame + i) *
-				num_channels + j;
+	_TrackState &track = _tracks[track_idx];
+
+	while (num_pulled < num_frames) {
+		PlayheadChunk *chunk = _io->decode_blocking(_playhead_idx,
+			track_idx, clip, want_frame + num_pulled);
+		if (!chunk) {
+			// End of the song
+			break;
+		}
 
-			dest[dest_idx] = src[src_idx];
+		if (track.ring.is_allocated()) {
+			// The ring was empty, so the chunk is its front slot
+			if (_pull_chunk(*chunk, clip.song_id, dest,
+				want_frame, num_pulled, num_frames)) {
+				track.ring.pop();
+			}
+		} else {
+			receive_chunk(track_idx, chunk);
+			if (_pull_chunk(*chunk, clip.song_id, dest,
+				want_frame, num_pulled, num_frames)) {
+				_pop_chunk(track);
+			}
 		}
 	}
 }
 
-void AudioPlayhead::_fill_silence(float *dest, ma_uint64 first_frame,
-	ma_uint64 num_frames, ma_uint64 num_channels)
+// Copies as many of the wanted frames as possible from the chunk, and returns
+// true if the chunk has nothing more to offer (it's been used up or doesn't
+// contain the wanted frames) and should be discarded
+bool AudioPlayhead::_pull_chunk(PlayheadChunk &chunk, unsigned int song_id,
+	float *dest, ma_uint64 want_frame, ma_uint64 &num_pulled,
+	ma_uint64 num_frames)
 {
-	ma_uint64 ofs = first_frame * num_channels;
-	for (ma_uint64 i = 0; i < num_frames * num_channels; ++i) {
-		dest[ofs + i] = 0.0f;
+	ma_uint64 cur_first_frame = want_frame + num_pulled;
+	ma_uint64 chunk_last_frame = chunk.first_frame + chunk.num_frames;
+
+	if (chunk.song_id != song_id || cur_first_frame < chunk.first_frame ||
+		cur_first_frame >= chunk_last_frame) {
+		return true;
 	}
-}
 
-void AudioPlayhead::_delete_chunk(PlayheadChunk *chunk)
-{
-	if (_io) {
-		_io->delete_playhead_chunk(chunk);
+	ma_uint64 need_frames = num_frames - num_pulled;
+	ma_uint64 avail_frames = chunk_last_frame - cur_first_frame;
+	ma_uint64 cur_src_first_frame = cur_first_frame - chunk.first_frame;
+	ma_uint64 cur_dest_first_frame = num_pulled;
+
+	if (avail_frames <= need_frames) {
+		_copy_frames(dest, chunk, cur_dest_first_frame,
+			cur_src_first_frame, avail_frames);
+		num_pulled += avail_frames;
+
+		return true;
 	} else {
-		if (chunk) {
-			if (chunk->frames) {
-				delete[] chunk->frames;
-			}
+		_copy_frames(dest, chunk, cur_dest_first_frame,
+			cur_src_first_frame, need_frames);
+		num_pulled += need_frames;
 
-			delete chunk;
-		}
+		return false;
 	}
 }
 
-void AudioPlayhead::_pop_chunk(_ChunksList &chunks)
+// Converts the chunk's frames to float and maps its channels onto the output's
+// (see RenderKernels::load_frames()) in the same pass
+void AudioPlayhead::_copy_frames(float *dest, const PlayheadChunk &chunk,
+	ma_uint64 dest_first_frame, ma_uint64 src_first_frame,
+	ma_uint64 num_frames)
 {
+	_kernels.load_frames(dest + dest_first_frame * _num_channels,
+		sample_at(chunk.frames, chunk.storage, src_first_frame *
+		chunk.num_channels), chunk.storage, chunk.num_channels,
+		num_frames);
+}
+
+void AudioPlayhead::_fill_silence(float *dest, ma_uint64 first_frame,
+	ma_uint64 num_frames)
+{
+	_kernels.fill_silence(dest + first_frame * _num_channels, num_frames);
+}
+
+// Popped chunks are freed by the IOEngine once it sees they were released
+void AudioPlayhead::_pop_chunk(_TrackState &track)
+{
+	_ChunksList &chunks = track.audio.chunks;
+
 	if (chunks.head) {
 		if (chunks.head == chunks.tail) {
-			_delete_chunk(chunks.head);
 			chunks.head = nullptr;
 			chunks.tail = nullptr;
 		} else {
-			PlayheadChunk *old_chunk = chunks.head;
 			chunks.head = chunks.head->next;
-			_delete_chunk(old_chunk);
 		}
+
+		std::atomic<ma_uint64> &num_released =
+			track.shared.num_chunks_released;
+		num_released.store(num_released.load(std::memory_order_relaxed)
+			+ 1, std::memory_order_release);
 	}
 }
 
 void AudioPlayhead::_pop_all_chunks(unsigned int track_idx)
 {
-	_ChunksList &chunks = _cache[track_idx];
-	while (chunks.head) {
-		_pop_chunk(chunks);
+	_TrackState &track = _tracks[track_idx];
+	while (track.audio.chunks.head) {
+		_pop_chunk(track);
 	}
-	chunks.head = nullptr;
-	chunks.tail = nullptr;
 }
 
 bool AudioPlayhead::_is_track_valid(unsigned int track_idx)
 {
-	return track_idx < WORLD_NUM_TRACKS;
+	return track_idx < _num_tracks;
 }
 }
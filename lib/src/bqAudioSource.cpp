@@ -0,0 +1,310 @@
+#include "bqAudioSource.h"
+
+#include <cstring>
+
+namespace bq {
+// Reads through a miniaudio decoder, and if the decoder reads raw PCM from a
+// file, owns that file too
+class MiniaudioReader : public AudioSourceReader {
+public:
+	MiniaudioReader() {}
+	~MiniaudioReader() override
+	{
+		if (ready) {
+			ma_decoder_uninit(&decoder);
+		}
+		if (file) {
+			std::fclose(file);
+		}
+	}
+
+	bool seek(ma_uint64 frame) override
+	{
+		return ma_decoder_seek_to_pcm_frame(&decoder, frame) ==
+			MA_SUCCESS;
+	}
+
+	ma_uint64 read(float *frames, ma_uint64 num_frames) override
+	{
+		return ma_decoder_read_pcm_frames(&decoder, frames, num_frames);
+	}
+
+	ma_uint64 get_length() override
+	{
+		return ma_decoder_get_length_in_pcm_frames(&decoder);
+	}
+
+	ma_decoder decoder;
+	bool ready = false;
+
+	std::FILE *file = nullptr;
+	ma_uint64 first_byte = 0;
+};
+
+static size_t read_raw_file(ma_decoder *decoder, void *out, size_t num_bytes)
+{
+	MiniaudioReader *reader = static_cast<MiniaudioReader *>(
+		decoder->pUserData);
+	return std::fread(out, 1, num_bytes, reader->file);
+}
+
+static ma_bool32 seek_raw_file(ma_decoder *decoder, int byte_offset,
+	ma_seek_origin origin)
+{
+	MiniaudioReader *reader = static_cast<MiniaudioReader *>(
+		decoder->pUserData);
+
+	int result = 0;
+	if (origin == ma_seek_origin_start) {
+		result = std::fseek(reader->file, static_cast<long>(
+			reader->first_byte + byte_offset), SEEK_SET);
+	} else {
+		result = std::fseek(reader->file, byte_offset, SEEK_CUR);
+	}
+
+	return result == 0 ? MA_TRUE : MA_FALSE;
+}
+
+MiniaudioFileSource::MiniaudioFileSource(const std::string &filename)
+{
+	_filename = filename;
+}
+
+std::unique_ptr<AudioSourceReader> MiniaudioFileSource::open(
+	ma_uint32 num_channels, ma_uint32 sample_rate) const
+{
+	std::unique_ptr<MiniaudioReader> reader(new MiniaudioReader);
+
+	ma_decoder_config decoder_cfg = ma_decoder_config_init(ma_format_f32,
+		num_channels, sample_rate);
+	reader->ready = ma_decoder_init_file(_filename.c_str(), &decoder_cfg,
+		&reader->decoder) == MA_SUCCESS;
+	if (!reader->ready) {
+		return nullptr;
+	}
+
+	return reader;
+}
+
+bool MiniaudioFileSource::get_native_format(ma_uint32 &num_channels,
+	ma_uint32 &sample_rate) const
+{
+	// Channel count and sample rate 0 mean the file's own
+	std::unique_ptr<AudioSourceReader> reader = open(0, 0);
+	if (!reader) {
+		return false;
+	}
+
+	const ma_decoder &decoder =
+		static_cast<MiniaudioReader &>(*reader).decoder;
+	num_channels = decoder.outputChannels;
+	sample_rate = decoder.outputSampleRate;
+
+	return true;
+}
+
+AudioSourceCost MiniaudioFileSource::get_cost_hint() const
+{
+	return AudioSourceCost::DECODE;
+}
+
+const std::string &MiniaudioFileSource::get_filename() const
+{
+	return _filename;
+}
+
+MiniaudioMemorySource::MiniaudioMemorySource(const void *data,
+	size_t num_bytes, std::shared_ptr<const void> owner)
+{
+	_data = data;
+	_num_bytes = num_bytes;
+	_owner = owner;
+}
+
+std::unique_ptr<AudioSourceReader> MiniaudioMemorySource::open(
+	ma_uint32 num_channels, ma_uint32 sample_rate) const
+{
+	std::unique_ptr<MiniaudioReader> reader(new MiniaudioReader);
+
+	ma_decoder_config decoder_cfg = ma_decoder_config_init(ma_format_f32,
+		num_channels, sample_rate);
+	reader->ready = ma_decoder_init_memory(_data, _num_bytes, &decoder_cfg,
+		&reader->decoder) == MA_SUCCESS;
+	if (!reader->ready) {
+		return nullptr;
+	}
+
+	return reader;
+}
+
+bool MiniaudioMemorySource::get_native_format(ma_uint32 &num_channels,
+	ma_uint32 &sample_rate) const
+{
+	std::unique_ptr<AudioSourceReader> reader = open(0, 0);
+	if (!reader) {
+		return false;
+	}
+
+	const ma_decoder &decoder =
+		static_cast<MiniaudioReader &>(*reader).decoder;
+	num_channels = decoder.outputChannels;
+	sample_rate = decoder.outputSampleRate;
+
+	return true;
+}
+
+AudioSourceCost MiniaudioMemorySource::get_cost_hint() const
+{
+	return AudioSourceCost::DECODE;
+}
+
+PcmMemorySource::PcmMemorySource(const float *frames, ma_uint64 num_frames,
+	ma_uint32 num_channels, ma_uint32 sample_rate,
+	std::shared_ptr<const void> owner)
+{
+	_frames = frames;
+	_num_frames = num_frames;
+	_num_channels = num_channels;
+	_sample_rate = sample_rate;
+	_owner = owner;
+}
+
+std::unique_ptr<AudioSourceReader> PcmMemorySource::open(
+	ma_uint32 num_channels, ma_uint32 sample_rate) const
+{
+	if (num_channels == _num_channels && sample_rate == _sample_rate) {
+		return std::unique_ptr<AudioSourceReader>(new PcmMemoryReader(
+			_frames, _num_frames, _num_channels, _owner));
+	}
+
+	// Anything else is converted by a decoder reading the frames as raw
+	// PCM
+	std::unique_ptr<MiniaudioReader> reader(new MiniaudioReader);
+
+	ma_decoder_config in_cfg = ma_decoder_config_init(ma_format_f32,
+		_num_channels, _sample_rate);
+	ma_decoder_config out_cfg = ma_decoder_config_init(ma_format_f32,
+		num_channels, sample_rate);
+	reader->ready = ma_decoder_init_memory_raw(_frames, _num_frames *
+		_num_channels * sizeof(float), &in_cfg, &out_cfg,
+		&reader->decoder) == MA_SUCCESS;
+	if (!reader->ready) {
+		return nullptr;
+	}
+
+	return reader;
+}
+
+bool PcmMemorySource::get_native_format(ma_uint32 &num_channels,
+	ma_uint32 &sample_rate) const
+{
+	num_channels = _num_channels;
+	sample_rate = _sample_rate;
+	return true;
+}
+
+AudioSourceCost PcmMemorySource::get_cost_hint() const
+{
+	return AudioSourceCost::MEMORY;
+}
+
+const float *PcmMemorySource::get_frames(ma_uint32 num_channels,
+	ma_uint32 sample_rate, ma_uint64 &num_frames) const
+{
+	if (num_channels != _num_channels || sample_rate != _sample_rate) {
+		num_frames = 0;
+		return nullptr;
+	}
+
+	num_frames = _num_frames;
+	return _frames;
+}
+
+RawPcmFileSource::RawPcmFileSource(const std::string &filename,
+	ma_format format, ma_uint32 num_channels, ma_uint32 sample_rate,
+	ma_uint64 first_byte)
+{
+	_filename = filename;
+	_format = format;
+	_num_channels = num_channels;
+	_sample_rate = sample_rate;
+	_first_byte = first_byte;
+}
+
+std::unique_ptr<AudioSourceReader> RawPcmFileSource::open(
+	ma_uint32 num_channels, ma_uint32 sample_rate) const
+{
+	std::unique_ptr<MiniaudioReader> reader(new MiniaudioReader);
+
+	reader->file = std::fopen(_filename.c_str(), "rb");
+	if (!reader->file || std::fseek(reader->file, static_cast<long>(
+		_first_byte), SEEK_SET) != 0) {
+		return nullptr;
+	}
+	reader->first_byte = _first_byte;
+
+	ma_decoder_config in_cfg = ma_decoder_config_init(_format,
+		_num_channels, _sample_rate);
+	ma_decoder_config out_cfg = ma_decoder_config_init(ma_format_f32,
+		num_channels, sample_rate);
+	reader->ready = ma_decoder_init_raw(read_raw_file, seek_raw_file,
+		reader.get(), &in_cfg, &out_cfg, &reader->decoder) ==
+		MA_SUCCESS;
+	if (!reader->ready) {
+		return nullptr;
+	}
+
+	return reader;
+}
+
+bool RawPcmFileSource::get_native_format(ma_uint32 &num_channels,
+	ma_uint32 &sample_rate) const
+{
+	num_channels = _num_channels;
+	sample_rate = _sample_rate;
+	return true;
+}
+
+AudioSourceCost RawPcmFileSource::get_cost_hint() const
+{
+	return AudioSourceCost::RAW_FILE;
+}
+
+PcmMemoryReader::PcmMemoryReader(const float *frames, ma_uint64 num_frames,
+	ma_uint32 num_channels, std::shared_ptr<const void> owner)
+{
+	_frames = frames;
+	_num_frames = num_frames;
+	_num_channels = num_channels;
+	_owner = owner;
+}
+
+bool PcmMemoryReader::seek(ma_uint64 frame)
+{
+	if (frame > _num_frames) {
+		return false;
+	}
+
+	_cur_frame = frame;
+	return true;
+}
+
+ma_uint64 PcmMemoryReader::read(float *frames, ma_uint64 num_frames)
+{
+	ma_uint64 num_left = _num_frames - _cur_frame;
+	if (num_frames > num_left) {
+		num_frames = num_left;
+	}
+
+	std::memcpy(frames, _frames + _cur_frame * _num_channels, num_frames *
+		_num_channels * sizeof(float));
+	_cur_frame += num_frames;
+
+	return num_frames;
+}
+
+ma_uint64 PcmMemoryReader::get_length()
+{
+	return _num_frames;
+}
+}
@@ -0,0 +1,230 @@
+#include "bqBatchRenderer.h"
+
+namespace bq {
+BatchRenderer::BatchRenderer(Library *library, ma_uint32 num_channels,
+	ma_uint32 sample_rate, const BatchRendererConfig &config)
+{
+	_library = library;
+	_num_channels = num_channels;
+	_sample_rate = sample_rate;
+	_world_config = config.world_config;
+	_default_job_num_bytes = default_job_num_bytes(_world_config,
+		num_channels, sample_rate);
+	_max_num_job_bytes = config.max_num_job_bytes;
+
+	if (_library && config.max_num_cache_bytes > 0) {
+		_cache.reset(new DecodedSongCache(config.max_num_cache_bytes));
+		_library->bind_decoded_song_cache(_cache.get());
+	}
+
+	unsigned int num_threads = config.num_threads;
+	if (num_threads < 1) {
+		num_threads = std::thread::hardware_concurrency();
+	}
+	if (num_threads < 1) {
+		num_threads = 1;
+	}
+
+	for (unsigned int i = 0; i < num_threads; ++i) {
+		_workers.emplace_back(new _Worker);
+	}
+	// Only start the threads once every worker exists, since they steal
+	// from each other
+	for (unsigned int i = 0; i < num_threads; ++i) {
+		_workers[i]->thread = std::thread(&BatchRenderer::_work, this,
+			i);
+	}
+}
+
+BatchRenderer::~BatchRenderer()
+{
+	wait();
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_jobs_available.notify_all();
+
+	for (auto &worker : _workers) {
+		worker->thread.join();
+	}
+
+	if (_cache) {
+		_library->bind_decoded_song_cache(nullptr);
+	}
+}
+
+unsigned int BatchRenderer::submit(const BatchRenderJob &job,
+	const DoneCallback &on_done)
+{
+	_Job queued;
+	queued.job = job;
+	queued.on_done = on_done;
+
+	// Spread the jobs over the workers' queues; whatever imbalance is left
+	// is evened out by stealing
+	unsigned int worker_idx = _next_worker_idx.fetch_add(1) %
+		static_cast<unsigned int>(_workers.size());
+	unsigned int id;
+	{
+		// Counted in the same critical section that queues it, so that
+		// a worker can't take the job (and uncount it) before it's
+		// counted
+		std::lock_guard<std::mutex> lock(_mutex);
+		id = queued.id = _next_job_id++;
+		++_num_pending;
+
+		_Worker &worker = *_workers[worker_idx];
+		std::lock_guard<std::mutex> worker_lock(worker.mutex);
+		worker.jobs.push_back(std::move(queued));
+		++_num_queued;
+	}
+	_jobs_available.notify_one();
+
+	return id;
+}
+
+void BatchRenderer::wait()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_jobs_done.wait(lock, [this] { return _num_pending == 0; });
+}
+
+unsigned int BatchRenderer::get_num_threads()
+{
+	return static_cast<unsigned int>(_workers.size());
+}
+
+DecodedSongCache *BatchRenderer::get_decoded_song_cache()
+{
+	return _cache.get();
+}
+
+ma_uint64 BatchRenderer::default_job_num_bytes(const WorldConfig &config,
+	ma_uint32 num_channels, ma_uint32 sample_rate)
+{
+	BufferSizes sizes = config.resolve(sample_rate);
+
+	ma_uint64 stream_num_bytes = STREAMER_USE_RING_BUFFERS ?
+		sizes.ring_num_bytes(num_channels) :
+		3 * sizes.chunk_num_bytes(num_channels);
+
+	return static_cast<ma_uint64>(config.num_playheads) *
+		config.num_tracks * stream_num_bytes +
+		static_cast<ma_uint64>(config.num_tracks) * 4 *
+		sizes.preload_num_bytes(num_channels);
+}
+
+void BatchRenderer::_work(unsigned int worker_idx)
+{
+	while (true) {
+		_Job job;
+		if (!_take_job(worker_idx, job)) {
+			std::unique_lock<std::mutex> lock(_mutex);
+			_jobs_available.wait(lock, [this] {
+				return _num_queued > 0 || _quit;
+			});
+			if (_quit && _num_queued == 0) {
+				return;
+			}
+			continue;
+		}
+
+		ma_uint64 num_bytes = job.job.num_bytes;
+		if (num_bytes < 1) {
+			num_bytes = _default_job_num_bytes;
+		}
+
+		_admit(num_bytes);
+		bool succeeded = _run_job(job.job);
+		_release(num_bytes);
+
+		if (job.on_done) {
+			job.on_done(job.id, succeeded);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			--_num_pending;
+		}
+		_jobs_done.notify_all();
+	}
+}
+
+// Takes the newest job from the worker's own queue, or failing that, the
+// oldest job from another worker's queue
+bool BatchRenderer::_take_job(unsigned int worker_idx, _Job &job)
+{
+	unsigned int num_workers = static_cast<unsigned int>(_workers.size());
+	bool found = false;
+
+	for (unsigned int i = 0; i < num_workers && !found; ++i) {
+		_Worker &worker = *_workers[(worker_idx + i) % num_workers];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		if (worker.jobs.empty()) {
+			continue;
+		}
+
+		if (i == 0) {
+			job = std::move(worker.jobs.back());
+			worker.jobs.pop_back();
+		} else {
+			job = std::move(worker.jobs.front());
+			worker.jobs.pop_front();
+		}
+		found = true;
+	}
+
+	if (found) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		--_num_queued;
+	}
+
+	return found;
+}
+
+bool BatchRenderer::_run_job(const BatchRenderJob &job)
+{
+	World world(_num_channels, _sample_rate, _library, _world_config);
+	if (job.setup) {
+		job.setup(world);
+	}
+
+	OfflineRenderer renderer(&world);
+	if (!job.filename.empty()) {
+		return renderer.render_mix(job.playhead_idx, job.from_beat,
+			job.to_beat, job.filename, job.filename_format);
+	}
+	if (job.on_block) {
+		return renderer.render(job.playhead_idx, job.from_beat,
+			job.to_beat, job.on_block);
+	}
+
+	return false;
+}
+
+// Blocks until the job fits in the memory budget. A job is always admitted
+// when nothing else is running, so that an oversized job can't wait forever.
+void BatchRenderer::_admit(ma_uint64 num_bytes)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_memory_available.wait(lock, [this, num_bytes] {
+		return _num_running == 0 ||
+			_num_running_bytes + num_bytes <= _max_num_job_bytes;
+	});
+
+	_num_running_bytes += num_bytes;
+	++_num_running;
+}
+
+void BatchRenderer::_release(ma_uint64 num_bytes)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_num_running_bytes -= num_bytes;
+		--_num_running;
+	}
+	_memory_available.notify_all();
+}
+}
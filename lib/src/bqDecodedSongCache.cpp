@@ -0,0 +1,191 @@
+#include "bqDecodedSongCache.h"
+
+namespace bq {
+DecodedSongCache::DecodedSongCache(ma_uint64 max_num_bytes)
+{
+	_max_num_bytes = max_num_bytes;
+}
+
+std::shared_ptr<const DecodedSong> DecodedSongCache::get(
+	const AudioSource &source, unsigned int song_id,
+	ma_uint32 num_channels, ma_uint32 sample_rate)
+{
+	_Key key(song_id, num_channels, sample_rate);
+
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	_Entry &entry = _entries[key];
+	while (entry.decoding) {
+		_decode_done.wait(lock);
+	}
+
+	if (entry.failed) {
+		return nullptr;
+	}
+
+	if (entry.song) {
+		entry.last_use = ++_use_clock;
+		return entry.song;
+	}
+
+	// Decoding it again would only throw it away again
+	if (entry.no_room_num_bytes > 0 &&
+		!_can_make_room(entry.no_room_num_bytes)) {
+		return nullptr;
+	}
+
+	// Decode without holding the lock, so other songs can be looked up (or
+	// decoded) in the meantime
+	entry.decoding = true;
+	ma_uint64 max_song_num_bytes = _max_num_bytes;
+	lock.unlock();
+
+	std::shared_ptr<DecodedSong> song = _decode(source, num_channels,
+		sample_rate, max_song_num_bytes);
+
+	lock.lock();
+
+	// std::map never moves its entries, so the reference is still valid
+	entry.decoding = false;
+	if (song) {
+		ma_uint64 num_bytes = song->frames.size() * sizeof(float);
+		if (_make_room(num_bytes)) {
+			entry.song = song;
+			entry.num_bytes = num_bytes;
+			entry.last_use = ++_use_clock;
+			entry.no_room_num_bytes = 0;
+			_num_bytes += num_bytes;
+		} else {
+			entry.no_room_num_bytes = num_bytes;
+		}
+	} else {
+		entry.failed = true;
+	}
+
+	_decode_done.notify_all();
+
+	return entry.song;
+}
+
+ma_uint64 DecodedSongCache::get_num_bytes()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _num_bytes;
+}
+
+ma_uint64 DecodedSongCache::get_max_num_bytes()
+{
+	return _max_num_bytes;
+}
+
+// Returns nullptr if the song can't be decoded or has more than max_num_bytes
+// of frames
+std::shared_ptr<DecodedSong> DecodedSongCache::_decode(
+	const AudioSource &source, ma_uint32 num_channels,
+	ma_uint32 sample_rate, ma_uint64 max_num_bytes)
+{
+	std::unique_ptr<AudioSourceReader> reader = source.open(num_channels,
+		sample_rate);
+	if (!reader) {
+		return nullptr;
+	}
+
+	std::shared_ptr<DecodedSong> song = std::make_shared<DecodedSong>();
+	song->num_channels = num_channels;
+	song->sample_rate = sample_rate;
+
+	ma_uint64 max_num_frames = max_num_bytes / (num_channels *
+		sizeof(float));
+
+	// The length isn't known up front for every format, so this is only a
+	// hint
+	ma_uint64 length_hint = reader->get_length();
+	if (length_hint > 0 && length_hint <= max_num_frames) {
+		song->frames.reserve(length_hint * num_channels);
+	}
+
+	// Reads at most one frame past max_num_frames, which is enough to
+	// tell that the song is too big without reading much more of it
+	const ma_uint64 READ_NUM_FRAMES = 65536;
+	while (true) {
+		ma_uint64 num_frames = song->num_frames;
+		ma_uint64 num_wanted = max_num_frames - num_frames + 1;
+		if (num_wanted > READ_NUM_FRAMES) {
+			num_wanted = READ_NUM_FRAMES;
+		}
+
+		song->frames.resize((num_frames + num_wanted) * num_channels);
+		ma_uint64 num_read = reader->read(song->frames.data() +
+			num_frames * num_channels, num_wanted);
+		song->num_frames += num_read;
+
+		if (song->num_frames > max_num_frames) {
+			return nullptr;
+		}
+
+		if (num_read < num_wanted) {
+			break;
+		}
+	}
+
+	if (song->num_frames < 1) {
+		return nullptr;
+	}
+
+	song->frames.resize(song->num_frames * num_channels);
+	song->frames.shrink_to_fit();
+
+	return song;
+}
+
+// Whether evicting every song nobody else is using would leave room for
+// num_bytes more. Must be called with the lock held.
+bool DecodedSongCache::_can_make_room(ma_uint64 num_bytes)
+{
+	if (num_bytes > _max_num_bytes) {
+		return false;
+	}
+
+	ma_uint64 num_free_bytes = _max_num_bytes - _num_bytes;
+	for (const auto &it : _entries) {
+		const _Entry &candidate = it.second;
+		if (candidate.song && candidate.song.use_count() == 1) {
+			num_free_bytes += candidate.num_bytes;
+		}
+	}
+
+	return num_free_bytes >= num_bytes;
+}
+
+// Evicts songs nobody else is using, least recently used first, until there's
+// room for num_bytes more. Evicts nothing if that can't make enough room. Must
+// be called with the lock held.
+bool DecodedSongCache::_make_room(ma_uint64 num_bytes)
+{
+	if (!_can_make_room(num_bytes)) {
+		return false;
+	}
+
+	while (_num_bytes + num_bytes > _max_num_bytes) {
+		auto lru = _entries.end();
+		for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+			const _Entry &candidate = it->second;
+			if (candidate.song && candidate.song.use_count() == 1 &&
+				(lru == _entries.end() || candidate.last_use <
+				lru->second.last_use)) {
+				lru = it;
+			}
+		}
+
+		if (lru == _entries.end()) {
+			return false;
+		}
+
+		_num_bytes -= lru->second.num_bytes;
+		lru->second.song.reset();
+		lru->second.num_bytes = 0;
+	}
+
+	return true;
+}
+}
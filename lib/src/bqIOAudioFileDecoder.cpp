@@ -7,10 +7,13 @@ IOAudioFileDecoder::~IOAudioFileDecoder()
 }
 
 void IOAudioFileDecoder::set_decode_config(ma_uint32 num_channels,
-	ma_uint32 sample_rate)
+	ma_uint32 sample_rate, const BufferSizes &sizes)
 {
 	_num_channels = num_channels;
 	_sample_rate = sample_rate;
+	_chunk_num_frames = sizes.chunk_num_frames;
+	_send_frame_window = sizes.next_chunk_window_num_frames;
+	_storage = sizes.sample_storage;
 }
 
 void IOAudioFileDecoder::bind_library(Library *library)
@@ -18,6 +21,14 @@ void IOAudioFileDecoder::bind_library(Library *library)
 	_library = library;
 }
 
+void IOAudioFileDecoder::bind_tracer(Tracer *tracer, unsigned int playhead_idx,
+	unsigned int track_idx)
+{
+	_tracer = tracer;
+	_playhead_idx = playhead_idx;
+	_track_idx = track_idx;
+}
+
 void IOAudioFileDecoder::set_clip_idx(unsigned int clip_idx)
 {
 	if (!_last_clip_idx_valid || clip_idx != _last_clip_idx) {
@@ -42,10 +53,87 @@ void IOAudioFileDecoder::set_song_id(unsigned int song_id)
 
 PlayheadChunk *IOAudioFileDecoder::decode(ma_uint64 from_frame)
 {
-	if (!_decoder_ready || _end_of_song) {
+	ma_uint64 actual_from_frame = 0;
+	if (!_prepare_decode(from_frame, _chunk_num_frames,
+		actual_from_frame)) {
 		return nullptr;
 	}
 
+	PlayheadChunk *chunk = new PlayheadChunk;
+	chunk->next = nullptr;
+	chunk->owns_frames = _borrow_frames == nullptr;
+	chunk->frames = nullptr;
+	chunk->storage = SampleStorage::F32;
+	if (chunk->owns_frames) {
+		chunk->storage = _storage;
+		chunk->frames = allocate_samples(chunk->storage,
+			_chunk_num_frames * _song_num_channels);
+	}
+
+	if (!_decode_chunk(*chunk, from_frame, actual_from_frame,
+		_chunk_num_frames)) {
+		if (chunk->owns_frames) {
+			free_samples(chunk->frames);
+		}
+		delete chunk;
+		return nullptr;
+	}
+
+	return chunk;
+}
+
+bool IOAudioFileDecoder::decode_into(PlayheadRing &ring, ma_uint64 from_frame)
+{
+	PlayheadChunk *slot = ring.begin_write();
+	if (!slot) {
+		return false;
+	}
+
+	ma_uint64 actual_from_frame = 0;
+	if (!_prepare_decode(from_frame, ring.slot_num_frames(),
+		actual_from_frame)) {
+		return false;
+	}
+
+	if (!_decode_chunk(*slot, from_frame, actual_from_frame,
+		ring.slot_num_frames())) {
+		return false;
+	}
+
+	ring.end_write();
+
+	return true;
+}
+
+void IOAudioFileDecoder::invalidate_last_clip_idx()
+{
+	_last_clip_idx_valid = false;
+}
+
+void IOAudioFileDecoder::reset_next_send_frame()
+{
+	_next_send_frame = 0;
+	_next_send_frame_valid = false;
+
+	_end_of_song = false;
+}
+
+void IOAudioFileDecoder::get_stats(StreamStats &stats)
+{
+	stats.num_decode_calls = _num_decode_calls.get();
+	stats.num_decoded_bytes = _num_decoded_bytes.get();
+}
+
+// Determines whether the next chunk needs to be decoded yet given the frame
+// the AudioEngine currently wants, and if so, seeks to the first frame of that
+// chunk
+bool IOAudioFileDecoder::_prepare_decode(ma_uint64 from_frame,
+	ma_uint64 chunk_num_frames, ma_uint64 &actual_from_frame)
+{
+	if (!_decoder_ready || _end_of_song) {
+		return false;
+	}
+
 	if (from_frame < _last_from_frame) {
 		reset_next_send_frame();
 	}
@@ -53,7 +141,7 @@ PlayheadChunk *IOAudioFileDecoder::decode(ma_uint64 from_frame)
 	// If we skipped chunks (e.g. clip's sample offset was adjusted), reset
 	// the next send frame to from_frame rather than decoding everything in
 	// between (because those chunks won't be used)...
-	if (from_frame > _next_send_frame + _CHUNK_NUM_FRAMES) {
+	if (from_frame > _next_send_frame + chunk_num_frames) {
 		reset_next_send_frame();
 	}
 
@@ -61,96 +149,149 @@ PlayheadChunk *IOAudioFileDecoder::decode(ma_uint64 from_frame)
 	// This if statement is necessary because these are *unsigned* ints - we
 	// wouldn't want them to wrap around to a huge number if we subtracted
 	// a larger number from a smaller number
-	if (needs_chunk_threshold > _SEND_FRAME_WINDOW) {
-		needs_chunk_threshold -= _SEND_FRAME_WINDOW;
+	if (needs_chunk_threshold > _send_frame_window) {
+		needs_chunk_threshold -= _send_frame_window;
 	} else {
 		needs_chunk_threshold = 0;
 	}
 
 	if (from_frame < needs_chunk_threshold) {
-		return nullptr;
+		return false;
 	}
 
-	ma_uint64 actual_from_frame = _next_send_frame;
+	actual_from_frame = _next_send_frame;
 	if (!_next_send_frame_valid) {
 		actual_from_frame = from_frame;
 		_next_send_frame_valid = true;
 	}
 
 	if (_decoder_cur_frame != actual_from_frame) {
-		if (ma_decoder_seek_to_pcm_frame(&_decoder, actual_from_frame)
-			!= MA_SUCCESS) {
+		if (!_seek(actual_from_frame)) {
 			_end_of_song = true;
-			return nullptr;
+			return false;
 		}
 	}
 	_decoder_cur_frame = actual_from_frame;
 
-	PlayheadChunk *chunk = new PlayheadChunk;
-	chunk->next = nullptr;
-	chunk->song_id = _last_song_id;
-	chunk->num_channels = _num_channels;
-	chunk->sample_rate = _sample_rate;
-	chunk->first_frame = actual_from_frame;
-	chunk->num_frames = _CHUNK_NUM_FRAMES;
-	chunk->frames = new float[_CHUNK_NUM_FRAMES * _num_channels];
-
-	ma_uint64 num_decoded_frames = ma_decoder_read_pcm_frames(&_decoder,
-		chunk->frames, _CHUNK_NUM_FRAMES);
+	return true;
+}
+
+// Decodes up to chunk_num_frames frames into the chunk's (already allocated)
+// frames, and returns false if there was nothing left to decode
+bool IOAudioFileDecoder::_decode_chunk(PlayheadChunk &chunk,
+	ma_uint64 from_frame, ma_uint64 actual_from_frame,
+	ma_uint64 chunk_num_frames)
+{
+	chunk.song_id = _last_song_id;
+	chunk.num_channels = _song_num_channels;
+	chunk.sample_rate = _sample_rate;
+	chunk.first_frame = actual_from_frame;
+
+	trace(_tracer, TraceEventType::DECODE_BEGIN, _playhead_idx, _track_idx,
+		static_cast<double>(from_frame));
+	ma_uint64 num_decoded_frames = chunk.owns_frames ?
+		_read(chunk.frames, chunk.storage, chunk_num_frames) :
+		_borrow(chunk.frames, chunk_num_frames);
+	trace(_tracer, TraceEventType::DECODE_END, _playhead_idx, _track_idx,
+		static_cast<double>(num_decoded_frames));
 	_decoder_cur_frame += num_decoded_frames;
+	_num_decode_calls.add(1);
+	if (chunk.owns_frames) {
+		_num_decoded_bytes.add(num_decoded_frames * _song_num_channels *
+			sample_storage_num_bytes(chunk.storage));
+	}
 
-	chunk->num_frames = num_decoded_frames;
-	if (chunk->num_frames < _CHUNK_NUM_FRAMES) {
+	chunk.num_frames = num_decoded_frames;
+	if (chunk.num_frames < chunk_num_frames) {
 		_end_of_song = true;
 	}
-	if (chunk->num_frames <= 0) {
-		delete[] chunk->frames;
-		delete chunk;
-		return nullptr;
+	if (chunk.num_frames <= 0) {
+		return false;
 	}
 
 	_last_from_frame = from_frame;
-	_next_send_frame = actual_from_frame + _CHUNK_NUM_FRAMES;
+	_next_send_frame = actual_from_frame + chunk_num_frames;
 
-	return chunk;
+	return true;
 }
 
-void IOAudioFileDecoder::invalidate_last_clip_idx()
+void IOAudioFileDecoder::_open_file(unsigned int song_id)
 {
-	_last_clip_idx_valid = false;
+	_close_file();
+
+	_song_num_channels = stored_num_channels(
+		_library->num_channels(song_id), _num_channels);
+	_borrow_frames = _library->pcm_frames(song_id, _song_num_channels,
+		_sample_rate, _borrow_num_frames);
+	if (!_borrow_frames) {
+		_reader = _library->open_song(song_id, _song_num_channels,
+			_sample_rate);
+	}
+
+	_decoder_ready = _borrow_frames || _reader;
 }
 
-void IOAudioFileDecoder::reset_next_send_frame()
+void IOAudioFileDecoder::_close_file()
 {
+	_reader.reset();
+	_borrow_frames = nullptr;
+	_borrow_num_frames = 0;
+	_borrow_cur_frame = 0;
+
+	_decoder_ready = false;
+	_decoder_cur_frame = 0;
 	_next_send_frame = 0;
 	_next_send_frame_valid = false;
 
 	_end_of_song = false;
 }
 
-void IOAudioFileDecoder::_open_file(unsigned int song_id)
+bool IOAudioFileDecoder::_seek(ma_uint64 frame)
 {
-	_close_file();
-
-	ma_decoder_config decoder_cfg = ma_decoder_config_init(ma_format_f32,
-		_num_channels, _sample_rate);
-	if (ma_decoder_init_file(_library->filename(song_id).c_str(),
-		&decoder_cfg, &_decoder) == MA_SUCCESS) {
-		_decoder_ready = true;
+	if (_borrow_frames) {
+		if (frame > _borrow_num_frames) {
+			return false;
+		}
+		_borrow_cur_frame = frame;
+		return true;
 	}
+
+	return _reader->seek(frame);
 }
 
-void IOAudioFileDecoder::_close_file()
+ma_uint64 IOAudioFileDecoder::_read(void *frames, SampleStorage storage,
+	ma_uint64 num_frames)
 {
-	if (_decoder_ready) {
-		ma_decoder_uninit(&_decoder);
+	// Chunks only own their frames when there's nothing to borrow (see
+	// decode()), but ring slots always do
+	if (_borrow_frames) {
+		ma_uint64 num_left = _borrow_num_frames - _borrow_cur_frame;
+		if (num_frames > num_left) {
+			num_frames = num_left;
+		}
+		store_samples(frames, storage, _borrow_frames +
+			_borrow_cur_frame * _song_num_channels, num_frames *
+			_song_num_channels);
+		_borrow_cur_frame += num_frames;
+		return num_frames;
 	}
 
-	_decoder_ready = false;
-	_decoder_cur_frame = 0;
-	_next_send_frame = 0;
-	_next_send_frame_valid = false;
+	return read_samples(*_reader, frames, storage, num_frames,
+		_song_num_channels, _scratch);
+}
 
-	_end_of_song = false;
+// Points frames at the next num_frames frames of the song's memory instead of
+// copying them
+ma_uint64 IOAudioFileDecoder::_borrow(void *&frames, ma_uint64 num_frames)
+{
+	ma_uint64 num_left = _borrow_num_frames - _borrow_cur_frame;
+	if (num_frames > num_left) {
+		num_frames = num_left;
+	}
+	// The AudioEngine only ever reads chunks' frames
+	frames = const_cast<float *>(_borrow_frames + _borrow_cur_frame *
+		_song_num_channels);
+	_borrow_cur_frame += num_frames;
+	return num_frames;
 }
 }
@@ -1,19 +1,37 @@
 #include "bqIOEngine.h"
 #include "bqAudioEngine.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 namespace bq {
-IOEngine::IOEngine()
+IOEngine::IOEngine(unsigned int num_tracks, unsigned int num_playheads)
 {
 	_msg_pool = new QwNodePool<IOMsg>(_NUM_MAX_POOL_MSGS);
+	_num_msgs_pushed = 0;
 
-	for (unsigned int i = 0; i < WORLD_NUM_TRACKS; ++i) {
-		_track_dirty[i] = false;
+	_num_tracks = num_tracks;
+	_num_playheads = num_playheads;
+	unsigned int num_streams = _num_playheads * _num_tracks;
 
-		for (unsigned int j = 0; j < WORLD_NUM_PLAYHEADS; ++j) {
-			_playheads[j].cur_clip_dirty[i] = false;
-			_wait_cur_want_frame[j][i] = false;
-		}
+	_tracks.allocate(_num_tracks);
+	_published_clips.allocate(_num_tracks);
+	for (unsigned int i = 0; i < _num_tracks; ++i) {
+		_tracks[i].bind_preload_timing(&_timings.preload);
+		_published_clips[i].allocate(0);
 	}
+
+	_playheads.allocate(_num_playheads);
+	_streams.allocate(num_streams);
+
+	_dirty_tracks.reserve(_num_tracks);
+	_track_dirty.assign(_num_tracks, false);
+	_preload_dirty_tracks.reserve(_num_tracks);
+	_track_preloads_dirty.assign(_num_tracks, false);
+	_balance_beats.assign(_num_playheads, 0.0);
+	_dirty_streams.reserve(num_streams);
+	_streams_with_sent_chunks.reserve(num_streams);
 }
 
 IOEngine::~IOEngine()
@@ -26,9 +44,12 @@ IOEngine::~IOEngine()
 	// cause memory management errors.
 	bind_library(nullptr);
 	bind_audio_engine(nullptr);
+	bind_tracer(nullptr);
 
 	handle_all_msgs();
 
+	_reclaim_all();
+
 	delete _msg_pool;
 }
 
@@ -39,7 +60,7 @@ void IOEngine::decode_next_cache_chunks(unsigned int playhead_idx,
 		!_is_track_valid(track_idx) ||
 		_tracks[track_idx].num_clips() <= 0 ||
 		_playheads[playhead_idx].wait_playhead_jump ||
-		_wait_cur_want_frame[playhead_idx][track_idx]) {
+		wait_cur_want_frame(playhead_idx, track_idx)) {
 		return;
 	}
 
@@ -56,45 +77,88 @@ void IOEngine::decode_next_cache_chunks(unsigned int playhead_idx,
 
 	const AudioClip &clip = track.clip_at(clip_idx);
 
-	// If the clip is less than one beat long, don't cache anything (the
-	// content should have already been preloaded). We want to avoid the
-	// decoder opening and closing lots of files, which would thrash the
-	// filesystem.
+	// If the clip's stream is less than one beat long and preloaded, don't
+	// cache anything (the preload covers it). We want to avoid the decoder
+	// opening and closing lots of files, which would thrash the filesystem.
+	// Streams whose preload was evicted (or not made yet) to stay within
+	// the memory budget are decoded like any other, though, since nothing
+	// else would play them.
 	// Also, if the playhead is not actually inside the clip, don't cache
 	// anything (because it's not actually playing - it's just cued or
 	// something). This would need to be fixed later when implementing clip
 	// looping.
 	double playhead_beat = _audio->get_playhead_beat(playhead_idx);
-	if (clip.end - clip.start < 1.0 ||
+	bool preloaded = track.clip_at(clip.stream_first_clip_idx).preload
+		.num_frames > 0;
+	if ((clip.end - clip.stream_start < 1.0 && preloaded) ||
 		playhead_beat < clip.start || playhead_beat >= clip.end) {
 		return;
 	}
 
-	IOAudioFileDecoder &decoder = _decoders[playhead_idx][track_idx];
-	decoder.set_clip_idx(clip_idx);
+	// All clips in a stream share one decoder position, so crossing into
+	// the next clip of the same stream doesn't restart decoding
+	IOAudioFileDecoder &decoder =
+		_streams[_stream_idx(playhead_idx, track_idx)].decoder;
+	decoder.set_clip_idx(clip.stream_first_clip_idx);
 	decoder.set_song_id(song_id);
 
 	ma_uint64 cur_want_frame = _audio->get_cur_want_frame(playhead_idx,
 		track_idx);
-	PlayheadChunk *chunk = nullptr;
-	while ((chunk = decoder.decode(cur_want_frame))) {
-		_audio->receive_playhead_chunk(playhead_idx, track_idx, chunk);
+	PlayheadRing *ring = _audio->get_playhead_ring(playhead_idx,
+		track_idx);
+	bool timing = _timings.decode.is_enabled();
+	ma_uint64 start = timing ? TimingHistogram::now() : 0;
+	if (ring) {
+		while (decoder.decode_into(*ring, cur_want_frame)) {
+			if (timing) {
+				ma_uint64 end = TimingHistogram::now();
+				_timings.decode.record(end - start);
+				start = end;
+			}
+		}
+	} else {
+		PlayheadChunk *chunk = nullptr;
+		while ((chunk = decoder.decode(cur_want_frame))) {
+			if (timing) {
+				ma_uint64 end = TimingHistogram::now();
+				_timings.decode.record(end - start);
+				start = end;
+			}
+
+			_audio->receive_playhead_chunk(playhead_idx, track_idx,
+				chunk);
+			_send_chunk(playhead_idx, track_idx, chunk);
+		}
 	}
 }
 
-void IOEngine::set_decode_config(ma_uint32 num_channels, ma_uint32 sample_rate)
+void IOEngine::set_decode_config(ma_uint32 num_channels, ma_uint32 sample_rate,
+	const BufferSizes &sizes)
 {
 	_decode_num_channels = num_channels;
 	_decode_sample_rate = sample_rate;
 
-	for (unsigned int i = 0; i < WORLD_NUM_TRACKS; ++i) {
+	for (unsigned int i = 0; i < _num_tracks; ++i) {
 		_tracks[i].set_preload_config(_decode_num_channels,
-			_decode_sample_rate);
+			_decode_sample_rate, sizes.preload_num_frames,
+			sizes.sample_storage);
+	}
 
-		for (unsigned int j = 0; j < WORLD_NUM_PLAYHEADS; ++j) {
-			_decoders[j][i].set_decode_config(_decode_num_channels,
-				_decode_sample_rate);
-		}
+	for (_Stream &stream : _streams) {
+		stream.decoder.set_decode_config(_decode_num_channels,
+			_decode_sample_rate, sizes);
+	}
+
+	_stream_num_bytes = sizes.stream_num_bytes(_decode_num_channels);
+}
+
+void IOEngine::set_memory_budget(ma_uint64 num_bytes)
+{
+	_memory_budget_num_bytes = num_bytes;
+	_balance_pending = num_bytes > 0;
+
+	for (unsigned int i = 0; i < _num_tracks; ++i) {
+		_tracks[i].set_preloads_managed(num_bytes > 0);
 	}
 }
 
@@ -103,23 +167,40 @@ void IOEngine::bind_audio_engine(AudioEngine *audio)
 	_audio = audio;
 }
 
-void IOEngine::bind_library(Library *library)
+void IOEngine::bind_tracer(Tracer *tracer)
 {
-	_library = library;
+	_tracer = tracer;
 
-	for (unsigned int i = 0; i < WORLD_NUM_TRACKS; ++i) {
-		for (unsigned int j = 0; j < WORLD_NUM_PLAYHEADS; ++j) {
-			_decoders[j][i].bind_library(_library);
+	for (unsigned int i = 0; i < _num_tracks; ++i) {
+		for (unsigned int j = 0; j < _num_playheads; ++j) {
+			_streams[_stream_idx(j, i)].decoder.bind_tracer(_tracer,
+				j, i);
 		}
 
+		_tracks[i].bind_tracer(_tracer, i);
+	}
+}
+
+void IOEngine::bind_library(Library *library)
+{
+	_library = library;
+
+	for (unsigned int i = 0; i < _num_tracks; ++i) {
 		_tracks[i].bind_library(_library);
 	}
+
+	for (_Stream &stream : _streams) {
+		stream.decoder.bind_library(_library);
+	}
 }
 
 void IOEngine::handle_all_msgs()
 {
 	IOMsg *msg = nullptr;
 	while ((msg = _msg_queue.pop())) {
+		trace(_tracer, TraceEventType::IO_MSG_POP, TRACE_NO_IDX,
+			TRACE_NO_IDX, static_cast<double>(msg->type));
+
 		switch (msg->type) {
 		case IOMsgType::INSERT_CLIP:
 			_handle_insert_clip(msg->contents.insert_clip);
@@ -130,20 +211,6 @@ void IOEngine::handle_all_msgs()
 				msg->contents.erase_clips_range);
 			break;
 
-		case IOMsgType::DELETE_CLIPS:
-			_handle_delete_clips(msg->contents.delete_clips);
-			break;
-
-		case IOMsgType::DELETE_OLD_PRELOADS:
-			_handle_delete_old_preloads(
-				msg->contents.delete_old_preloads);
-			break;
-
-		case IOMsgType::DELETE_PLAYHEAD_CHUNK:
-			_handle_delete_playhead_chunk(
-				msg->contents.delete_playhead_chunk);
-			break;
-
 		case IOMsgType::JUMP_PLAYHEAD:
 			_handle_jump_playhead(msg->contents.jump_playhead);
 			break;
@@ -162,43 +229,55 @@ void IOEngine::handle_all_msgs()
 		}
 
 		_msg_pool->deallocate(msg);
+		_num_msgs_handled.add(1);
 	}
 
-	for (unsigned int i = 0; i < WORLD_NUM_TRACKS; ++i) {
-		if (_track_dirty[i]) {
-			if (_audio) {
-				_audio->receive_clips(i,
-					_tracks[i].copy_clips());
-				_audio->receive_old_preloads(
-					_tracks[i].copy_old_preloads());
-			}
-
-			for (unsigned int j = 0; j < WORLD_NUM_PLAYHEADS; ++j) {
-				_wait_cur_want_frame[j][i] = true;
-
-				_playheads[j].cur_clip_dirty[i] = true;
-				_decoders[j][i].invalidate_last_clip_idx();
-			}
+	if (_should_balance_preloads()) {
+		_balance_preloads();
+	}
 
-			_track_dirty[i] = false;
+	for (unsigned int i : _preload_dirty_tracks) {
+		// Edited tracks are published below anyway
+		if (!_track_dirty[i]) {
+			_publish_clips(i);
 		}
+		_track_preloads_dirty[i] = false;
 	}
+	_preload_dirty_tracks.clear();
 
-	for (unsigned int i = 0; i < WORLD_NUM_PLAYHEADS; ++i) {
-		for (unsigned int j = 0; j < WORLD_NUM_TRACKS; ++j) {
-			if (_playheads[i].cur_clip_dirty[j]) {
-				_update_audio_cur_clip_idx(i, j);
-				_playheads[i].cur_clip_dirty[j] = false;
-			}
+	for (unsigned int i : _dirty_tracks) {
+		_publish_clips(i);
+
+		for (unsigned int j = 0; j < _num_playheads; ++j) {
+			_request_cur_want_frame(j, i);
+
+			_mark_cur_clip_dirty(j, i);
+			_streams[_stream_idx(j, i)].decoder
+				.invalidate_last_clip_idx();
 		}
 
-		_playheads[i].jumping = false;
+		_track_dirty[i] = false;
+	}
+	_dirty_tracks.clear();
+
+	// A jump marks every one of its playhead's streams dirty, so every
+	// jumping playhead is reached here
+	for (unsigned int idx : _dirty_streams) {
+		_update_audio_cur_clip_idx(idx / _num_tracks,
+			idx % _num_tracks);
+		_streams[idx].cur_clip_dirty = false;
 	}
+	for (unsigned int idx : _dirty_streams) {
+		_playheads[idx / _num_tracks].jumping = false;
+	}
+	_dirty_streams.clear();
+
+	_reclaim();
 }
 
 void IOEngine::insert_clip(unsigned int track, double start, double end,
 	double fade_in, double fade_out, unsigned int song_id,
-	ma_uint64 first_frame, double pitch_shift)
+	ma_uint64 first_frame, double pitch_shift, double preload_seconds)
 {
 	IOMsg *msg = _msg_pool->allocate();
 	msg->type = IOMsgType::INSERT_CLIP;
@@ -209,7 +288,11 @@ void IOEngine::insert_clip(unsigned int track, double start, double end,
 	msg->contents.insert_clip.fade_in = fade_in;
 	msg->contents.insert_clip.fade_out = fade_out;
 	msg->contents.insert_clip.pitch_shift = pitch_shift;
+	msg->contents.insert_clip.preload_seconds = preload_seconds;
 	msg->contents.insert_clip.first_frame = first_frame;
+	trace(_tracer, TraceEventType::IO_MSG_PUSH, TRACE_NO_IDX, track,
+		static_cast<double>(msg->type));
+	_num_msgs_pushed.fetch_add(1, std::memory_order_relaxed);
 	_msg_queue.push(msg);
 }
 
@@ -220,30 +303,9 @@ void IOEngine::erase_clips_range(unsigned int track, double from, double to)
 	msg->contents.erase_clips_range.track = track;
 	msg->contents.erase_clips_range.from = from;
 	msg->contents.erase_clips_range.to = to;
-	_msg_queue.push(msg);
-}
-
-void IOEngine::delete_clips(AudioClipsArray clips)
-{
-	IOMsg *msg = _msg_pool->allocate();
-	msg->type = IOMsgType::DELETE_CLIPS;
-	msg->contents.delete_clips.clips = clips;
-	_msg_queue.push(msg);
-}
-
-void IOEngine::delete_old_preloads(OldPreloadsArray old_preloads)
-{
-	IOMsg *msg = _msg_pool->allocate();
-	msg->type = IOMsgType::DELETE_OLD_PRELOADS;
-	msg->contents.delete_old_preloads.old_preloads = old_preloads;
-	_msg_queue.push(msg);
-}
-
-void IOEngine::delete_playhead_chunk(PlayheadChunk *chunk)
-{
-	IOMsg *msg = _msg_pool->allocate();
-	msg->type = IOMsgType::DELETE_PLAYHEAD_CHUNK;
-	msg->contents.delete_playhead_chunk.chunk = chunk;
+	trace(_tracer, TraceEventType::IO_MSG_PUSH, TRACE_NO_IDX, track,
+		static_cast<double>(msg->type));
+	_num_msgs_pushed.fetch_add(1, std::memory_order_relaxed);
 	_msg_queue.push(msg);
 }
 
@@ -253,6 +315,9 @@ void IOEngine::jump_playhead(unsigned int playhead, double beat)
 	msg->type = IOMsgType::JUMP_PLAYHEAD;
 	msg->contents.jump_playhead.playhead = playhead;
 	msg->contents.jump_playhead.beat = beat;
+	trace(_tracer, TraceEventType::IO_MSG_PUSH, playhead, TRACE_NO_IDX,
+		static_cast<double>(msg->type));
+	_num_msgs_pushed.fetch_add(1, std::memory_order_relaxed);
 	_msg_queue.push(msg);
 }
 
@@ -261,6 +326,9 @@ void IOEngine::notify_audio_playhead_jumped(unsigned int playhead)
 	IOMsg *msg = _msg_pool->allocate();
 	msg->type = IOMsgType::AUDIO_PLAYHEAD_JUMPED;
 	msg->contents.audio_playhead_jumped.playhead = playhead;
+	trace(_tracer, TraceEventType::IO_MSG_PUSH, playhead, TRACE_NO_IDX,
+		static_cast<double>(msg->type));
+	_num_msgs_pushed.fetch_add(1, std::memory_order_relaxed);
 	_msg_queue.push(msg);
 }
 
@@ -270,83 +338,221 @@ void IOEngine::request_emergency_chunk(unsigned int playhead, unsigned int track
 	msg->type = IOMsgType::REQUEST_EMERGENCY_CHUNK;
 	msg->contents.request_emergency_chunk.playhead = playhead;
 	msg->contents.request_emergency_chunk.track = track;
+	trace(_tracer, TraceEventType::IO_MSG_PUSH, playhead, track,
+		static_cast<double>(msg->type));
+	_num_msgs_pushed.fetch_add(1, std::memory_order_relaxed);
 	_msg_queue.push(msg);
 }
 
+void IOEngine::get_stats(Stats &stats)
+{
+	stats.num_preloads = 0;
+	stats.num_preload_bytes = 0;
+	stats.num_preload_evictions = 0;
+	for (unsigned int i = 0; i < _num_tracks; ++i) {
+		stats.num_preloads += _tracks[i].get_num_preloads();
+		stats.num_preload_bytes += _tracks[i].get_num_preload_bytes();
+		stats.num_preload_evictions +=
+			_tracks[i].get_num_preload_evictions();
+	}
+
+	// The two counters are read at slightly different times
+	ma_uint64 num_freed = _num_freed_preload_bytes.get();
+	stats.num_live_preload_bytes = stats.num_preload_bytes > num_freed ?
+		stats.num_preload_bytes - num_freed : 0;
+
+	for (unsigned int i = 0; i < _num_playheads; ++i) {
+		for (unsigned int j = 0; j < _num_tracks; ++j) {
+			StreamStats &stream = stats.stream(i, j);
+			_Stream &io_stream = _streams[_stream_idx(i, j)];
+			io_stream.decoder.get_stats(stream);
+
+			if (!_audio) {
+				continue;
+			}
+
+			PlayheadRing *ring = _audio->get_playhead_ring(i, j);
+			if (ring) {
+				stream.num_queued_chunks = ring->num_filled();
+			} else {
+				ma_uint64 sent =
+					io_stream.num_chunks_sent.get();
+				ma_uint64 released =
+					_audio->get_num_chunks_released(i, j);
+				stream.num_queued_chunks = sent > released ?
+					sent - released : 0;
+			}
+		}
+	}
+
+	// The counters aren't read atomically together, so the handled count
+	// may be slightly ahead of the pushed count
+	ma_uint64 num_msgs_pushed = _num_msgs_pushed.load(
+		std::memory_order_relaxed);
+	ma_uint64 num_msgs_handled = _num_msgs_handled.get();
+	stats.io_msg_queue_depth = num_msgs_pushed > num_msgs_handled ?
+		num_msgs_pushed - num_msgs_handled : 0;
+}
+
+void IOEngine::set_timing_enabled(bool enabled)
+{
+	_timings.decode.set_enabled(enabled);
+	_timings.preload.set_enabled(enabled);
+}
+
+void IOEngine::get_timing_stats(TimingStats &stats)
+{
+	stats.io_decode = _timings.decode.summarize();
+	stats.io_preload = _timings.preload.summarize();
+}
+
+PlayheadChunk *IOEngine::decode_blocking(unsigned int playhead,
+	unsigned int track, const AudioClip &clip, ma_uint64 want_frame)
+{
+	if (!_library || !_audio || !_is_playhead_valid(playhead) ||
+		!_is_track_valid(track) ||
+		!_library->is_song_id_valid(clip.song_id)) {
+		return nullptr;
+	}
+
+	IOAudioFileDecoder &decoder = _streams[_stream_idx(playhead,
+		track)].decoder;
+	decoder.set_clip_idx(clip.stream_first_clip_idx);
+	decoder.set_song_id(clip.song_id);
+	// Decode from exactly the wanted frame; the decoder carries on from
+	// there for any later chunks
+	decoder.reset_next_send_frame();
+
+	PlayheadRing *ring = _audio->get_playhead_ring(playhead, track);
+	if (ring) {
+		if (!decoder.decode_into(*ring, want_frame)) {
+			return nullptr;
+		}
+		return ring->front();
+	}
+
+	PlayheadChunk *chunk = decoder.decode(want_frame);
+	if (chunk) {
+		_send_chunk(playhead, track, chunk);
+	}
+	return chunk;
+}
+
 bool IOEngine::wait_cur_want_frame(unsigned int playhead, unsigned int track)
 {
-	if (_is_playhead_valid(playhead) && _is_track_valid(track)) {
-		return _wait_cur_want_frame[playhead][track];
+	if (_audio && _is_playhead_valid(playhead) && _is_track_valid(track)) {
+		return _streams[_stream_idx(playhead, track)]
+			.want_frame_request !=
+			_audio->get_want_frame_ack(playhead, track);
 	} else {
 		return false;
 	}
 }
 
-void IOEngine::set_wait_cur_want_frame(unsigned int playhead,
-	unsigned int track, bool value)
+ma_uint64 IOEngine::get_want_frame_request(unsigned int playhead,
+	unsigned int track)
 {
 	if (_is_playhead_valid(playhead) && _is_track_valid(track)) {
-		_wait_cur_want_frame[playhead][track] = value;
+		return _streams[_stream_idx(playhead, track)]
+			.want_frame_request;
+	} else {
+		return 0;
 	}
 }
 
 bool IOEngine::_is_track_valid(unsigned int track_idx)
 {
-	return track_idx < WORLD_NUM_TRACKS;
+	return track_idx < _num_tracks;
 }
 
 bool IOEngine::_is_playhead_valid(unsigned int playhead_idx)
 {
-	return playhead_idx < WORLD_NUM_PLAYHEADS;
+	return playhead_idx < _num_playheads;
 }
 
-void IOEngine::_handle_insert_clip(IOMsgInsertClip &msg)
+unsigned int IOEngine::_stream_idx(unsigned int playhead_idx,
+	unsigned int track_idx)
 {
-	if (_is_track_valid(msg.track)) {
-		_tracks[msg.track].insert_clip(msg.start, msg.end, msg.fade_in,
-			msg.fade_out, msg.song_id, msg.first_frame,
-			msg.pitch_shift);
-		_track_dirty[msg.track] = true;
+	return playhead_idx * _num_tracks + track_idx;
+}
+
+void IOEngine::_mark_track_dirty(unsigned int track_idx)
+{
+	if (!_track_dirty[track_idx]) {
+		_track_dirty[track_idx] = true;
+		_dirty_tracks.push_back(track_idx);
 	}
 }
 
-void IOEngine::_handle_erase_clips_range(IOMsgEraseClipsRange &msg)
+void IOEngine::_mark_track_preloads_dirty(unsigned int track_idx)
 {
-	if (_is_track_valid(msg.track)) {
-		_tracks[msg.track].erase_clips_range(msg.from, msg.to);
-		_track_dirty[msg.track] = true;
+	if (!_track_preloads_dirty[track_idx]) {
+		_track_preloads_dirty[track_idx] = true;
+		_preload_dirty_tracks.push_back(track_idx);
 	}
 }
 
-void IOEngine::_handle_delete_clips(IOMsgDeleteClips &msg)
+void IOEngine::_publish_clips(unsigned int track_idx)
 {
-	if (msg.clips.clips) {
-		delete[] msg.clips.clips;
+	if (!_audio) {
+		return;
 	}
+
+	AudioClipsArray clips = _tracks[track_idx].copy_clips();
+	_audio->receive_clips(track_idx, clips);
+	_retire(_published_clips[track_idx],
+		_tracks[track_idx].take_old_preloads());
+	_published_clips[track_idx] = clips;
 }
 
-void IOEngine::_handle_delete_old_preloads(IOMsgDeleteOldPreloads &msg)
+void IOEngine::_mark_cur_clip_dirty(unsigned int playhead_idx,
+	unsigned int track_idx)
 {
-	if (msg.old_preloads.frames) {
-		for (unsigned int i = 0; i < msg.old_preloads.num_preloads;
-			++i) {
-			if (msg.old_preloads.frames[i]) {
-				delete[] msg.old_preloads.frames[i];
-			}
-		}
+	unsigned int idx = _stream_idx(playhead_idx, track_idx);
+	if (!_streams[idx].cur_clip_dirty) {
+		_streams[idx].cur_clip_dirty = true;
+		_dirty_streams.push_back(idx);
+	}
+}
 
-		delete[] msg.old_preloads.frames;
+void IOEngine::_send_chunk(unsigned int playhead_idx, unsigned int track_idx,
+	PlayheadChunk *chunk)
+{
+	unsigned int idx = _stream_idx(playhead_idx, track_idx);
+	_Stream &stream = _streams[idx];
+
+	stream.sent_chunks.push_back(chunk);
+	stream.num_chunks_sent.add(1);
+
+	if (!stream.has_sent_chunks) {
+		stream.has_sent_chunks = true;
+		_streams_with_sent_chunks.push_back(idx);
 	}
 }
 
-void IOEngine::_handle_delete_playhead_chunk(IOMsgDeletePlayheadChunk &msg)
+void IOEngine::_free_chunk(PlayheadChunk *chunk)
 {
-	if (msg.chunk) {
-		if (msg.chunk->frames) {
-			delete[] msg.chunk->frames;
-		}
+	if (chunk->owns_frames) {
+		free_samples(chunk->frames);
+	}
+	delete chunk;
+}
+
+void IOEngine::_handle_insert_clip(IOMsgInsertClip &msg)
+{
+	if (_is_track_valid(msg.track)) {
+		_tracks[msg.track].insert_clip(msg.start, msg.end, msg.fade_in,
+			msg.fade_out, msg.song_id, msg.first_frame,
+			msg.pitch_shift, msg.preload_seconds);
+		_mark_track_dirty(msg.track);
+	}
+}
 
-		delete msg.chunk;
+void IOEngine::_handle_erase_clips_range(IOMsgEraseClipsRange &msg)
+{
+	if (_is_track_valid(msg.track)) {
+		_tracks[msg.track].erase_clips_range(msg.from, msg.to);
+		_mark_track_dirty(msg.track);
 	}
 }
 
@@ -357,10 +563,11 @@ void IOEngine::_handle_jump_playhead(IOMsgJumpPlayhead &msg)
 		playhead.jump_beat = msg.beat;
 		playhead.jumping = true;
 		playhead.wait_playhead_jump = true;
-		for (unsigned int i = 0; i < WORLD_NUM_TRACKS; ++i) {
-			_wait_cur_want_frame[msg.playhead][i] = true;
-			playhead.cur_clip_dirty[i] = true;
-			_decoders[msg.playhead][i].reset_next_send_frame();
+		for (unsigned int i = 0; i < _num_tracks; ++i) {
+			_request_cur_want_frame(msg.playhead, i);
+			_mark_cur_clip_dirty(msg.playhead, i);
+			_streams[_stream_idx(msg.playhead, i)].decoder
+				.reset_next_send_frame();
 		}
 	}
 }
@@ -375,7 +582,8 @@ void IOEngine::_handle_audio_playhead_jumped(IOMsgAudioPlayheadJumped &msg)
 void IOEngine::_handle_request_emergency_chunk(IOMsgRequestEmergencyChunk &msg)
 {
 	if (_is_playhead_valid(msg.playhead) && _is_track_valid(msg.track)) {
-		_decoders[msg.playhead][msg.track].reset_next_send_frame();
+		_streams[_stream_idx(msg.playhead, msg.track)].decoder
+			.reset_next_send_frame();
 	}
 }
 
@@ -388,12 +596,7 @@ void IOEngine::_update_audio_cur_clip_idx(unsigned int playhead_idx,
 
 	unsigned int cur_clip_idx = 0;
 
-	double playhead_beat = 0.0;
-	if (playhead.jumping) {
-		playhead_beat = playhead.jump_beat;
-	} else if (_audio) {
-		playhead_beat = _audio->get_playhead_beat(playhead_idx);
-	}
+	double playhead_beat = _cur_playhead_beat(playhead_idx);
 
 	for (unsigned int i = 0; i < num_clips; ++i) {
 		if (playhead_beat >= track.clip_at(i).start) {
@@ -412,4 +615,245 @@ void IOEngine::_update_audio_cur_clip_idx(unsigned int playhead_idx,
 		}
 	}
 }
+
+void IOEngine::_request_cur_want_frame(unsigned int playhead_idx,
+	unsigned int track_idx)
+{
+	std::atomic<ma_uint64> &request =
+		_streams[_stream_idx(playhead_idx, track_idx)]
+		.want_frame_request;
+	request.store(request.load(std::memory_order_relaxed) + 1);
+}
+
+// Where the playhead is, or will be once the AudioEngine handles its jump
+double IOEngine::_cur_playhead_beat(unsigned int playhead_idx)
+{
+	const DirtyPlayheadInfo &playhead = _playheads[playhead_idx];
+	if (playhead.jumping) {
+		return playhead.jump_beat;
+	} else if (_audio) {
+		return _audio->get_playhead_beat(playhead_idx);
+	}
+
+	return 0.0;
+}
+
+bool IOEngine::_should_balance_preloads()
+{
+	if (_memory_budget_num_bytes == 0 || !_audio || !_library) {
+		return false;
+	}
+
+	if (_balance_pending || !_dirty_tracks.empty()) {
+		return true;
+	}
+
+	for (unsigned int i = 0; i < _num_playheads; ++i) {
+		if (_playheads[i].jumping || std::abs(_cur_playhead_beat(i) -
+			_balance_beats[i]) >= _BALANCE_INTERVAL_BEATS) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void IOEngine::_balance_preloads()
+{
+	for (unsigned int i = 0; i < _num_playheads; ++i) {
+		_balance_beats[i] = _cur_playhead_beat(i);
+	}
+
+	_preload_candidates.clear();
+	for (unsigned int i = 0; i < _num_tracks; ++i) {
+		IOTrack &track = _tracks[i];
+		track.update_streams();
+
+		unsigned int num_clips = track.num_clips();
+		for (unsigned int j = 0; j < num_clips; ++j) {
+			const AudioClip &clip = track.clip_at(j);
+			if (clip.stream_first_clip_idx != j) {
+				continue;
+			}
+
+			double stream_end = clip.end;
+			for (unsigned int k = j + 1; k < num_clips &&
+				track.clip_at(k).stream_first_clip_idx == j;
+				++k) {
+				stream_end = track.clip_at(k).end;
+			}
+
+			_PreloadCandidate candidate;
+			candidate.track_idx = i;
+			candidate.clip_idx = j;
+			candidate.distance = _distance_to_playheads(
+				clip.stream_start, stream_end);
+			candidate.num_bytes = track.preload_num_bytes(j);
+			_preload_candidates.push_back(candidate);
+		}
+	}
+
+	std::stable_sort(_preload_candidates.begin(),
+		_preload_candidates.end(),
+		[](const _PreloadCandidate &a, const _PreloadCandidate &b) {
+			return a.distance < b.distance;
+		});
+
+	ma_uint64 reserved = _stream_num_bytes * _num_playheads * _num_tracks;
+	ma_uint64 available = _memory_budget_num_bytes > reserved ?
+		_memory_budget_num_bytes - reserved : 0;
+
+	// Evictions come first, so that the new preloads never push the
+	// total over the budget even for a moment
+	ma_uint64 num_used_bytes = 0;
+	for (_PreloadCandidate &candidate : _preload_candidates) {
+		candidate.keep = num_used_bytes + candidate.num_bytes <=
+			available;
+		if (candidate.keep) {
+			num_used_bytes += candidate.num_bytes;
+		} else if (_tracks[candidate.track_idx].has_preload(
+			candidate.clip_idx)) {
+			_tracks[candidate.track_idx].evict_preload(
+				candidate.clip_idx);
+			_mark_track_preloads_dirty(candidate.track_idx);
+		}
+	}
+
+	unsigned int num_made = 0;
+	_balance_pending = false;
+	for (const _PreloadCandidate &candidate : _preload_candidates) {
+		IOTrack &track = _tracks[candidate.track_idx];
+		if (!candidate.keep || track.has_preload(candidate.clip_idx)) {
+			continue;
+		}
+
+		if (num_made >= _MAX_PRELOADS_PER_BALANCE) {
+			_balance_pending = true;
+			break;
+		}
+
+		track.materialize_preload(candidate.clip_idx);
+		_mark_track_preloads_dirty(candidate.track_idx);
+		++num_made;
+	}
+}
+
+// How far ahead of the nearest playhead a stream begins, or 0 if a playhead is
+// inside it. Streams that every playhead has passed come last, since only a
+// jump could bring a playhead back to them.
+double IOEngine::_distance_to_playheads(double stream_start,
+	double stream_end)
+{
+	double distance = std::numeric_limits<double>::infinity();
+	for (unsigned int i = 0; i < _num_playheads; ++i) {
+		double beat = _balance_beats[i];
+		if (beat >= stream_end) {
+			continue;
+		}
+
+		double playhead_distance = beat < stream_start ?
+			stream_start - beat : 0.0;
+		if (playhead_distance < distance) {
+			distance = playhead_distance;
+		}
+	}
+
+	return distance;
+}
+
+void IOEngine::_retire(AudioClipsArray clips,
+	std::vector<AudioClipPreload> preloads)
+{
+	if (!_audio) {
+		// Nobody else can be using them
+		_free_retired(clips, preloads);
+		return;
+	}
+
+	// Pairs with the fence in AudioEngine::handle_all_msgs: whatever was
+	// pushed before this point is handled by the next audio callback that
+	// begins after the epoch read here
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	_RetiredMemory retired;
+	retired.epoch = _audio->get_epoch();
+	retired.clips = clips;
+	retired.preloads.swap(preloads);
+	_retired.push_back(std::move(retired));
+}
+
+void IOEngine::_reclaim()
+{
+	if (!_audio) {
+		return;
+	}
+
+	ma_uint64 epoch = _audio->get_epoch();
+	while (!_retired.empty() &&
+		epoch >= _retired.front().epoch + _RECLAIM_NUM_EPOCHS) {
+		_RetiredMemory &retired = _retired.front();
+		_free_retired(retired.clips, retired.preloads);
+		_retired.pop_front();
+	}
+
+	for (size_t i = 0; i < _streams_with_sent_chunks.size();) {
+		unsigned int idx = _streams_with_sent_chunks[i];
+		_Stream &stream = _streams[idx];
+		ma_uint64 num_released = _audio->get_num_chunks_released(
+			idx / _num_tracks, idx % _num_tracks);
+
+		while (stream.num_chunks_freed < num_released &&
+			!stream.sent_chunks.empty()) {
+			_free_chunk(stream.sent_chunks.front());
+			stream.sent_chunks.pop_front();
+			++stream.num_chunks_freed;
+		}
+
+		if (stream.sent_chunks.empty()) {
+			stream.has_sent_chunks = false;
+			_streams_with_sent_chunks[i] =
+				_streams_with_sent_chunks.back();
+			_streams_with_sent_chunks.pop_back();
+		} else {
+			++i;
+		}
+	}
+}
+
+// Must only be called once the AudioEngine can no longer be using anything
+void IOEngine::_reclaim_all()
+{
+	for (_RetiredMemory &retired : _retired) {
+		_free_retired(retired.clips, retired.preloads);
+	}
+	_retired.clear();
+
+	for (unsigned int i = 0; i < _num_tracks; ++i) {
+		_published_clips[i].deallocate();
+	}
+
+	for (unsigned int idx : _streams_with_sent_chunks) {
+		_Stream &stream = _streams[idx];
+		for (PlayheadChunk *chunk : stream.sent_chunks) {
+			_free_chunk(chunk);
+		}
+		stream.sent_chunks.clear();
+		stream.has_sent_chunks = false;
+	}
+	_streams_with_sent_chunks.clear();
+}
+
+void IOEngine::_free_retired(AudioClipsArray &clips,
+	std::vector<AudioClipPreload> &preloads)
+{
+	clips.deallocate();
+
+	for (AudioClipPreload &preload : preloads) {
+		if (preload.frames) {
+			free_samples(preload.frames);
+			_num_freed_preload_bytes.add(preload.num_bytes);
+		}
+	}
+	preloads.clear();
+}
 }
@@ -1,10 +1,34 @@
 #include "bqIOTrack.h"
 
 namespace bq {
-void IOTrack::set_preload_config(ma_uint32 num_channels, ma_uint32 sample_rate)
+IOTrack::~IOTrack()
+{
+	for (AudioClip &clip : _clips) {
+		if (clip.owns_preload && !clip.preload.borrowed &&
+			clip.preload.frames) {
+			free_samples(clip.preload.frames);
+		}
+	}
+
+	for (AudioClipPreload &preload : _old_preloads) {
+		if (preload.frames) {
+			free_samples(preload.frames);
+		}
+	}
+}
+
+void IOTrack::set_preload_config(ma_uint32 num_channels, ma_uint32 sample_rate,
+	ma_uint64 preload_num_frames, SampleStorage storage)
 {
 	_preload_num_channels = num_channels;
 	_preload_sample_rate = sample_rate;
+	_preload_num_frames = preload_num_frames;
+	_preload_storage = storage;
+}
+
+void IOTrack::set_preloads_managed(bool managed)
+{
+	_preloads_managed = managed;
 }
 
 void IOTrack::bind_library(Library *library)
@@ -12,9 +36,20 @@ void IOTrack::bind_library(Library *library)
 	_library = library;
 }
 
+void IOTrack::bind_preload_timing(TimingHistogram *preload_timing)
+{
+	_preload_timing = preload_timing;
+}
+
+void IOTrack::bind_tracer(Tracer *tracer, unsigned int track_idx)
+{
+	_tracer = tracer;
+	_track_idx = track_idx;
+}
+
 void IOTrack::insert_clip(double start, double end, double fade_in,
 	double fade_out, unsigned int song_id, ma_uint64 first_frame,
-	double pitch_shift)
+	double pitch_shift, double preload_seconds)
 {
 	erase_clips_range(start, end);
 
@@ -35,11 +70,11 @@ void IOTrack::insert_clip(double start, double end, double fade_in,
 	clip.fade_in = fade_in;
 	clip.fade_out = fade_out;
 	clip.pitch_shift = pitch_shift;
+	clip.preload_seconds = preload_seconds;
 	clip.first_frame = _library->samples_self2out(clip.song_id,
 		first_frame);
-	if (_library) {
-		clip.preload = _preload(clip.song_id, clip.first_frame);
-	}
+	// Preloading is deferred until the clips are published, because this
+	// clip might turn out to continue another clip's stream
 	it = _clips.insert(it, clip);
 }
 
@@ -68,16 +103,14 @@ void IOTrack::erase_clips_range(double from, double to)
 		}
 
 		if (contains_start && contains_end) {
-			_old_preloads.push_back(it->preload.frames);
+			_retire_preload(*it);
 			it = _clips.erase(it);
 		} else if (contains_start) { // <- PRELOADS HERE
 			if (_library) {
 				it->first_frame +=
 					_library->beats_to_out_samples(
 						it->song_id, to - it->start);
-				_old_preloads.push_back(it->preload.frames);
-				it->preload = _preload(it->song_id,
-					it->first_frame);
+				_retire_preload(*it);
 			}
 			it->start = to;
 
@@ -94,21 +127,23 @@ void IOTrack::erase_clips_range(double from, double to)
 			AudioClip old = *it;
 			// The clip on the left side of the hole will use the
 			// same preload frames as this old clip, so we don't
-			// push those onto _needs_delete
+			// push those onto _old_preloads
 			it = _clips.erase(it);
 
 			AudioClip first = old;
 			first.end = from;
 			it = _clips.insert(it, first);
 
+			// The clip on the right side of the hole is preloaded
+			// when the clips are next published
 			AudioClip last = old;
 			if (_library) {
 				last.first_frame +=
 					_library->beats_to_out_samples(
 						last.song_id, to - last.start);
-				last.preload = _preload(last.song_id,
-					last.first_frame);
 			}
+			last.preload = AudioClipPreload();
+			last.owns_preload = false;
 			last.start = to;
 			it = _clips.insert(std::next(it), last);
 
@@ -119,36 +154,79 @@ void IOTrack::erase_clips_range(double from, double to)
 
 AudioClipsArray IOTrack::copy_clips()
 {
-	AudioClipsArray result;
+	update_streams();
+	_bake_render_info();
 
-	result.num_clips = static_cast<unsigned int>(_clips.size());
+	AudioClipsArray result;
+	result.allocate(static_cast<unsigned int>(_clips.size()));
 
-	if (result.num_clips > 0) {
-		result.clips = new AudioClip[result.num_clips];
-		std::copy(_clips.begin(), _clips.end(), result.clips);
-	} else {
-		result.clips = nullptr;
+	for (unsigned int i = 0; i < result.num_clips; ++i) {
+		result.starts[i] = _clips[i].start;
+		result.ends[i] = _clips[i].end;
+		result.clips[i] = _clips[i];
 	}
 
 	return result;
 }
 
-OldPreloadsArray IOTrack::copy_old_preloads()
+std::vector<AudioClipPreload> IOTrack::take_old_preloads()
+{
+	std::vector<AudioClipPreload> result;
+	result.swap(_old_preloads);
+	return result;
+}
+
+bool IOTrack::has_preload(unsigned int stream_first_clip_idx)
 {
-	OldPreloadsArray result;
+	return _clips[stream_first_clip_idx].owns_preload;
+}
 
-	result.num_preloads = static_cast<unsigned int>(_old_preloads.size());
+ma_uint64 IOTrack::preload_num_bytes(unsigned int stream_first_clip_idx)
+{
+	const AudioClip &clip = _clips[stream_first_clip_idx];
+	if (clip.owns_preload) {
+		return clip.preload.num_bytes;
+	}
 
-	if (result.num_preloads > 0) {
-		result.frames = new float *[result.num_preloads];
-		std::copy(_old_preloads.begin(), _old_preloads.end(),
-			result.frames);
-		_old_preloads.clear();
-	} else {
-		result.frames = nullptr;
+	if (!_library) {
+		return 0;
 	}
 
-	return result;
+	// Songs already in memory are preloaded for free (see _preload())
+	ma_uint32 num_channels = stored_num_channels(
+		_library->num_channels(clip.song_id), _preload_num_channels);
+	ma_uint64 song_num_frames = 0;
+	if (_library->pcm_frames(clip.song_id, num_channels,
+		_preload_sample_rate, song_num_frames)) {
+		return 0;
+	}
+
+	return _preload_num_frames_for(stream_first_clip_idx) * num_channels *
+		sample_storage_num_bytes(_preload_storage);
+}
+
+void IOTrack::materialize_preload(unsigned int stream_first_clip_idx)
+{
+	AudioClip &clip = _clips[stream_first_clip_idx];
+	if (clip.owns_preload || !_library) {
+		return;
+	}
+
+	// The rest of the stream picks it up in update_streams()
+	clip.preload = _preload(clip.song_id, clip.first_frame,
+		_preload_num_frames_for(stream_first_clip_idx));
+	clip.owns_preload = true;
+}
+
+void IOTrack::evict_preload(unsigned int stream_first_clip_idx)
+{
+	AudioClip &clip = _clips[stream_first_clip_idx];
+	if (!clip.owns_preload) {
+		return;
+	}
+
+	_retire_preload(clip);
+	_num_preload_evictions.add(1);
 }
 
 unsigned int IOTrack::num_clips()
@@ -166,30 +244,238 @@ bool IOTrack::is_clip_valid(unsigned int clip_idx)
 	return clip_idx < _clips.size();
 }
 
-AudioClipPreload IOTrack::_preload(unsigned int song_id, ma_uint64 first_frame)
+ma_uint64 IOTrack::get_num_preloads()
+{
+	return _num_preloads.get();
+}
+
+ma_uint64 IOTrack::get_num_preload_bytes()
+{
+	return _num_preload_bytes.get();
+}
+
+ma_uint64 IOTrack::get_num_preload_evictions()
+{
+	return _num_preload_evictions.get();
+}
+
+AudioClipPreload IOTrack::_preload(unsigned int song_id, ma_uint64 first_frame,
+	ma_uint64 preload_num_frames)
 {
 	AudioClipPreload result;
+	result.want_num_frames = preload_num_frames;
+
+	bool timing = _preload_timing && _preload_timing->is_enabled();
+	ma_uint64 start = timing ? TimingHistogram::now() : 0;
+	trace(_tracer, TraceEventType::PRELOAD_BEGIN, TRACE_NO_IDX, _track_idx,
+		static_cast<double>(song_id));
+
+	// Mono songs are kept mono (see stored_num_channels())
+	ma_uint32 num_channels = stored_num_channels(
+		_library->num_channels(song_id), _preload_num_channels);
+
+	// Songs already in memory in the stored format are preloaded by
+	// pointing the preload into the song instead of reading anything
+	ma_uint64 song_num_frames = 0;
+	const float *song_frames = _library->pcm_frames(song_id, num_channels,
+		_preload_sample_rate, song_num_frames);
+
+	if (song_frames) {
+		if (first_frame <= song_num_frames) {
+			ma_uint64 num_frames = song_num_frames - first_frame;
+			if (num_frames > preload_num_frames) {
+				num_frames = preload_num_frames;
+			}
 
-	ma_decoder_config decoder_cfg = ma_decoder_config_init(ma_format_f32,
-		_preload_num_channels, _preload_sample_rate);
+			result.num_channels = num_channels;
+			result.sample_rate = _preload_sample_rate;
+			result.first_frame = first_frame;
+			result.num_frames = num_frames;
+			// The AudioEngine only ever reads preloads
+			result.frames = const_cast<float *>(song_frames +
+				first_frame * num_channels);
+			result.storage = SampleStorage::F32;
+			result.borrowed = true;
+
+			_num_preloads.add(1);
+		}
+	} else {
+		std::unique_ptr<AudioSourceReader> reader =
+			_library->open_song(song_id, num_channels,
+				_preload_sample_rate);
+		if (reader && reader->seek(first_frame)) {
+			// Don't allocate past the end of the song, if the
+			// reader knows where that is
+			ma_uint64 length = reader->get_length();
+			if (length > first_frame &&
+				length - first_frame < preload_num_frames) {
+				preload_num_frames = length - first_frame;
+			}
 
-	ma_decoder decoder;
-	if (ma_decoder_init_file(_library->filename(song_id).c_str(),
-		&decoder_cfg, &decoder) == MA_SUCCESS) {
-		if (ma_decoder_seek_to_pcm_frame(&decoder, first_frame) ==
-			MA_SUCCESS) {
-			result.num_channels = _preload_num_channels;
+			result.num_channels = num_channels;
 			result.sample_rate = _preload_sample_rate;
 			result.first_frame = first_frame;
-			result.frames = new float[PRELOAD_NUM_FRAMES *
-				_preload_num_channels];
-			result.num_frames = ma_decoder_read_pcm_frames(&decoder,
-				result.frames, PRELOAD_NUM_FRAMES);
+			ma_uint64 num_samples = preload_num_frames *
+				num_channels;
+			result.storage = _preload_storage;
+			result.frames = allocate_samples(result.storage,
+				num_samples);
+			result.num_bytes = num_samples *
+				sample_storage_num_bytes(result.storage);
+			result.num_frames = read_samples(*reader,
+				result.frames, result.storage,
+				preload_num_frames, num_channels, _scratch);
+
+			_num_preloads.add(1);
+			_num_preload_bytes.add(result.num_bytes);
 		}
+	}
 
-		ma_decoder_uninit(&decoder);
+	if (timing) {
+		_preload_timing->record(TimingHistogram::now() - start);
 	}
+	trace(_tracer, TraceEventType::PRELOAD_END, TRACE_NO_IDX, _track_idx,
+		static_cast<double>(result.num_frames));
 
 	return result;
 }
+
+// The stream's first clip's own preload length if it has one, otherwise its
+// song's, otherwise the World's, but no more than the stream can play
+ma_uint64 IOTrack::_preload_num_frames_for(unsigned int stream_first_clip_idx)
+{
+	const AudioClip &first = _clips[stream_first_clip_idx];
+
+	ma_uint64 num_frames = _preload_num_frames;
+	double seconds = first.preload_seconds;
+	if (seconds <= 0.0) {
+		seconds = _library->preload_seconds(first.song_id);
+	}
+	if (seconds > 0.0) {
+		num_frames = seconds_to_frames(seconds, _preload_sample_rate);
+	}
+
+	double stream_end = first.end;
+	for (unsigned int i = stream_first_clip_idx + 1; i < _clips.size() &&
+		_clips[i].stream_first_clip_idx == stream_first_clip_idx; ++i) {
+		stream_end = _clips[i].end;
+	}
+
+	ma_uint64 stream_num_frames = _library->beats_to_out_samples(
+		first.song_id, stream_end - first.stream_start) +
+		seconds_to_frames(_PRELOAD_MARGIN_SECONDS,
+			_preload_sample_rate);
+	if (stream_num_frames < num_frames) {
+		num_frames = stream_num_frames;
+	}
+
+	return num_frames;
+}
+
+void IOTrack::update_streams()
+{
+	for (unsigned int i = 0; i < _clips.size(); ++i) {
+		AudioClip &clip = _clips[i];
+
+		if (i > 0 && _continues_stream(_clips[i - 1], clip)) {
+			const AudioClip &prev = _clips[i - 1];
+
+			// This clip's own preload would be redundant with the
+			// one at the beginning of the stream
+			_retire_preload(clip);
+
+			clip.stream_start = prev.stream_start;
+			clip.stream_first_frame = prev.stream_first_frame;
+			clip.stream_first_clip_idx = prev.stream_first_clip_idx;
+		} else {
+			clip.stream_start = clip.start;
+			clip.stream_first_frame = clip.first_frame;
+			clip.stream_first_clip_idx = i;
+		}
+	}
+
+	// Preloads are only made once every stream's extent is known, since
+	// each is sized to fit its stream
+	for (unsigned int i = 0; i < _clips.size(); ++i) {
+		AudioClip &clip = _clips[i];
+
+		unsigned int first_idx = clip.stream_first_clip_idx;
+		if (first_idx != i) {
+			clip.preload = _clips[first_idx].preload;
+		} else if (clip.owns_preload) {
+			// A stream that has grown since its preload was made
+			// (e.g. by a clip inserted right after it) needs a
+			// longer one. It was resident, so it's made again right
+			// away even while preloads are managed.
+			ma_uint64 num_frames = _library ?
+				_preload_num_frames_for(i) : 0;
+			if (num_frames > clip.preload.want_num_frames) {
+				_retire_preload(clip);
+				clip.preload = _preload(clip.song_id,
+					clip.first_frame, num_frames);
+				clip.owns_preload = true;
+			}
+		} else {
+			clip.preload = AudioClipPreload();
+			if (_preloads_managed) {
+				// Waits for materialize_preload()
+				continue;
+			}
+
+			if (_library) {
+				clip.preload = _preload(clip.song_id,
+					clip.first_frame,
+					_preload_num_frames_for(i));
+			}
+			clip.owns_preload = true;
+		}
+	}
+}
+
+void IOTrack::_bake_render_info()
+{
+	for (AudioClip &clip : _clips) {
+		clip.song_bpm = 0.0;
+		clip.beats_to_out_frames_factor = 0.0;
+		if (_library) {
+			clip.song_bpm = _library->bpm(clip.song_id);
+			clip.beats_to_out_frames_factor =
+				_library->beats_to_out_samples_factor(
+					clip.song_id);
+		}
+
+		clip.inv_fade_in = clip.fade_in > 0.0 ? 1.0 / clip.fade_in :
+			0.0;
+		clip.inv_fade_out = clip.fade_out > 0.0 ?
+			1.0 / clip.fade_out : 0.0;
+	}
+}
+
+bool IOTrack::_continues_stream(const AudioClip &prev, const AudioClip &clip)
+{
+	if (!_library || clip.song_id != prev.song_id ||
+		clip.pitch_shift != prev.pitch_shift ||
+		std::abs(clip.start - prev.end) > _STREAM_MAX_BEAT_GAP) {
+		return false;
+	}
+
+	ma_uint64 expect_first_frame = prev.stream_first_frame +
+		_library->beats_to_out_samples(clip.song_id,
+			clip.start - prev.stream_start);
+	ma_uint64 drift = clip.first_frame > expect_first_frame ?
+		clip.first_frame - expect_first_frame :
+		expect_first_frame - clip.first_frame;
+
+	return drift <= _STREAM_MAX_FRAME_DRIFT;
+}
+
+void IOTrack::_retire_preload(AudioClip &clip)
+{
+	if (clip.owns_preload && !clip.preload.borrowed) {
+		_old_preloads.push_back(clip.preload);
+	}
+
+	clip.preload = AudioClipPreload();
+	clip.owns_preload = false;
+}
 }
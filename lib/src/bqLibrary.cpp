@@ -11,9 +11,77 @@ unsigned int Library::add_song(const std::string &filename, double sample_rate,
 {
 	_songs.push_back(LibrarySongInfo(filename, sample_rate,
 		_out_sample_rate, bpm));
+	_songs.back().set_source(std::make_shared<MiniaudioFileSource>(
+		filename));
+	_set_native_num_channels(_songs.back());
 	return static_cast<unsigned int>(_songs.size()) - 1;
 }
 
+unsigned int Library::add_song(const float *frames, ma_uint64 num_frames,
+	ma_uint32 num_channels, double sample_rate, double bpm, bool copy)
+{
+	std::shared_ptr<const void> owner;
+	if (copy) {
+		std::shared_ptr<std::vector<float>> copied =
+			std::make_shared<std::vector<float>>(frames, frames +
+				num_frames * num_channels);
+		frames = copied->data();
+		owner = copied;
+	}
+
+	_songs.push_back(LibrarySongInfo(std::string(), sample_rate,
+		_out_sample_rate, bpm));
+	_songs.back().set_source(std::make_shared<PcmMemorySource>(frames,
+		num_frames, num_channels, static_cast<ma_uint32>(sample_rate),
+		owner));
+	_songs.back().set_num_channels(num_channels);
+	return static_cast<unsigned int>(_songs.size()) - 1;
+}
+
+unsigned int Library::add_song(const void *data, size_t num_bytes,
+	double sample_rate, double bpm, bool copy)
+{
+	std::shared_ptr<const void> owner;
+	if (copy) {
+		const unsigned char *bytes =
+			static_cast<const unsigned char *>(data);
+		std::shared_ptr<std::vector<unsigned char>> copied =
+			std::make_shared<std::vector<unsigned char>>(bytes,
+				bytes + num_bytes);
+		data = copied->data();
+		owner = copied;
+	}
+
+	_songs.push_back(LibrarySongInfo(std::string(), sample_rate,
+		_out_sample_rate, bpm));
+	_songs.back().set_source(std::make_shared<MiniaudioMemorySource>(
+		data, num_bytes, owner));
+	_set_native_num_channels(_songs.back());
+	return static_cast<unsigned int>(_songs.size()) - 1;
+}
+
+unsigned int Library::add_song(std::shared_ptr<const AudioSource> source,
+	double bpm)
+{
+	ma_uint32 num_channels = 0, sample_rate = 0;
+	if (source) {
+		source->get_native_format(num_channels, sample_rate);
+	}
+
+	_songs.push_back(LibrarySongInfo(std::string(), sample_rate,
+		_out_sample_rate, bpm));
+	_songs.back().set_source(source);
+	_songs.back().set_num_channels(num_channels);
+	return static_cast<unsigned int>(_songs.size()) - 1;
+}
+
+void Library::set_preload_seconds(unsigned int song_id, double preload_seconds)
+{
+	if (is_song_id_valid(song_id)) {
+		_songs[song_id].set_preload_seconds(preload_seconds);
+	}
+}
+
 double Library::sample_rate(unsigned int song_id) const
 {
 	if (is_song_id_valid(song_id)) {
@@ -32,6 +100,24 @@ double Library::bpm(unsigned int song_id) const
 	}
 }
 
+double Library::preload_seconds(unsigned int song_id) const
+{
+	if (is_song_id_valid(song_id)) {
+		return _songs[song_id].get_preload_seconds();
+	} else {
+		return 0.0;
+	}
+}
+
+ma_uint32 Library::num_channels(unsigned int song_id) const
+{
+	if (is_song_id_valid(song_id)) {
+		return _songs[song_id].get_num_channels();
+	} else {
+		return 0;
+	}
+}
+
 ma_uint64 Library::beats_to_samples(unsigned int song_id, double beats) const
 {
 	if (is_song_id_valid(song_id)) {
@@ -70,6 +156,15 @@ const
 	}
 }
 
+double Library::beats_to_out_samples_factor(unsigned int song_id) const
+{
+	if (is_song_id_valid(song_id)) {
+		return _songs[song_id].get_beats_to_out_samples_factor();
+	} else {
+		return 0.0;
+	}
+}
+
 ma_uint64 Library::samples_self2out(unsigned int song_id,
 	ma_uint64 self_samples) const
 {
@@ -90,12 +185,12 @@ const
 	}
 }
 
-const std::string Library::filename(unsigned int song_id) const
+const std::string &Library::filename(unsigned int song_id) const
 {
 	if (is_song_id_valid(song_id)) {
 		return _songs[song_id].get_filename();
 	} else {
-		return "";
+		return _empty_filename;
 	}
 }
 
@@ -103,4 +198,67 @@ bool Library::is_song_id_valid(unsigned int song_id) const
 {
 	return song_id < _songs.size();
 }
+
+const AudioSource *Library::source(unsigned int song_id) const
+{
+	if (is_song_id_valid(song_id)) {
+		return _songs[song_id].get_source();
+	} else {
+		return nullptr;
+	}
+}
+
+std::unique_ptr<AudioSourceReader> Library::open_song(unsigned int song_id,
+	ma_uint32 num_channels, ma_uint32 sample_rate) const
+{
+	const AudioSource *song_source = source(song_id);
+	if (!song_source) {
+		return nullptr;
+	}
+
+	// Songs that are already in memory gain nothing from being cached
+	if (_decoded_song_cache &&
+		song_source->get_cost_hint() != AudioSourceCost::MEMORY) {
+		std::shared_ptr<const DecodedSong> cached =
+			_decoded_song_cache->get(*song_source, song_id,
+				num_channels, sample_rate);
+		if (cached) {
+			return std::unique_ptr<AudioSourceReader>(
+				new PcmMemoryReader(cached->frames.data(),
+					cached->num_frames, num_channels,
+					cached));
+		}
+	}
+
+	return song_source->open(num_channels, sample_rate);
+}
+
+const float *Library::pcm_frames(unsigned int song_id, ma_uint32 num_channels,
+	ma_uint32 sample_rate, ma_uint64 &num_frames) const
+{
+	num_frames = 0;
+
+	const AudioSource *song_source = source(song_id);
+	if (!song_source) {
+		return nullptr;
+	}
+
+	return song_source->get_frames(num_channels, sample_rate, num_frames);
+}
+
+void Library::bind_decoded_song_cache(DecodedSongCache *cache)
+{
+	_decoded_song_cache = cache;
+}
+
+// Only the file's header is read, so this is cheap even for long songs
+void Library::_set_native_num_channels(LibrarySongInfo &song)
+{
+	ma_uint32 num_channels = 0, sample_rate = 0;
+	const AudioSource *song_source = song.get_source();
+	if (song_source && song_source->get_native_format(num_channels,
+		sample_rate)) {
+		song.set_num_channels(num_channels);
+	}
+}
 }
@@ -34,6 +34,11 @@ void LibrarySongInfo::set_bpm(double bpm)
 	_recalc_conversion_factors();
 }
 
+void LibrarySongInfo::set_source(std::shared_ptr<const AudioSource> source)
+{
+	_source = source;
+}
+
 const std::string &LibrarySongInfo::get_filename() const
 {
 	return _filename;
@@ -49,6 +54,31 @@ double LibrarySongInfo::get_bpm() const
 	return _bpm;
 }
 
+void LibrarySongInfo::set_preload_seconds(double preload_seconds)
+{
+	_preload_seconds = preload_seconds;
+}
+
+double LibrarySongInfo::get_preload_seconds() const
+{
+	return _preload_seconds;
+}
+
+void LibrarySongInfo::set_num_channels(ma_uint32 num_channels)
+{
+	_num_channels = num_channels;
+}
+
+ma_uint32 LibrarySongInfo::get_num_channels() const
+{
+	return _num_channels;
+}
+
+const AudioSource *LibrarySongInfo::get_source() const
+{
+	return _source.get();
+}
+
 ma_uint64 LibrarySongInfo::beats_to_samples(double beats) const
 {
 	if (beats < 0.0) {
@@ -77,6 +107,11 @@ double LibrarySongInfo::out_samples_to_beats(double out_samples) const
 	return out_samples * _out_samples_to_beats;
 }
 
+double LibrarySongInfo::get_beats_to_out_samples_factor() const
+{
+	return _beats_to_out_samples;
+}
+
 ma_uint64 LibrarySongInfo::samples_self2out(ma_uint64 self_samples) const
 {
 	return static_cast<ma_uint64>(static_cast<double>(self_samples) *
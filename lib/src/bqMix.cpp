@@ -0,0 +1,167 @@
+#include "bqMix.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace bq {
+// Samples summed at a time before they're converted; small enough to stay on
+// the stack and in the L1 cache, so the conversion doesn't cost another pass
+// over memory
+static constexpr ma_uint64 MIX_BLOCK_NUM_SAMPLES = 256;
+
+static constexpr float S16_SCALE = 32768.0f;
+static constexpr float S24_SCALE = 8388608.0f;
+static constexpr double S32_SCALE = 2147483648.0;
+
+static float clamp(float x, float a, float b)
+{
+	return (x < a) ? a : (x > b) ? b : x;
+}
+
+// NaN gets past clamp(), and converting it to an integer is undefined
+static float nan_to_zero(float x)
+{
+	return std::isnan(x) ? 0.0f : x;
+}
+
+size_t mix_format_num_bytes(MixFormat format)
+{
+	switch (format) {
+	case MixFormat::S16:
+		return 2;
+
+	case MixFormat::S24:
+		return 3;
+
+	default:
+		return 4;
+	}
+}
+
+ma_format mix_format_to_ma_format(MixFormat format)
+{
+	switch (format) {
+	case MixFormat::S16:
+		return ma_format_s16;
+
+	case MixFormat::S24:
+		return ma_format_s24;
+
+	case MixFormat::S32:
+		return ma_format_s32;
+
+	default:
+		return ma_format_f32;
+	}
+}
+
+MixDither::MixDither(std::uint32_t seed)
+{
+	// Xorshift never leaves 0
+	_state = seed ? seed : 1;
+}
+
+float MixDither::next()
+{
+	return _next_uniform() + _next_uniform() - 1.0f;
+}
+
+// In [0, 1)
+float MixDither::_next_uniform()
+{
+	_state ^= _state << 13;
+	_state ^= _state >> 17;
+	_state ^= _state << 5;
+
+	return static_cast<float>(_state >> 8) * (1.0f / 16777216.0f);
+}
+
+static void store_s16(std::int16_t *dest, const float *src,
+	ma_uint64 num_samples, MixDither &dither)
+{
+	for (ma_uint64 i = 0; i < num_samples; ++i) {
+		float scaled = clamp(nan_to_zero(src[i]) * S16_SCALE +
+			dither.next(), -32768.0f, 32767.0f);
+		dest[i] = static_cast<std::int16_t>(std::lrint(scaled));
+	}
+}
+
+static void store_s24(unsigned char *dest, const float *src,
+	ma_uint64 num_samples, MixDither &dither)
+{
+	for (ma_uint64 i = 0; i < num_samples; ++i) {
+		float scaled = clamp(nan_to_zero(src[i]) * S24_SCALE +
+			dither.next(), -8388608.0f, 8388607.0f);
+		std::int32_t value = static_cast<std::int32_t>(
+			std::lrint(scaled));
+		dest[i * 3] = static_cast<unsigned char>(value);
+		dest[i * 3 + 1] = static_cast<unsigned char>(value >> 8);
+		dest[i * 3 + 2] = static_cast<unsigned char>(value >> 16);
+	}
+}
+
+static void store_s32(std::int32_t *dest, const float *src,
+	ma_uint64 num_samples)
+{
+	for (ma_uint64 i = 0; i < num_samples; ++i) {
+		double scaled = static_cast<double>(nan_to_zero(src[i])) *
+			S32_SCALE;
+		if (scaled < -2147483648.0) {
+			scaled = -2147483648.0;
+		} else if (scaled > 2147483647.0) {
+			scaled = 2147483647.0;
+		}
+		dest[i] = static_cast<std::int32_t>(std::llrint(scaled));
+	}
+}
+
+void mix_samples(void *dest, MixFormat format, const float *const *srcs,
+	unsigned int num_srcs, ma_uint64 num_samples, MixDither &dither)
+{
+	float block[MIX_BLOCK_NUM_SAMPLES];
+
+	for (ma_uint64 i = 0; i < num_samples; i += MIX_BLOCK_NUM_SAMPLES) {
+		ma_uint64 n = num_samples - i;
+		if (n > MIX_BLOCK_NUM_SAMPLES) {
+			n = MIX_BLOCK_NUM_SAMPLES;
+		}
+
+		// Float mixes are summed straight into dest
+		float *sum = format == MixFormat::F32 ?
+			static_cast<float *>(dest) + i : block;
+
+		// One source at a time, so that every pass is a plain add
+		if (num_srcs < 1) {
+			std::memset(sum, 0, n * sizeof(float));
+		} else {
+			std::memcpy(sum, srcs[0] + i, n * sizeof(float));
+		}
+		for (unsigned int j = 1; j < num_srcs; ++j) {
+			const float *src = srcs[j] + i;
+			for (ma_uint64 k = 0; k < n; ++k) {
+				sum[k] += src[k];
+			}
+		}
+
+		switch (format) {
+		case MixFormat::S16:
+			store_s16(static_cast<std::int16_t *>(dest) + i, sum, n,
+				dither);
+			break;
+
+		case MixFormat::S24:
+			store_s24(static_cast<unsigned char *>(dest) + i * 3,
+				sum, n, dither);
+			break;
+
+		case MixFormat::S32:
+			store_s32(static_cast<std::int32_t *>(dest) + i, sum,
+				n);
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+}
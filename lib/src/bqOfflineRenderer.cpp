@@ -0,0 +1,186 @@
+#include "bqOfflineRenderer.h"
+
+#include <cmath>
+#include <vector>
+
+namespace bq {
+OfflineRenderer::OfflineRenderer(World *world)
+{
+	_world = world;
+}
+
+bool OfflineRenderer::render(unsigned int playhead_idx, double from_beat,
+	double to_beat, const BlockCallback &callback)
+{
+	if (!callback) {
+		return false;
+	}
+
+	return _render(playhead_idx, from_beat, to_beat, MixFormat::F32,
+		[&callback](const void *mix, const float *const *tracks,
+			ma_uint64 num_frames) {
+			return callback(static_cast<const float *>(mix), tracks,
+				num_frames);
+		});
+}
+
+bool OfflineRenderer::_render(unsigned int playhead_idx, double from_beat,
+	double to_beat, MixFormat format, const _MixBlockCallback &callback)
+{
+	if (!_world || !callback ||
+		playhead_idx >= _world->get_num_playheads() ||
+		to_beat <= from_beat) {
+		return false;
+	}
+
+	unsigned int num_tracks = _world->get_num_tracks();
+
+	ma_uint64 num_channels = _world->get_num_channels();
+	double sample_rate = static_cast<double>(_world->get_sample_rate());
+	if (num_channels < 1 || sample_rate <= 0.0) {
+		return false;
+	}
+
+	_world->set_offline_rendering(true);
+	_world->set_playhead_beat(playhead_idx, from_beat);
+	for (unsigned int i = 0; i < _NUM_SETTLE_PUMPS; ++i) {
+		_pump(playhead_idx);
+	}
+
+	// Any tempo change made beforehand has been applied by now
+	double bpm = _world->get_bpm();
+	ma_uint64 total_num_frames = static_cast<ma_uint64>(std::llround(
+		(to_beat - from_beat) * 60.0 / bpm * sample_rate));
+
+	ma_uint64 block_num_samples = _BLOCK_NUM_FRAMES * num_channels;
+	std::vector<unsigned char> mix(block_num_samples *
+		mix_format_num_bytes(format));
+	std::vector<float> tracks(block_num_samples * num_tracks);
+	std::vector<const float *> track_ptrs(num_tracks);
+	for (unsigned int i = 0; i < num_tracks; ++i) {
+		track_ptrs[i] = tracks.data() + i * block_num_samples;
+	}
+	// Seeded the same way every time, so that renders stay deterministic
+	MixDither dither;
+
+	bool completed = true;
+
+	ma_uint64 num_rendered = 0;
+	while (num_rendered < total_num_frames) {
+		ma_uint64 num_frames = total_num_frames - num_rendered;
+		if (num_frames > _BLOCK_NUM_FRAMES) {
+			num_frames = _BLOCK_NUM_FRAMES;
+		}
+		ma_uint64 num_samples = num_frames * num_channels;
+
+		_pump(playhead_idx);
+
+		for (unsigned int i = 0; i < num_tracks; ++i) {
+			float *track = tracks.data() + i * block_num_samples;
+			_world->pull_audio(playhead_idx, i, track, num_frames);
+		}
+		_world->pull_done_advance_playhead(playhead_idx, num_frames);
+
+		mix_samples(mix.data(), format, track_ptrs.data(), num_tracks,
+			num_samples, dither);
+
+		if (!callback(mix.data(), track_ptrs.data(), num_frames)) {
+			completed = false;
+			break;
+		}
+
+		num_rendered += num_frames;
+	}
+
+	_world->set_offline_rendering(false);
+
+	return completed;
+}
+
+bool OfflineRenderer::render_mix(unsigned int playhead_idx, double from_beat,
+	double to_beat, const std::string &filename, MixFormat format)
+{
+	if (!_world) {
+		return false;
+	}
+
+	ma_encoder_config encoder_cfg = ma_encoder_config_init(
+		ma_resource_format_wav, mix_format_to_ma_format(format),
+		_world->get_num_channels(), _world->get_sample_rate());
+
+	ma_encoder encoder;
+	if (ma_encoder_init_file(filename.c_str(), &encoder_cfg, &encoder) !=
+		MA_SUCCESS) {
+		return false;
+	}
+
+	bool result = _render(playhead_idx, from_beat, to_beat, format,
+		[&encoder](const void *mix, const float *const *,
+			ma_uint64 num_frames) {
+			return ma_encoder_write_pcm_frames(&encoder, mix,
+				num_frames) == num_frames;
+		});
+
+	ma_encoder_uninit(&encoder);
+
+	return result;
+}
+
+bool OfflineRenderer::render_stems(unsigned int playhead_idx, double from_beat,
+	double to_beat, const std::string &filename_prefix)
+{
+	if (!_world) {
+		return false;
+	}
+
+	ma_encoder_config encoder_cfg = ma_encoder_config_init(
+		ma_resource_format_wav, ma_format_f32,
+		_world->get_num_channels(), _world->get_sample_rate());
+
+	unsigned int num_tracks = _world->get_num_tracks();
+	std::vector<ma_encoder> encoders(num_tracks);
+	unsigned int num_encoders = 0;
+	for (; num_encoders < num_tracks; ++num_encoders) {
+		std::string filename = filename_prefix +
+			std::to_string(num_encoders) + ".wav";
+		if (ma_encoder_init_file(filename.c_str(), &encoder_cfg,
+			&encoders[num_encoders]) != MA_SUCCESS) {
+			break;
+		}
+	}
+
+	bool result = false;
+	if (num_encoders == num_tracks) {
+		result = render(playhead_idx, from_beat, to_beat,
+			[&encoders](const float *, const float *const *tracks,
+				ma_uint64 num_frames) {
+				for (size_t i = 0; i < encoders.size(); ++i) {
+					if (ma_encoder_write_pcm_frames(
+						&encoders[i], tracks[i],
+						num_frames) != num_frames) {
+						return false;
+					}
+				}
+				return true;
+			});
+	}
+
+	for (unsigned int i = 0; i < num_encoders; ++i) {
+		ma_encoder_uninit(&encoders[i]);
+	}
+
+	return result;
+}
+
+// Does one round of the IO thread's and then the audio thread's work
+void OfflineRenderer::_pump(unsigned int playhead_idx)
+{
+	// Named before the pumps can name it after either engine
+	_world->name_trace_thread("offline");
+	_world->pump_io_thread();
+	for (unsigned int i = 0; i < _world->get_num_tracks(); ++i) {
+		_world->decode_chunks(playhead_idx, i);
+	}
+	_world->pump_audio_thread();
+}
+}
@@ -0,0 +1,116 @@
+#include "bqPlayheadRing.h"
+
+namespace bq {
+PlayheadRing::~PlayheadRing()
+{
+	deallocate();
+}
+
+void PlayheadRing::allocate(ma_uint32 num_channels, unsigned int num_slots,
+	ma_uint64 slot_num_frames, SampleStorage storage)
+{
+	deallocate();
+
+	_num_slots = num_slots;
+	_slot_num_frames = slot_num_frames;
+
+	if (_num_slots > 0) {
+		_slots = new PlayheadChunk[_num_slots];
+		_frames = allocate_samples(storage, _num_slots *
+			_slot_num_frames * num_channels);
+
+		for (unsigned int i = 0; i < _num_slots; ++i) {
+			PlayheadChunk &slot = _slots[i];
+			slot.next = nullptr;
+			slot.num_channels = num_channels;
+			slot.sample_rate = 0;
+			slot.first_frame = 0;
+			slot.num_frames = 0;
+			slot.frames = sample_at(_frames, storage,
+				i * _slot_num_frames * num_channels);
+			slot.storage = storage;
+			slot.owns_frames = true;
+			slot.song_id = 0;
+		}
+	}
+}
+
+void PlayheadRing::deallocate()
+{
+	if (_slots) {
+		delete[] _slots;
+		_slots = nullptr;
+	}
+
+	if (_frames) {
+		free_samples(_frames);
+		_frames = nullptr;
+	}
+
+	_num_slots = 0;
+	_slot_num_frames = 0;
+	_write_idx = 0;
+	_read_idx = 0;
+}
+
+bool PlayheadRing::is_allocated()
+{
+	return _slots != nullptr;
+}
+
+ma_uint64 PlayheadRing::slot_num_frames()
+{
+	return _slot_num_frames;
+}
+
+PlayheadChunk *PlayheadRing::begin_write()
+{
+	ma_uint64 write_idx = _write_idx.load(std::memory_order_relaxed);
+	ma_uint64 read_idx = _read_idx.load(std::memory_order_acquire);
+
+	if (!_slots || write_idx - read_idx >= _num_slots) {
+		return nullptr;
+	}
+
+	return &_slots[write_idx % _num_slots];
+}
+
+void PlayheadRing::end_write()
+{
+	_write_idx.store(_write_idx.load(std::memory_order_relaxed) + 1,
+		std::memory_order_release);
+}
+
+PlayheadChunk *PlayheadRing::front()
+{
+	ma_uint64 read_idx = _read_idx.load(std::memory_order_relaxed);
+	ma_uint64 write_idx = _write_idx.load(std::memory_order_acquire);
+
+	if (!_slots || read_idx == write_idx) {
+		return nullptr;
+	}
+
+	return &_slots[read_idx % _num_slots];
+}
+
+void PlayheadRing::pop()
+{
+	ma_uint64 read_idx = _read_idx.load(std::memory_order_relaxed);
+	if (read_idx != _write_idx.load(std::memory_order_acquire)) {
+		_read_idx.store(read_idx + 1, std::memory_order_release);
+	}
+}
+
+void PlayheadRing::pop_all()
+{
+	_read_idx.store(_write_idx.load(std::memory_order_acquire),
+		std::memory_order_release);
+}
+
+ma_uint64 PlayheadRing::num_filled()
+{
+	ma_uint64 read_idx = _read_idx.load(std::memory_order_acquire);
+	ma_uint64 write_idx = _write_idx.load(std::memory_order_acquire);
+	return write_idx > read_idx ? write_idx - read_idx : 0;
+}
+}
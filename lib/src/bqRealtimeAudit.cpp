@@ -0,0 +1,426 @@
+#include "bqRealtimeAudit.h"
+
+#ifdef BQ_REALTIME_AUDIT
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#include <unistd.h>
+#endif
+
+namespace bq {
+namespace {
+thread_local unsigned int audio_thread_depth = 0;
+// Set while a violation is being reported or while an audited function calls
+// through to another audited function, so that each violation is only counted
+// once
+thread_local bool suppressed = false;
+
+std::atomic<ma_uint64> num_allocations(0);
+std::atomic<ma_uint64> num_deallocations(0);
+std::atomic<ma_uint64> num_blocking_calls(0);
+std::atomic<bool> print_stack_traces(false);
+
+const char *violation_name(RealtimeAuditViolation violation)
+{
+	switch (violation) {
+	case RealtimeAuditViolation::ALLOCATION:
+		return "allocation";
+
+	case RealtimeAuditViolation::DEALLOCATION:
+		return "deallocation";
+
+	case RealtimeAuditViolation::BLOCKING_CALL:
+		return "blocking call";
+
+	default:
+		return "violation";
+	}
+}
+}
+
+RealtimeAuditScope::RealtimeAuditScope()
+{
+	++audio_thread_depth;
+}
+
+RealtimeAuditScope::~RealtimeAuditScope()
+{
+	--audio_thread_depth;
+}
+
+bool realtime_audit_is_audio_thread()
+{
+	return audio_thread_depth > 0;
+}
+
+void realtime_audit_report_violation(RealtimeAuditViolation violation,
+	const char *what)
+{
+	if (audio_thread_depth == 0 || suppressed) {
+		return;
+	}
+
+	switch (violation) {
+	case RealtimeAuditViolation::ALLOCATION:
+		++num_allocations;
+		break;
+
+	case RealtimeAuditViolation::DEALLOCATION:
+		++num_deallocations;
+		break;
+
+	case RealtimeAuditViolation::BLOCKING_CALL:
+		++num_blocking_calls;
+		break;
+
+	default:
+		break;
+	}
+
+	if (print_stack_traces) {
+		suppressed = true;
+
+		std::fprintf(stderr, "bquence realtime audit: %s (%s) on the "
+			"audio thread\n", violation_name(violation), what);
+#if defined(__GLIBC__)
+		void *frames[64];
+		int num_frames = backtrace(frames, 64);
+		backtrace_symbols_fd(frames, num_frames, STDERR_FILENO);
+#endif
+
+		suppressed = false;
+	}
+}
+
+RealtimeAuditReport realtime_audit_get_report()
+{
+	RealtimeAuditReport report;
+	report.num_allocations = num_allocations;
+	report.num_deallocations = num_deallocations;
+	report.num_blocking_calls = num_blocking_calls;
+	return report;
+}
+
+void realtime_audit_reset()
+{
+	num_allocations = 0;
+	num_deallocations = 0;
+	num_blocking_calls = 0;
+}
+
+void realtime_audit_set_print_stack_traces(bool print)
+{
+#if defined(__GLIBC__)
+	// backtrace() loads libgcc and allocates the first time it's called,
+	// so get that out of the way now rather than while reporting
+	if (print) {
+		void *frames[1];
+		backtrace(frames, 1);
+	}
+#endif
+
+	print_stack_traces = print;
+}
+
+namespace {
+class SuppressScope {
+public:
+	SuppressScope() : _was_suppressed(suppressed)
+	{
+		suppressed = true;
+	}
+
+	~SuppressScope()
+	{
+		suppressed = _was_suppressed;
+	}
+
+private:
+	bool _was_suppressed;
+};
+}
+}
+
+//
+// Replacements for the global allocation functions
+//
+
+namespace {
+void *audited_alloc(std::size_t size, const char *what)
+{
+	bq::realtime_audit_report_violation(
+		bq::RealtimeAuditViolation::ALLOCATION, what);
+
+	bq::SuppressScope suppress;
+	return std::malloc(size > 0 ? size : 1);
+}
+
+void audited_free(void *ptr, const char *what)
+{
+	if (ptr) {
+		bq::realtime_audit_report_violation(
+			bq::RealtimeAuditViolation::DEALLOCATION, what);
+	}
+
+	bq::SuppressScope suppress;
+	std::free(ptr);
+}
+
+#if __cpp_aligned_new
+void *audited_aligned_alloc(std::size_t size, std::align_val_t align,
+	const char *what)
+{
+	bq::realtime_audit_report_violation(
+		bq::RealtimeAuditViolation::ALLOCATION, what);
+
+	std::size_t alignment = static_cast<std::size_t>(align);
+	if (alignment < sizeof(void *)) {
+		alignment = sizeof(void *);
+	}
+
+	bq::SuppressScope suppress;
+	void *ptr = nullptr;
+	if (posix_memalign(&ptr, alignment, size > 0 ? size : 1) != 0) {
+		ptr = nullptr;
+	}
+	return ptr;
+}
+#endif
+}
+
+void *operator new(std::size_t size)
+{
+	void *ptr = audited_alloc(size, "operator new");
+	if (!ptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void *operator new[](std::size_t size)
+{
+	void *ptr = audited_alloc(size, "operator new[]");
+	if (!ptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+	return audited_alloc(size, "operator new");
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+	return audited_alloc(size, "operator new[]");
+}
+
+void operator delete(void *ptr) noexcept
+{
+	audited_free(ptr, "operator delete");
+}
+
+void operator delete[](void *ptr) noexcept
+{
+	audited_free(ptr, "operator delete[]");
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+	audited_free(ptr, "operator delete");
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+	audited_free(ptr, "operator delete[]");
+}
+
+#if __cpp_aligned_new
+void *operator new(std::size_t size, std::align_val_t align)
+{
+	void *ptr = audited_aligned_alloc(size, align, "operator new");
+	if (!ptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void *operator new[](std::size_t size, std::align_val_t align)
+{
+	void *ptr = audited_aligned_alloc(size, align, "operator new[]");
+	if (!ptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+	audited_free(ptr, "operator delete");
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+	audited_free(ptr, "operator delete[]");
+}
+
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept
+{
+	audited_free(ptr, "operator delete");
+}
+
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept
+{
+	audited_free(ptr, "operator delete[]");
+}
+#endif
+
+//
+// C library wrappers
+//
+// These only take effect if the final executable is linked with:
+//
+//   -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+//   -Wl,--wrap=pthread_mutex_lock,--wrap=pthread_cond_wait
+//   -Wl,--wrap=nanosleep,--wrap=usleep,--wrap=sleep
+//   -Wl,--wrap=read,--wrap=write
+//   -Wl,--wrap=fopen,--wrap=fread,--wrap=fwrite,--wrap=fclose
+//
+#ifdef BQ_REALTIME_AUDIT_WRAP_LIBC
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+int __real_pthread_mutex_lock(pthread_mutex_t *mutex);
+int __real_pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+int __real_nanosleep(const struct timespec *req, struct timespec *rem);
+int __real_usleep(useconds_t usec);
+unsigned int __real_sleep(unsigned int seconds);
+ssize_t __real_read(int fd, void *buf, size_t count);
+ssize_t __real_write(int fd, const void *buf, size_t count);
+FILE *__real_fopen(const char *path, const char *mode);
+size_t __real_fread(void *ptr, size_t size, size_t num, FILE *stream);
+size_t __real_fwrite(const void *ptr, size_t size, size_t num,
+	FILE *stream);
+int __real_fclose(FILE *stream);
+
+static void report_allocation(const char *what)
+{
+	bq::realtime_audit_report_violation(
+		bq::RealtimeAuditViolation::ALLOCATION, what);
+}
+
+static void report_blocking_call(const char *what)
+{
+	bq::realtime_audit_report_violation(
+		bq::RealtimeAuditViolation::BLOCKING_CALL, what);
+}
+
+void *__wrap_malloc(size_t size)
+{
+	report_allocation("malloc");
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t num, size_t size)
+{
+	report_allocation("calloc");
+	return __real_calloc(num, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	report_allocation("realloc");
+	return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+	if (ptr) {
+		bq::realtime_audit_report_violation(
+			bq::RealtimeAuditViolation::DEALLOCATION, "free");
+	}
+	__real_free(ptr);
+}
+
+int __wrap_pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+	report_blocking_call("pthread_mutex_lock");
+	return __real_pthread_mutex_lock(mutex);
+}
+
+int __wrap_pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+	report_blocking_call("pthread_cond_wait");
+	return __real_pthread_cond_wait(cond, mutex);
+}
+
+int __wrap_nanosleep(const struct timespec *req, struct timespec *rem)
+{
+	report_blocking_call("nanosleep");
+	return __real_nanosleep(req, rem);
+}
+
+int __wrap_usleep(useconds_t usec)
+{
+	report_blocking_call("usleep");
+	return __real_usleep(usec);
+}
+
+unsigned int __wrap_sleep(unsigned int seconds)
+{
+	report_blocking_call("sleep");
+	return __real_sleep(seconds);
+}
+
+ssize_t __wrap_read(int fd, void *buf, size_t count)
+{
+	report_blocking_call("read");
+	return __real_read(fd, buf, count);
+}
+
+ssize_t __wrap_write(int fd, const void *buf, size_t count)
+{
+	report_blocking_call("write");
+	return __real_write(fd, buf, count);
+}
+
+FILE *__wrap_fopen(const char *path, const char *mode)
+{
+	report_blocking_call("fopen");
+	return __real_fopen(path, mode);
+}
+
+size_t __wrap_fread(void *ptr, size_t size, size_t num, FILE *stream)
+{
+	report_blocking_call("fread");
+	return __real_fread(ptr, size, num, stream);
+}
+
+size_t __wrap_fwrite(const void *ptr, size_t size, size_t num, FILE *stream)
+{
+	report_blocking_call("fwrite");
+	return __real_fwrite(ptr, size, num, stream);
+}
+
+int __wrap_fclose(FILE *stream)
+{
+	report_blocking_call("fclose");
+	return __real_fclose(stream);
+}
+}
+#endif
+
+#endif
@@ -0,0 +1,177 @@
+#include "bqRenderKernels.h"
+
+#include <cstring>
+
+namespace bq {
+// Mono frames converted at a time before they're copied to every channel;
+// small enough to stay on the stack and in the L1 cache
+static constexpr ma_uint64 MONO_BLOCK_NUM_FRAMES = 256;
+
+// NUM_CHANNELS is 0 for the generic kernels, which use num_channels instead;
+// the specialized ones ignore it, so their channel loops have constant bounds
+template<ma_uint32 NUM_CHANNELS>
+static void kernel_fill_silence(float *dest, ma_uint64 num_frames,
+	ma_uint32 num_channels)
+{
+	const ma_uint32 ch = NUM_CHANNELS ? NUM_CHANNELS : num_channels;
+
+	for (ma_uint64 i = 0; i < num_frames * ch; ++i) {
+		dest[i] = 0.0f;
+	}
+}
+
+template<ma_uint32 NUM_CHANNELS>
+static void kernel_apply_gains(float *dest, const float *gains,
+	ma_uint64 num_frames, ma_uint32 num_channels)
+{
+	const ma_uint32 ch = NUM_CHANNELS ? NUM_CHANNELS : num_channels;
+
+	for (ma_uint64 i = 0; i < num_frames; ++i) {
+		float gain = gains[i];
+		for (ma_uint32 j = 0; j < ch; ++j) {
+			dest[i * ch + j] *= gain;
+		}
+	}
+}
+
+template<ma_uint32 NUM_CHANNELS>
+static void kernel_load_frames(float *dest, const void *src,
+	SampleStorage storage, ma_uint32 src_num_channels,
+	ma_uint64 num_frames, ma_uint32 num_channels)
+{
+	const ma_uint32 ch = NUM_CHANNELS ? NUM_CHANNELS : num_channels;
+
+	if (src_num_channels == ch) {
+		load_samples(dest, src, storage, num_frames * ch);
+		return;
+	}
+
+	float block[MONO_BLOCK_NUM_FRAMES];
+	for (ma_uint64 i = 0; i < num_frames; i += MONO_BLOCK_NUM_FRAMES) {
+		ma_uint64 num_block_frames = num_frames - i;
+		if (num_block_frames > MONO_BLOCK_NUM_FRAMES) {
+			num_block_frames = MONO_BLOCK_NUM_FRAMES;
+		}
+
+		load_samples(block, sample_at(src, storage, i), storage,
+			num_block_frames);
+
+		float *out = dest + i * ch;
+		for (ma_uint64 j = 0; j < num_block_frames; ++j) {
+			for (ma_uint32 k = 0; k < ch; ++k) {
+				out[j * ch + k] = block[j];
+			}
+		}
+	}
+}
+
+template<ma_uint32 NUM_CHANNELS>
+static void kernel_deinterleave(float *const *dest_channels,
+	ma_uint64 first_frame, const float *src, ma_uint64 num_frames,
+	ma_uint32 num_channels)
+{
+	const ma_uint32 ch = NUM_CHANNELS ? NUM_CHANNELS : num_channels;
+
+	for (ma_uint64 i = 0; i < num_frames; ++i) {
+		for (ma_uint32 j = 0; j < ch; ++j) {
+			dest_channels[j][first_frame + i] = src[i * ch + j];
+		}
+	}
+}
+
+void RenderKernels::select(ma_uint32 num_channels, bool generic)
+{
+	_num_channels = num_channels;
+	_specialized = !generic;
+
+	switch (generic ? 0 : num_channels) {
+	case 1:
+		_fill_silence = kernel_fill_silence<1>;
+		_apply_gains = kernel_apply_gains<1>;
+		_load_frames = kernel_load_frames<1>;
+		_deinterleave = kernel_deinterleave<1>;
+		break;
+
+	case 2:
+		_fill_silence = kernel_fill_silence<2>;
+		_apply_gains = kernel_apply_gains<2>;
+		_load_frames = kernel_load_frames<2>;
+		_deinterleave = kernel_deinterleave<2>;
+		break;
+
+	case 4:
+		_fill_silence = kernel_fill_silence<4>;
+		_apply_gains = kernel_apply_gains<4>;
+		_load_frames = kernel_load_frames<4>;
+		_deinterleave = kernel_deinterleave<4>;
+		break;
+
+	case 6:
+		_fill_silence = kernel_fill_silence<6>;
+		_apply_gains = kernel_apply_gains<6>;
+		_load_frames = kernel_load_frames<6>;
+		_deinterleave = kernel_deinterleave<6>;
+		break;
+
+	case 8:
+		_fill_silence = kernel_fill_silence<8>;
+		_apply_gains = kernel_apply_gains<8>;
+		_load_frames = kernel_load_frames<8>;
+		_deinterleave = kernel_deinterleave<8>;
+		break;
+
+	default:
+		_fill_silence = kernel_fill_silence<0>;
+		_apply_gains = kernel_apply_gains<0>;
+		_load_frames = kernel_load_frames<0>;
+		_deinterleave = kernel_deinterleave<0>;
+		_specialized = false;
+		break;
+	}
+}
+
+void RenderKernels::fill_silence(const RenderDest &dest, ma_uint64 first_frame,
+	ma_uint64 num_frames) const
+{
+	if (!dest.channels) {
+		_fill_silence(dest.frames + first_frame * _num_channels,
+			num_frames, _num_channels);
+		return;
+	}
+
+	for (ma_uint32 i = 0; i < _num_channels; ++i) {
+		std::memset(dest.channels[i] + first_frame, 0,
+			num_frames * sizeof(float));
+	}
+}
+
+void RenderKernels::apply_gains(const RenderDest &dest, ma_uint64 first_frame,
+	const float *gains, ma_uint64 num_frames) const
+{
+	if (!dest.channels) {
+		_apply_gains(dest.frames + first_frame * _num_channels, gains,
+			num_frames, _num_channels);
+		return;
+	}
+
+	for (ma_uint32 i = 0; i < _num_channels; ++i) {
+		float *channel = dest.channels[i] + first_frame;
+		for (ma_uint64 j = 0; j < num_frames; ++j) {
+			channel[j] *= gains[j];
+		}
+	}
+}
+
+void RenderKernels::store_frames(const RenderDest &dest, ma_uint64 first_frame,
+	const float *src, ma_uint64 num_frames) const
+{
+	if (!dest.channels) {
+		std::memcpy(dest.frames + first_frame * _num_channels, src,
+			num_frames * _num_channels * sizeof(float));
+		return;
+	}
+
+	_deinterleave(dest.channels, first_frame, src, num_frames,
+		_num_channels);
+}
+}
@@ -0,0 +1,217 @@
+#include "bqRenderPool.h"
+
+#include <chrono>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace bq {
+static void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+	_mm_pause();
+#endif
+}
+
+// Sleeps until woken, unless word no longer holds expected. May return
+// spuriously.
+static void futex_wait(std::atomic<std::uint32_t> &word,
+	std::uint32_t expected)
+{
+#if defined(__linux__)
+	syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word),
+		FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+	// Without futexes, the workers poll instead
+	(void)word;
+	(void)expected;
+	std::this_thread::sleep_for(std::chrono::microseconds(100));
+#endif
+}
+
+static void futex_wake_all(std::atomic<std::uint32_t> &word)
+{
+#if defined(__linux__)
+	syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word),
+		FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#else
+	(void)word;
+#endif
+}
+
+RenderPool::RenderPool(unsigned int num_workers, bool pin_workers,
+	int realtime_priority)
+{
+	_workers.reserve(num_workers);
+	for (unsigned int i = 0; i < num_workers; ++i) {
+		_workers.emplace_back(&RenderPool::_work, this, i, pin_workers,
+			realtime_priority);
+	}
+}
+
+RenderPool::~RenderPool()
+{
+	_quit.store(true, std::memory_order_relaxed);
+	_generation.fetch_add(1, std::memory_order_seq_cst);
+	futex_wake_all(_generation);
+
+	for (std::thread &worker : _workers) {
+		worker.join();
+	}
+}
+
+unsigned int RenderPool::get_num_workers()
+{
+	return static_cast<unsigned int>(_workers.size());
+}
+
+void RenderPool::run(Job job, void *context, unsigned int num_jobs)
+{
+	if (_workers.empty() || num_jobs < 2) {
+		for (unsigned int i = 0; i < num_jobs; ++i) {
+			job(context, i);
+		}
+		return;
+	}
+
+	_job = job;
+	_context = context;
+
+	for (unsigned int first = 0; first < num_jobs;
+		first += _MAX_ROUND_NUM_JOBS) {
+		unsigned int round_num_jobs = num_jobs - first;
+		if (round_num_jobs > _MAX_ROUND_NUM_JOBS) {
+			round_num_jobs = _MAX_ROUND_NUM_JOBS;
+		}
+
+		_first_job_idx = first;
+		_num_done.store(0, std::memory_order_relaxed);
+
+		// Publishes the round; everything written above is visible to
+		// whoever claims one of its jobs
+		std::uint32_t generation = _generation.load(
+			std::memory_order_relaxed) + 1;
+		_claim.store((static_cast<std::uint64_t>(generation) << 32) |
+			(static_cast<std::uint64_t>(round_num_jobs) << 16),
+			std::memory_order_release);
+
+		// The seq_cst pairs with the workers' increment of
+		// _num_sleeping, so a worker about to sleep is never missed
+		_generation.store(generation, std::memory_order_seq_cst);
+		if (_num_sleeping.load(std::memory_order_seq_cst) > 0) {
+			futex_wake_all(_generation);
+		}
+
+		_run_jobs();
+
+		// Only jobs already claimed by a worker can be left, so this
+		// never waits for a worker that's asleep
+		while (_num_done.load(std::memory_order_acquire) <
+			round_num_jobs) {
+			cpu_relax();
+		}
+	}
+}
+
+void RenderPool::_work(unsigned int worker_idx, bool pin,
+	int realtime_priority)
+{
+#if defined(__linux__)
+	if (pin) {
+		// Core 0 is left to the audio thread and the rest of the system
+		unsigned int num_cores = std::thread::hardware_concurrency();
+		if (num_cores > 1) {
+			cpu_set_t cores;
+			CPU_ZERO(&cores);
+			CPU_SET(1 + worker_idx % (num_cores - 1), &cores);
+			pthread_setaffinity_np(pthread_self(), sizeof(cores),
+				&cores);
+		}
+	}
+
+	// Fails without the privilege to do so, in which case the host has to
+	// raise the workers' priority itself
+	if (realtime_priority > 0) {
+		sched_param param;
+		param.sched_priority = realtime_priority;
+		pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	}
+#else
+	(void)worker_idx;
+	(void)pin;
+	(void)realtime_priority;
+#endif
+
+	// Not loaded from _generation, since run() may already have bumped it
+	// by the time this thread starts
+	std::uint32_t seen_generation = 0;
+
+	for (;;) {
+		_wait_for_generation(seen_generation);
+		seen_generation = _generation.load(std::memory_order_acquire);
+
+		if (_quit.load(std::memory_order_relaxed)) {
+			return;
+		}
+
+		_run_jobs();
+	}
+}
+
+void RenderPool::_run_jobs()
+{
+	std::uint64_t claim = _claim.load(std::memory_order_acquire);
+
+	for (;;) {
+		unsigned int job_idx = static_cast<unsigned int>(
+			claim & 0xffff);
+		unsigned int num_jobs = static_cast<unsigned int>(
+			(claim >> 16) & 0xffff);
+		if (job_idx >= num_jobs) {
+			return;
+		}
+
+		// Fails if another thread claimed the job first, or if a new
+		// round started meanwhile; either way, claim is reloaded
+		if (!_claim.compare_exchange_weak(claim, claim + 1,
+			std::memory_order_acquire,
+			std::memory_order_acquire)) {
+			continue;
+		}
+
+		// The round can't end (and the job slots can't be rewritten)
+		// before this job is done
+		_job(_context, _first_job_idx + job_idx);
+		_num_done.fetch_add(1, std::memory_order_release);
+
+		claim = _claim.load(std::memory_order_acquire);
+	}
+}
+
+void RenderPool::_wait_for_generation(std::uint32_t seen_generation)
+{
+	for (unsigned int i = 0; i < _NUM_SPINS; ++i) {
+		if (_generation.load(std::memory_order_acquire) !=
+			seen_generation) {
+			return;
+		}
+		cpu_relax();
+	}
+
+	_num_sleeping.fetch_add(1, std::memory_order_seq_cst);
+	while (_generation.load(std::memory_order_seq_cst) ==
+		seen_generation) {
+		futex_wait(_generation, seen_generation);
+	}
+	_num_sleeping.fetch_sub(1, std::memory_order_relaxed);
+}
+}
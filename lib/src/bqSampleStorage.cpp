@@ -0,0 +1,295 @@
+#include "bqSampleStorage.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#if defined(__F16C__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace bq {
+// Frames read through the scratch buffer at a time when converting
+static constexpr ma_uint64 SCRATCH_NUM_FRAMES = 4096;
+
+static constexpr float S16_SCALE = 32768.0f;
+static constexpr float INV_S16_SCALE = 1.0f / 32768.0f;
+
+static std::uint16_t float_to_half(float value)
+{
+	std::uint32_t bits = 0;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	std::uint32_t sign = (bits >> 16) & 0x8000;
+	std::uint32_t float_exp = (bits >> 23) & 0xff;
+	std::uint32_t mant = bits & 0x7fffff;
+
+	// Infinity and NaN
+	if (float_exp == 0xff) {
+		return static_cast<std::uint16_t>(sign | 0x7c00 |
+			(mant ? 0x200 : 0));
+	}
+
+	int exp = static_cast<int>(float_exp) - 127 + 15;
+	if (exp >= 31) {
+		return static_cast<std::uint16_t>(sign | 0x7c00);
+	}
+
+	// Rounded to nearest, ties to even; a carry out of the mantissa
+	// correctly rolls over into the exponent
+	if (exp <= 0) {
+		if (exp < -10) {
+			return static_cast<std::uint16_t>(sign);
+		}
+
+		mant |= 0x800000;
+		unsigned int shift = static_cast<unsigned int>(14 - exp);
+		std::uint32_t half_mant = mant >> shift;
+		std::uint32_t rest = mant & ((1u << shift) - 1);
+		std::uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half_mant & 1))) {
+			++half_mant;
+		}
+
+		return static_cast<std::uint16_t>(sign | half_mant);
+	}
+
+	std::uint32_t half = sign | (static_cast<std::uint32_t>(exp) << 10) |
+		(mant >> 13);
+	std::uint32_t rest = mant & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+		++half;
+	}
+
+	return static_cast<std::uint16_t>(half);
+}
+
+static float half_to_float(std::uint16_t half)
+{
+	std::uint32_t sign = static_cast<std::uint32_t>(half & 0x8000) << 16;
+	std::uint32_t exp = (half >> 10) & 0x1f;
+	std::uint32_t mant = half & 0x3ff;
+
+	std::uint32_t bits = 0;
+	if (exp == 0) {
+		if (mant == 0) {
+			bits = sign;
+		} else {
+			// Subnormal, so normalize it
+			exp = 127 - 15 + 1;
+			while (!(mant & 0x400)) {
+				mant <<= 1;
+				--exp;
+			}
+			bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+		}
+	} else if (exp == 31) {
+		bits = sign | 0x7f800000 | (mant << 13);
+	} else {
+		bits = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+	}
+
+	float value = 0.0f;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static std::int16_t float_to_s16(float value)
+{
+	// Converting NaN to an integer is undefined
+	if (std::isnan(value)) {
+		return 0;
+	}
+
+	float scaled = value * S16_SCALE;
+	if (scaled < -32768.0f) {
+		scaled = -32768.0f;
+	} else if (scaled > 32767.0f) {
+		scaled = 32767.0f;
+	}
+
+	return static_cast<std::int16_t>(scaled < 0.0f ? scaled - 0.5f :
+		scaled + 0.5f);
+}
+
+size_t sample_storage_num_bytes(SampleStorage storage)
+{
+	switch (storage) {
+	case SampleStorage::S16:
+	case SampleStorage::F16:
+		return sizeof(std::uint16_t);
+
+	default:
+		return sizeof(float);
+	}
+}
+
+void *allocate_samples(SampleStorage storage, ma_uint64 num_samples)
+{
+	return ::operator new(static_cast<size_t>(num_samples *
+		sample_storage_num_bytes(storage)));
+}
+
+void free_samples(void *samples)
+{
+	::operator delete(samples);
+}
+
+void *sample_at(void *samples, SampleStorage storage, ma_uint64 sample_idx)
+{
+	return static_cast<unsigned char *>(samples) + sample_idx *
+		sample_storage_num_bytes(storage);
+}
+
+const void *sample_at(const void *samples, SampleStorage storage,
+	ma_uint64 sample_idx)
+{
+	return static_cast<const unsigned char *>(samples) + sample_idx *
+		sample_storage_num_bytes(storage);
+}
+
+void store_samples(void *dest, SampleStorage storage, const float *src,
+	ma_uint64 num_samples)
+{
+	ma_uint64 i = 0;
+
+	switch (storage) {
+	case SampleStorage::S16: {
+		std::int16_t *s16 = static_cast<std::int16_t *>(dest);
+#if defined(__AVX2__)
+		// Same as float_to_s16(): NaN becomes 0, and the rest are
+		// clamped and then rounded half away from zero
+		__m256 scale = _mm256_set1_ps(S16_SCALE);
+		__m256 lowest = _mm256_set1_ps(-32768.0f);
+		__m256 highest = _mm256_set1_ps(32767.0f);
+		__m256 sign_mask = _mm256_set1_ps(-0.0f);
+		__m256 half = _mm256_set1_ps(0.5f);
+		for (; i + 8 <= num_samples; i += 8) {
+			__m256 scaled = _mm256_mul_ps(_mm256_loadu_ps(src + i),
+				scale);
+			scaled = _mm256_and_ps(scaled, _mm256_cmp_ps(scaled,
+				scaled, _CMP_ORD_Q));
+			scaled = _mm256_min_ps(_mm256_max_ps(scaled, lowest),
+				highest);
+			scaled = _mm256_add_ps(scaled, _mm256_or_ps(half,
+				_mm256_and_ps(scaled, sign_mask)));
+
+			__m256i wide = _mm256_cvttps_epi32(scaled);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(s16 + i),
+				_mm_packs_epi32(_mm256_castsi256_si128(wide),
+				_mm256_extracti128_si256(wide, 1)));
+		}
+#endif
+		for (; i < num_samples; ++i) {
+			s16[i] = float_to_s16(src[i]);
+		}
+		break;
+	}
+
+	case SampleStorage::F16: {
+		std::uint16_t *f16 = static_cast<std::uint16_t *>(dest);
+#if defined(__F16C__)
+		for (; i + 8 <= num_samples; i += 8) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(f16 + i),
+				_mm256_cvtps_ph(_mm256_loadu_ps(src + i),
+				_MM_FROUND_TO_NEAREST_INT));
+		}
+#endif
+		for (; i < num_samples; ++i) {
+			f16[i] = float_to_half(src[i]);
+		}
+		break;
+	}
+
+	default:
+		std::memcpy(dest, src, num_samples * sizeof(float));
+		break;
+	}
+}
+
+void load_samples(float *dest, const void *src, SampleStorage storage,
+	ma_uint64 num_samples)
+{
+	ma_uint64 i = 0;
+
+	switch (storage) {
+	case SampleStorage::S16: {
+		const std::int16_t *s16 = static_cast<const std::int16_t *>(
+			src);
+#if defined(__AVX2__)
+		__m256 scale = _mm256_set1_ps(INV_S16_SCALE);
+		for (; i + 8 <= num_samples; i += 8) {
+			__m128i packed = _mm_loadu_si128(
+				reinterpret_cast<const __m128i *>(s16 + i));
+			__m256 unpacked = _mm256_cvtepi32_ps(
+				_mm256_cvtepi16_epi32(packed));
+			_mm256_storeu_ps(dest + i, _mm256_mul_ps(unpacked,
+				scale));
+		}
+#endif
+		for (; i < num_samples; ++i) {
+			dest[i] = static_cast<float>(s16[i]) * INV_S16_SCALE;
+		}
+		break;
+	}
+
+	case SampleStorage::F16: {
+		const std::uint16_t *f16 = static_cast<const std::uint16_t *>(
+			src);
+#if defined(__F16C__)
+		for (; i + 8 <= num_samples; i += 8) {
+			_mm256_storeu_ps(dest + i, _mm256_cvtph_ps(
+				_mm_loadu_si128(reinterpret_cast<
+				const __m128i *>(f16 + i))));
+		}
+#endif
+		for (; i < num_samples; ++i) {
+			dest[i] = half_to_float(f16[i]);
+		}
+		break;
+	}
+
+	default:
+		std::memcpy(dest, src, num_samples * sizeof(float));
+		break;
+	}
+}
+
+ma_uint32 stored_num_channels(ma_uint32 song_num_channels,
+	ma_uint32 out_num_channels)
+{
+	return song_num_channels == 1 ? 1 : out_num_channels;
+}
+
+ma_uint64 read_samples(AudioSourceReader &reader, void *frames,
+	SampleStorage storage, ma_uint64 num_frames, ma_uint32 num_channels,
+	std::vector<float> &scratch)
+{
+	if (storage == SampleStorage::F32) {
+		return reader.read(static_cast<float *>(frames), num_frames);
+	}
+
+	scratch.resize(SCRATCH_NUM_FRAMES * num_channels);
+
+	ma_uint64 num_read = 0;
+	while (num_read < num_frames) {
+		ma_uint64 num_wanted = num_frames - num_read;
+		if (num_wanted > SCRATCH_NUM_FRAMES) {
+			num_wanted = SCRATCH_NUM_FRAMES;
+		}
+
+		ma_uint64 num_got = reader.read(scratch.data(), num_wanted);
+		store_samples(sample_at(frames, storage, num_read *
+			num_channels), storage, scratch.data(), num_got *
+			num_channels);
+		num_read += num_got;
+
+		if (num_got < num_wanted) {
+			break;
+		}
+	}
+
+	return num_read;
+}
+}
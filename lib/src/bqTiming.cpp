@@ -0,0 +1,139 @@
+#include "bqTiming.h"
+
+#include <chrono>
+
+namespace bq {
+TimingHistogram::TimingHistogram()
+{
+	_enabled = false;
+	_max = 0;
+}
+
+void TimingHistogram::set_enabled(bool enabled)
+{
+	_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool TimingHistogram::is_enabled() const
+{
+	return _enabled.load(std::memory_order_relaxed);
+}
+
+void TimingHistogram::record(ma_uint64 value)
+{
+	ma_uint64 max_value = (static_cast<ma_uint64>(1) << _MAX_MAGNITUDE);
+	if (value > max_value) {
+		value = max_value;
+	}
+
+	_buckets[_bucket_idx(value)].add(1);
+	_sum.add(value);
+	if (value > _max.load(std::memory_order_relaxed)) {
+		_max.store(value, std::memory_order_relaxed);
+	}
+	_count.add(1);
+}
+
+ma_uint64 TimingHistogram::get_count() const
+{
+	return _count.get();
+}
+
+ma_uint64 TimingHistogram::get_max() const
+{
+	return _max.load(std::memory_order_relaxed);
+}
+
+ma_uint64 TimingHistogram::get_percentile(double p) const
+{
+	// The buckets may be recorded into while we read them, so the total is
+	// taken from the buckets themselves rather than from _count
+	ma_uint64 total = 0;
+	for (unsigned int i = 0; i < _NUM_BUCKETS; ++i) {
+		total += _buckets[i].get();
+	}
+	if (total < 1) {
+		return 0;
+	}
+
+	if (p < 0.0) {
+		p = 0.0;
+	} else if (p > 100.0) {
+		p = 100.0;
+	}
+	ma_uint64 rank = static_cast<ma_uint64>(p / 100.0 *
+		static_cast<double>(total) + 0.5);
+	if (rank < 1) {
+		rank = 1;
+	}
+
+	ma_uint64 max_value = get_max();
+	ma_uint64 num_seen = 0;
+	for (unsigned int i = 0; i < _NUM_BUCKETS; ++i) {
+		num_seen += _buckets[i].get();
+		if (num_seen >= rank) {
+			ma_uint64 value = _bucket_highest_value(i);
+			return value < max_value ? value : max_value;
+		}
+	}
+
+	return max_value;
+}
+
+TimingSummary TimingHistogram::summarize() const
+{
+	TimingSummary summary;
+
+	summary.count = get_count();
+	if (summary.count > 0) {
+		summary.mean = _sum.get() / summary.count;
+	}
+	summary.p50 = get_percentile(50.0);
+	summary.p99 = get_percentile(99.0);
+	summary.p999 = get_percentile(99.9);
+	summary.max = get_max();
+
+	return summary;
+}
+
+ma_uint64 TimingHistogram::now()
+{
+	return static_cast<ma_uint64>(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch())
+		.count());
+}
+
+unsigned int TimingHistogram::_bucket_idx(ma_uint64 value)
+{
+	if (value < _NUM_SUB_BUCKETS) {
+		return static_cast<unsigned int>(value);
+	}
+
+	unsigned int magnitude = 0;
+	for (ma_uint64 v = value; v > 1; v >>= 1) {
+		++magnitude;
+	}
+
+	unsigned int shift = magnitude - _SUB_BUCKET_BITS;
+	unsigned int sub_bucket = static_cast<unsigned int>(
+		(value >> shift) - _NUM_SUB_BUCKETS);
+
+	return _NUM_SUB_BUCKETS + shift * _NUM_SUB_BUCKETS + sub_bucket;
+}
+
+ma_uint64 TimingHistogram::_bucket_highest_value(unsigned int bucket_idx)
+{
+	if (bucket_idx < _NUM_SUB_BUCKETS) {
+		return bucket_idx;
+	}
+
+	unsigned int shift = (bucket_idx - _NUM_SUB_BUCKETS) /
+		_NUM_SUB_BUCKETS;
+	ma_uint64 sub_bucket = (bucket_idx - _NUM_SUB_BUCKETS) %
+		_NUM_SUB_BUCKETS;
+	ma_uint64 lowest_value = (_NUM_SUB_BUCKETS + sub_bucket) << shift;
+
+	return lowest_value + (static_cast<ma_uint64>(1) << shift) - 1;
+}
+}
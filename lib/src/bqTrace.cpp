@@ -0,0 +1,256 @@
+#include "bqTrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+namespace bq {
+namespace {
+std::atomic<ma_uint64> next_tracer_id(1);
+
+// Every thread has its own copy, so its address identifies the thread
+thread_local char thread_token;
+
+// The ring the calling thread claimed in the Tracer it last used, so that
+// recording usually doesn't have to search for it
+thread_local ma_uint64 cached_tracer_id = 0;
+thread_local unsigned int cached_ring_idx = 0;
+
+struct TypeInfo {
+	const char *name;
+	const char *value_name;
+	// Chrome trace phase: B(egin), E(nd), or i(nstant)
+	char phase;
+};
+
+const TypeInfo TYPE_INFO[static_cast<unsigned int>(
+	TraceEventType::NUM_TYPES)] = {
+	{ "audio msg push", "msg type", 'i' },
+	{ "audio msg pop", "msg type", 'i' },
+	{ "io msg push", "msg type", 'i' },
+	{ "io msg pop", "msg type", 'i' },
+	{ "decode", "want frame", 'B' },
+	{ "decode", "num frames", 'E' },
+	{ "chunk receive", "first frame", 'i' },
+	{ "preload", "song id", 'B' },
+	{ "preload", "num frames", 'E' },
+	{ "underrun", "num missing frames", 'i' },
+	{ "jump", "beat", 'i' },
+	{ "clip boundary", "clip idx", 'i' },
+	{ "soundtouch clear", "want frame", 'i' }
+};
+
+struct ThreadEvent {
+	TraceEvent event;
+	unsigned int thread;
+};
+}
+
+Tracer::Tracer() : _id(next_tracer_id.fetch_add(1))
+{
+}
+
+Tracer::~Tracer()
+{
+	for (unsigned int i = 0; i < TRACE_MAX_NUM_THREADS; ++i) {
+		delete[] _rings[i].events;
+		_rings[i].events = nullptr;
+	}
+}
+
+void Tracer::set_enabled(bool enabled)
+{
+	if (enabled && !_allocated.load(std::memory_order_acquire)) {
+		for (unsigned int i = 0; i < TRACE_MAX_NUM_THREADS; ++i) {
+			_rings[i].events = new TraceEvent[
+				TRACE_RING_NUM_EVENTS];
+		}
+		_allocated.store(true, std::memory_order_release);
+	}
+
+	_enabled.store(enabled, std::memory_order_release);
+}
+
+void Tracer::record(TraceEventType type, unsigned int playhead,
+	unsigned int track, double value)
+{
+	if (!is_enabled() || !_allocated.load(std::memory_order_acquire)) {
+		return;
+	}
+
+	_Ring *ring = _current_thread_ring();
+	if (!ring) {
+		return;
+	}
+
+	ma_uint64 write_idx = ring->write_idx.load(std::memory_order_relaxed);
+	TraceEvent &event = ring->events[write_idx % TRACE_RING_NUM_EVENTS];
+	event.time_ns = static_cast<ma_uint64>(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch())
+		.count());
+	event.value = value;
+	event.type = type;
+	event.playhead = playhead < TRACE_NO_IDX ?
+		static_cast<ma_uint8>(playhead) : TRACE_NO_IDX;
+	event.track = track < TRACE_NO_IDX ?
+		static_cast<ma_uint8>(track) : TRACE_NO_IDX;
+	ring->write_idx.store(write_idx + 1, std::memory_order_release);
+}
+
+void Tracer::name_thread(const char *name)
+{
+	if (!is_enabled()) {
+		return;
+	}
+
+	_Ring *ring = _current_thread_ring();
+	if (ring && !ring->name.load(std::memory_order_relaxed)) {
+		ring->name.store(name, std::memory_order_relaxed);
+	}
+}
+
+void Tracer::write_chrome_json(std::ostream &out)
+{
+	std::vector<ThreadEvent> events;
+
+	if (_allocated.load(std::memory_order_acquire)) {
+		for (unsigned int i = 0; i < TRACE_MAX_NUM_THREADS; ++i) {
+			_Ring &ring = _rings[i];
+
+			ma_uint64 end = ring.write_idx.load(
+				std::memory_order_acquire);
+			ma_uint64 begin = end > TRACE_RING_NUM_EVENTS ?
+				end - TRACE_RING_NUM_EVENTS : 0;
+
+			std::vector<ThreadEvent> ring_events;
+			for (ma_uint64 j = begin; j < end; ++j) {
+				ThreadEvent thread_event;
+				thread_event.event = ring.events[
+					j % TRACE_RING_NUM_EVENTS];
+				thread_event.thread = i;
+				ring_events.push_back(thread_event);
+			}
+
+			// Anything the thread overwrote while we were copying
+			// is garbage
+			ma_uint64 new_end = ring.write_idx.load(
+				std::memory_order_acquire);
+			ma_uint64 num_overwritten = 0;
+			if (new_end > TRACE_RING_NUM_EVENTS &&
+				new_end - TRACE_RING_NUM_EVENTS > begin) {
+				num_overwritten = new_end -
+					TRACE_RING_NUM_EVENTS - begin;
+			}
+			if (num_overwritten > ring_events.size()) {
+				num_overwritten = ring_events.size();
+			}
+
+			events.insert(events.end(), ring_events.begin() +
+				static_cast<std::ptrdiff_t>(num_overwritten),
+				ring_events.end());
+		}
+	}
+
+	std::stable_sort(events.begin(), events.end(),
+		[](const ThreadEvent &a, const ThreadEvent &b) {
+			return a.event.time_ns < b.event.time_ns;
+		});
+
+	char line[256];
+	bool first = true;
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+
+	for (unsigned int i = 0; i < TRACE_MAX_NUM_THREADS; ++i) {
+		const char *name = _rings[i].name.load(
+			std::memory_order_relaxed);
+		if (!name) {
+			continue;
+		}
+
+		std::snprintf(line, sizeof(line), "%s{\"name\":\"thread_name\","
+			"\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+			"\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", i,
+			name);
+		out << line;
+		first = false;
+	}
+
+	ma_uint64 first_time_ns = events.empty() ? 0 :
+		events.front().event.time_ns;
+	for (const ThreadEvent &thread_event : events) {
+		const TraceEvent &event = thread_event.event;
+		unsigned int type = static_cast<unsigned int>(event.type);
+		if (type >= static_cast<unsigned int>(
+			TraceEventType::NUM_TYPES)) {
+			continue;
+		}
+		const TypeInfo &info = TYPE_INFO[type];
+
+		double ts_us = static_cast<double>(event.time_ns -
+			first_time_ns) / 1000.0;
+
+		std::snprintf(line, sizeof(line), "%s{\"name\":\"%s\","
+			"\"ph\":\"%c\",%s\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+			"\"args\":{\"%s\":%.17g", first ? "" : ",\n",
+			info.name, info.phase, info.phase == 'i' ?
+			"\"s\":\"t\"," : "", thread_event.thread, ts_us,
+			info.value_name, event.value);
+		out << line;
+		first = false;
+
+		if (event.playhead != TRACE_NO_IDX) {
+			out << ",\"playhead\":" <<
+				static_cast<unsigned int>(event.playhead);
+		}
+		if (event.track != TRACE_NO_IDX) {
+			out << ",\"track\":" <<
+				static_cast<unsigned int>(event.track);
+		}
+		out << "}}";
+	}
+
+	out << "\n]}\n";
+}
+
+bool Tracer::write_chrome_json(const std::string &filename)
+{
+	std::ofstream out(filename);
+	if (!out) {
+		return false;
+	}
+
+	write_chrome_json(out);
+
+	return static_cast<bool>(out);
+}
+
+Tracer::_Ring *Tracer::_current_thread_ring()
+{
+	if (cached_tracer_id == _id) {
+		return &_rings[cached_ring_idx];
+	}
+
+	// Rings are claimed in order and never given back, so the calling
+	// thread's ring, if it has one, comes before the first unclaimed one
+	const void *token = &thread_token;
+	for (unsigned int i = 0; i < TRACE_MAX_NUM_THREADS; ++i) {
+		const void *owner = _rings[i].owner.load(
+			std::memory_order_relaxed);
+		if (!owner && _rings[i].owner.compare_exchange_strong(owner,
+			token, std::memory_order_relaxed)) {
+			owner = token;
+		}
+
+		if (owner == token) {
+			cached_tracer_id = _id;
+			cached_ring_idx = i;
+			return &_rings[i];
+		}
+	}
+
+	return nullptr;
+}
+}
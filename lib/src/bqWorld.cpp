@@ -1,33 +1,115 @@
 #include "bqWorld.h"
+#include "bqRealtimeAudit.h"
+
+#include <cstring>
 
 namespace bq {
-World::World(ma_uint32 num_channels, ma_uint32 sample_rate)
+World::World(ma_uint32 num_channels, ma_uint32 sample_rate,
+	const WorldConfig &config)
 {
 	_library = new Library;
 	_library->set_out_sample_rate(sample_rate);
+	_owns_library = true;
 
-	_audio = new AudioEngine;
-	_audio->set_playback_config(num_channels, sample_rate);
-	_audio->bind_library(_library);
+	_init(num_channels, sample_rate, config);
+}
 
-	_io = new IOEngine;
-	_io->set_decode_config(num_channels, sample_rate);
-	_io->bind_library(_library);
+World::World(ma_uint32 num_channels, ma_uint32 sample_rate,
+	Library *shared_library, const WorldConfig &config)
+{
+	_library = shared_library;
+	_owns_library = false;
 
-	_io->bind_audio_engine(_audio);
-	_audio->bind_io_engine(_io);
+	_init(num_channels, sample_rate, config);
 }
 
 World::~World()
 {
+	delete _render_pool;
+	_render_pool = nullptr;
+
 	delete _audio;
 	_audio = nullptr;
 
 	delete _io;
 	_io = nullptr;
 
-	delete _library;
+	if (_owns_library) {
+		delete _library;
+	}
 	_library = nullptr;
+
+	delete _tracer;
+	_tracer = nullptr;
+}
+
+void World::_init(ma_uint32 num_channels, ma_uint32 sample_rate,
+	const WorldConfig &config)
+{
+	_num_channels = num_channels;
+	_sample_rate = sample_rate;
+	_config = config;
+	_buffer_sizes = config.resolve(sample_rate);
+
+	_audio = new AudioEngine(config.num_tracks, config.num_playheads);
+	_audio->set_playback_config(num_channels, sample_rate, _buffer_sizes);
+	_audio->bind_library(_library);
+
+	_io = new IOEngine(config.num_tracks, config.num_playheads);
+	_io->set_decode_config(num_channels, sample_rate, _buffer_sizes);
+	_io->set_memory_budget(config.memory_budget_num_bytes);
+	_io->bind_library(_library);
+
+	_io->bind_audio_engine(_audio);
+	_audio->bind_io_engine(_io);
+
+	_tracer = new Tracer;
+	_audio->bind_tracer(_tracer);
+	_io->bind_tracer(_tracer);
+
+	ma_uint64 mix_block_num_samples = _MIX_BLOCK_NUM_FRAMES * num_channels;
+	_mix_frames.allocate(static_cast<size_t>(mix_block_num_samples *
+		config.num_tracks), 0.0f);
+	_mix_track_frames.allocate(config.num_tracks, nullptr);
+	for (unsigned int i = 0; i < config.num_tracks; ++i) {
+		_mix_track_frames[i] = &_mix_frames[i * mix_block_num_samples];
+	}
+
+	if (config.num_render_workers > 0) {
+		_render_pool = new RenderPool(config.num_render_workers,
+			config.pin_render_workers,
+			config.render_worker_priority);
+	}
+}
+
+ma_uint32 World::get_num_channels()
+{
+	return _num_channels;
+}
+
+ma_uint32 World::get_sample_rate()
+{
+	return _sample_rate;
+}
+
+unsigned int World::get_num_tracks()
+{
+	return _config.num_tracks;
+}
+
+unsigned int World::get_num_playheads()
+{
+	return _config.num_playheads;
+}
+
+const WorldConfig &World::get_config()
+{
+	return _config;
+}
+
+const BufferSizes &World::get_buffer_sizes()
+{
+	return _buffer_sizes;
 }
 
 double World::get_bpm()
@@ -78,15 +160,61 @@ unsigned int World::add_song(const std::string &filename, double sample_rate,
 	return song_id;
 }
 
+unsigned int World::add_song(const float *frames, ma_uint64 num_frames,
+	ma_uint32 num_channels, double sample_rate, double bpm, bool copy)
+{
+	unsigned int song_id = 0;
+
+	if (_library) {
+		song_id = _library->add_song(frames, num_frames, num_channels,
+			sample_rate, bpm, copy);
+	}
+
+	return song_id;
+}
+
+unsigned int World::add_song(const void *data, size_t num_bytes,
+	double sample_rate, double bpm, bool copy)
+{
+	unsigned int song_id = 0;
+
+	if (_library) {
+		song_id = _library->add_song(data, num_bytes, sample_rate, bpm,
+			copy);
+	}
+
+	return song_id;
+}
+
+unsigned int World::add_song(std::shared_ptr<const AudioSource> source,
+	double bpm)
+{
+	unsigned int song_id = 0;
+
+	if (_library) {
+		song_id = _library->add_song(source, bpm);
+	}
+
+	return song_id;
+}
+
+void World::set_song_preload_seconds(unsigned int song_id,
+	double preload_seconds)
+{
+	if (_library) {
+		_library->set_preload_seconds(song_id, preload_seconds);
+	}
+}
+
 void World::insert_clip(unsigned int track_idx, double start_beat,
 	double end_beat, double fade_in_beats, double fade_out_beats,
 	double pitch_shift_semitones, ma_uint64 first_frame,
-	unsigned int song_id)
+	unsigned int song_id, double preload_seconds)
 {
 	if (_io) {
 		_io->insert_clip(track_idx, start_beat, end_beat, fade_in_beats,
 			fade_out_beats, song_id, first_frame,
-			pitch_shift_semitones);
+			pitch_shift_semitones, preload_seconds);
 	}
 }
 
@@ -100,6 +228,10 @@ void World::erase_clips_range(unsigned int track_idx, double from_beat,
 
 void World::pump_audio_thread()
 {
+	BQ_REALTIME_AUDIT_SCOPE();
+
+	name_trace_thread("audio");
+
 	if (_audio) {
 		_audio->handle_all_msgs();
 	}
@@ -107,6 +239,8 @@ void World::pump_audio_thread()
 
 void World::pump_io_thread()
 {
+	name_trace_thread("io");
+
 	if (_io) {
 		_io->handle_all_msgs();
 	}
@@ -122,16 +256,140 @@ void World::decode_chunks(unsigned int playhead_idx, unsigned int track_idx)
 void World::pull_audio(unsigned int playhead_idx, unsigned int track_idx,
 	float *out_frames, ma_uint64 num_frames)
 {
+	BQ_REALTIME_AUDIT_SCOPE();
+
 	if (_audio) {
 		_audio->pull(playhead_idx, track_idx, out_frames, num_frames);
 	}
 }
 
+void World::pull_audio_planar(unsigned int playhead_idx,
+	unsigned int track_idx, float *const *out_channels,
+	ma_uint64 num_frames)
+{
+	BQ_REALTIME_AUDIT_SCOPE();
+
+	if (_audio) {
+		_audio->pull_planar(playhead_idx, track_idx, out_channels,
+			num_frames);
+	}
+}
+
 void World::pull_done_advance_playhead(unsigned int playhead_idx,
 	ma_uint64 num_frames)
 {
+	BQ_REALTIME_AUDIT_SCOPE();
+
 	if (_audio) {
 		_audio->pull_done_advance_playhead(playhead_idx, num_frames);
 	}
 }
+
+void World::pull_mix(unsigned int playhead_idx, void *out_frames,
+	MixFormat format, ma_uint64 num_frames)
+{
+	BQ_REALTIME_AUDIT_SCOPE();
+
+	size_t frame_num_bytes = mix_format_num_bytes(format) * _num_channels;
+	if (!_audio || playhead_idx >= _config.num_playheads) {
+		std::memset(out_frames, 0, num_frames * frame_num_bytes);
+		return;
+	}
+
+	unsigned char *out = static_cast<unsigned char *>(out_frames);
+	unsigned int num_tracks = _config.num_tracks;
+
+	// Rendering a block at a time and advancing the playhead after each
+	// one sounds the same as being called with shorter buffers
+	for (ma_uint64 i = 0; i < num_frames; i += _MIX_BLOCK_NUM_FRAMES) {
+		ma_uint64 block_num_frames = num_frames - i;
+		if (block_num_frames > _MIX_BLOCK_NUM_FRAMES) {
+			block_num_frames = _MIX_BLOCK_NUM_FRAMES;
+		}
+
+		_audio->pull_tracks(playhead_idx, _mix_track_frames.begin(),
+			num_tracks, block_num_frames, _render_pool);
+		mix_samples(out + i * frame_num_bytes, format,
+			_mix_track_frames.begin(), num_tracks,
+			block_num_frames * _num_channels, _mix_dither);
+
+		_audio->pull_done_advance_playhead(playhead_idx,
+			block_num_frames);
+	}
+}
+
+Stats World::get_stats()
+{
+	Stats stats;
+	stats.num_tracks = _config.num_tracks;
+	stats.num_playheads = _config.num_playheads;
+	stats.streams.resize(static_cast<size_t>(_config.num_playheads) *
+		_config.num_tracks);
+
+	if (_audio) {
+		_audio->get_stats(stats);
+	}
+
+	if (_io) {
+		_io->get_stats(stats);
+	}
+
+	return stats;
+}
+
+void World::set_offline_rendering(bool offline)
+{
+	if (_audio) {
+		_audio->set_offline(offline);
+	}
+}
+
+void World::set_timing_enabled(bool enabled)
+{
+	if (_audio) {
+		_audio->set_timing_enabled(enabled);
+	}
+
+	if (_io) {
+		_io->set_timing_enabled(enabled);
+	}
+}
+
+TimingStats World::get_timing_stats()
+{
+	TimingStats stats;
+
+	if (_audio) {
+		_audio->get_timing_stats(stats);
+	}
+
+	if (_io) {
+		_io->get_timing_stats(stats);
+	}
+
+	return stats;
+}
+
+void World::set_tracing_enabled(bool enabled)
+{
+	if (_tracer) {
+		_tracer->set_enabled(enabled);
+	}
+}
+
+void World::name_trace_thread(const char *name)
+{
+	if (_tracer && _tracer->is_enabled()) {
+		_tracer->name_thread(name);
+	}
+}
+
+bool World::write_trace(const std::string &filename)
+{
+	if (_tracer) {
+		return _tracer->write_chrome_json(filename);
+	}
+
+	return false;
+}
 }
@@ -0,0 +1,71 @@
+#include "bqWorldConfig.h"
+
+#include <cmath>
+
+namespace bq {
+ma_uint64 BufferSizes::preload_num_bytes(ma_uint32 num_channels) const
+{
+	return preload_num_frames * num_channels *
+		sample_storage_num_bytes(sample_storage);
+}
+
+ma_uint64 BufferSizes::chunk_num_bytes(ma_uint32 num_channels) const
+{
+	return chunk_num_frames * num_channels *
+		sample_storage_num_bytes(sample_storage);
+}
+
+ma_uint64 BufferSizes::ring_num_bytes(ma_uint32 num_channels) const
+{
+	return ring_num_slots * ring_slot_num_frames * num_channels *
+		sample_storage_num_bytes(sample_storage);
+}
+
+ma_uint64 BufferSizes::stream_num_bytes(ma_uint32 num_channels) const
+{
+	if (STREAMER_USE_RING_BUFFERS) {
+		return ring_num_bytes(num_channels);
+	}
+
+	// The chunk being played, the ones covering the window, and the one
+	// decoded as the window moves past the last of those
+	ma_uint64 num_chunks = (next_chunk_window_num_frames +
+		chunk_num_frames - 1) / chunk_num_frames + 2;
+	return num_chunks * chunk_num_bytes(num_channels);
+}
+
+BufferSizes WorldConfig::resolve(ma_uint32 sample_rate) const
+{
+	BufferSizes sizes;
+	sizes.sample_storage = sample_storage;
+	sizes.preload_num_frames = seconds_to_frames(preload_seconds,
+		sample_rate);
+	sizes.chunk_num_frames = seconds_to_frames(chunk_seconds, sample_rate);
+	sizes.next_chunk_window_num_frames = seconds_to_frames(
+		next_chunk_window_seconds, sample_rate);
+	sizes.ring_slot_num_frames = seconds_to_frames(ring_slot_seconds,
+		sample_rate);
+
+	// Enough slots for the whole window plus the one being decoded
+	ma_uint64 num_window_slots = (sizes.next_chunk_window_num_frames +
+		sizes.ring_slot_num_frames - 1) / sizes.ring_slot_num_frames +
+		1;
+	sizes.ring_num_slots = STREAMER_RING_NUM_SLOTS;
+	if (sizes.ring_num_slots < num_window_slots) {
+		sizes.ring_num_slots = static_cast<unsigned int>(
+			num_window_slots);
+	}
+
+	return sizes;
+}
+
+ma_uint64 seconds_to_frames(double seconds, ma_uint32 sample_rate)
+{
+	double num_frames = std::round(seconds * sample_rate);
+	if (num_frames < 1.0) {
+		return 1;
+	}
+
+	return static_cast<ma_uint64>(num_frames);
+}
+}